@@ -0,0 +1,45 @@
+#include <benchmark/benchmark.h>
+
+#include "assembler.h"
+
+// A program of the given number of lines: a tag every 16, and instructions of every shape in
+// between, literals and tag references included
+static std::string GenerateSource(size_t lines)
+{
+    static const std::array<std::string, 8> shapes = {"ADD R0, R1, R2 ; three registers\n",
+                                                      "MOV R3, R4\n",
+                                                      "SET R5, h'1234\n",
+                                                      "INC R6\n",
+                                                      "LOAD R0, R7\n",
+                                                      "JNZ R1, R2\n",
+                                                      "NOP\n",
+                                                      "SET R2, Tag0\n"};
+    std::string source;
+    for (size_t line = 0; line < lines; ++line)
+    {
+        if (line % 16 == 0)
+        {
+            source += ":Tag" + std::to_string(line / 16) + "\n";
+            continue;
+        }
+        source += shapes[line % shapes.size()];
+    }
+    return source + "STOP\n";
+}
+
+static void BM_AssembleString(benchmark::State& state)
+{
+    const auto lines = static_cast<size_t>(state.range(0));
+    const std::string source = GenerateSource(lines);
+    size_t bytes = 0;
+    for (auto _ : state)
+    {
+        Assembler asmObj;
+        bytes = asmObj.AssembleString(source).size();
+        benchmark::DoNotOptimize(bytes);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * lines));
+    state.counters["binaryBytes"] = static_cast<double>(bytes);
+}
+BENCHMARK(BM_AssembleString)->ArgName("lines")->Arg(100)->Arg(1000)->Arg(10000)->Unit(
+    benchmark::kMillisecond);
@@ -0,0 +1,51 @@
+#include <benchmark/benchmark.h>
+
+#include <filesystem>
+
+#include "assembler.h"
+#include "batch_runner.h"
+
+// A batch of identical loop guests over a growing number of workers. Jobs per second should
+// grow close to linearly with the thread count, up to the number of cores.
+static void BM_BatchThroughput(benchmark::State& state)
+{
+    const auto threads = static_cast<size_t>(state.range(0));
+    const size_t jobCount = 64;
+
+    Assembler asmObj;
+    auto binProgram = asmObj.AssembleString(
+        "SET R0, 20000\n"
+        "SET R10, 0\n"
+        "goto:R2\n"
+        "INC R10\n"
+        "SUB R0, R10, R1\n"
+        "JNZ R1, R2\n"
+        "STOP\n");
+    const auto programPath =
+        std::filesystem::temp_directory_path() / "luinux_bench_batch_loop.bin";
+    std::ofstream(programPath, std::ios::binary)
+        .write(reinterpret_cast<const char*>(binProgram.data()), binProgram.size());
+
+    std::vector<BatchJob> jobs(jobCount, BatchJob{programPath.string()});
+    BatchRunner runner(BatchOptions{threads});
+    uint64_t instructions = 0;
+    for (auto _ : state)
+    {
+        for (const auto& result : runner.Run(jobs).results)
+        {
+            instructions += result.instructions;
+        }
+    }
+    std::filesystem::remove(programPath);
+
+    state.counters["jobs/s"] = benchmark::Counter(
+        static_cast<double>(state.iterations() * jobCount), benchmark::Counter::kIsRate);
+    state.counters["MIPS"] =
+        benchmark::Counter(static_cast<double>(instructions) / 1e6, benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_BatchThroughput)
+    ->ArgName("threads")
+    ->RangeMultiplier(2)
+    ->Range(1, 16)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
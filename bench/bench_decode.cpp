@@ -0,0 +1,52 @@
+#include <benchmark/benchmark.h>
+
+#include "processor.h"
+
+namespace
+{
+// Exposes the decode stage on its own
+class DecodingProcessor : public Processor
+{
+   public:
+    using Processor::Processor;
+
+    void Decode(uint16_t word)
+    {
+        _fetchedInstruction = word;
+        _DecodeInstruction();
+        _CleanInstructionCycle();
+    }
+};
+
+std::vector<uint16_t> ValidWords()
+{
+    std::vector<uint16_t> words;
+    for (uint32_t word = 0; word <= 0xffff; ++word)
+    {
+        if (decodeTable[word].IsValid())
+        {
+            words.push_back(static_cast<uint16_t>(word));
+        }
+    }
+    return words;
+}
+}  // namespace
+
+// _DecodeInstruction over every word that decodes, literals fetched from zeroed program memory
+static void BM_DecodeAllWords(benchmark::State& state)
+{
+    const auto words = ValidWords();
+    Memory16 programMemory(0x10000);
+    DecodingProcessor cpu(programMemory);
+    for (auto _ : state)
+    {
+        for (uint16_t word : words)
+        {
+            cpu.Decode(word);
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * words.size()));
+    state.counters["validWords"] = static_cast<double>(words.size());
+}
+BENCHMARK(BM_DecodeAllWords)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,73 @@
+#include <benchmark/benchmark.h>
+
+#include "assembler.h"
+#include "lockstep_engine.h"
+
+// A parameter sweep: the same ALU loop for every lane, seeded with a different R0 each. Runs the
+// lanes either through the LockstepEngine or one Processor after the other, and reports lane MIPS.
+static void BM_LockstepSweep(benchmark::State& state)
+{
+    const auto lanes = static_cast<size_t>(state.range(0));
+    const bool lockstep = state.range(1) != 0;
+    const uint16_t iterations = 2000;
+    std::string program =
+        "SET R10, " + std::to_string(iterations) +
+        "\n"
+        "SET R1, 0\n"
+        "goto:R2\n"
+        "ADD R1, R0, R1\n"
+        "XOR R1, R10, R3\n"
+        "SHFL R3\n"
+        "AND R3, R0, R4\n"
+        "SUB R1, R4, R5\n"
+        "DEC R10\n"
+        "JNZ R10, R2\n"
+        "STOP\n";
+    // 3 SETs, the 7 instruction loop body, and the STOP
+    const uint64_t instructionsPerLane = 3 + 7 * uint64_t{iterations} + 1;
+
+    Assembler asmObj;
+    auto binProgram = asmObj.AssembleString(program);
+    uint64_t instructions = 0;
+
+    for (auto _ : state)
+    {
+        if (lockstep)
+        {
+            state.PauseTiming();
+            LockstepEngine engine(binProgram, lanes);
+            for (size_t lane = 0; lane < lanes; ++lane)
+            {
+                engine.WriteRegister(lane, RegisterId::R0, static_cast<uint16_t>(lane));
+            }
+            state.ResumeTiming();
+
+            engine.Run();
+            benchmark::DoNotOptimize(engine.ReadRegister(0, RegisterId::R5));
+        }
+        else
+        {
+            for (size_t lane = 0; lane < lanes; ++lane)
+            {
+                state.PauseTiming();
+                Memory16 programMemory(MainMemorySize);
+                programMemory.WritePayload(0, binProgram);
+                Processor cpu(programMemory);
+                cpu.WriteRegister(RegisterId::R0, static_cast<uint16_t>(lane));
+                state.ResumeTiming();
+
+                cpu.ExecuteAll();
+                benchmark::DoNotOptimize(cpu.ReadRegister(RegisterId::R5));
+            }
+        }
+        instructions += instructionsPerLane * lanes;
+    }
+
+    state.SetLabel(lockstep ? LockstepEngine::KernelName() : "processor");
+    state.counters["MIPS"] =
+        benchmark::Counter(static_cast<double>(instructions) / 1e6, benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_LockstepSweep)
+    ->ArgNames({"lanes", "lockstep"})
+    ->ArgsProduct({{16, 256, 1024}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
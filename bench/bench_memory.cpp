@@ -0,0 +1,63 @@
+#include <benchmark/benchmark.h>
+
+#include "memory.h"
+#include "register.h"
+
+using Memory16 = Memory<uint16_t>;
+
+// Word accesses striding through memory, two bytes at a time or an odd one so a word in every
+// 128 straddles two pages. A memory covering the whole address space skips the bounds checks.
+static void BM_MemoryRead16(benchmark::State& state)
+{
+    const auto size = static_cast<size_t>(state.range(0));
+    const auto stride = static_cast<uint16_t>(state.range(1));
+    Memory16 mem(size);
+    const uint16_t mask = static_cast<uint16_t>(size / 2 - 1);
+    uint16_t address = 0;
+    uint16_t sum = 0;
+    for (auto _ : state)
+    {
+        sum += mem.Read16(address & mask);
+        address += stride;
+    }
+    benchmark::DoNotOptimize(sum);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MemoryRead16)
+    ->ArgNames({"size", "stride"})
+    ->ArgsProduct({{0x1000, 0x10000}, {2, 3}});
+
+static void BM_MemoryWrite16(benchmark::State& state)
+{
+    const auto size = static_cast<size_t>(state.range(0));
+    const auto stride = static_cast<uint16_t>(state.range(1));
+    Memory16 mem(size);
+    const uint16_t mask = static_cast<uint16_t>(size / 2 - 1);
+    uint16_t address = 0;
+    for (auto _ : state)
+    {
+        mem.Write16(address & mask, address);
+        address += stride;
+    }
+    benchmark::ClobberMemory();
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MemoryWrite16)
+    ->ArgNames({"size", "stride"})
+    ->ArgsProduct({{0x1000, 0x10000}, {2, 3}});
+
+// A register in the internal memory bank, the way GetInternalMemory() lays them out
+static void BM_RegisterReadWrite(benchmark::State& state)
+{
+    Memory<uint8_t> internal(256);
+    Register reg(2 * static_cast<uint16_t>(RegisterId::R0), internal, RegisterId::R0);
+    uint16_t value = 0;
+    for (auto _ : state)
+    {
+        reg.Write(value);
+        value = static_cast<uint16_t>(reg.Read() + 1);
+    }
+    benchmark::DoNotOptimize(value);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RegisterReadWrite);
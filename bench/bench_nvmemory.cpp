@@ -0,0 +1,147 @@
+#include <benchmark/benchmark.h>
+
+#include "memory.h"
+#include "nvram_flusher.h"
+#include "nvram_journal.h"
+
+// Latency of NVMemory::Flush() after writing to a number of pages, comparing rewriting the whole
+// file through fstreams with writing back the dirty pages of a mapping.
+static void WriteZeroedFile(const std::string& filename)
+{
+    std::vector<char> zeroes(0x10000);
+    std::ofstream(filename, std::ios::binary | std::ios::trunc)
+        .write(zeroes.data(), static_cast<std::streamsize>(zeroes.size()));
+}
+
+static void BM_NVRamFlush(benchmark::State& state)
+{
+    const auto mode = static_cast<NVMemoryMode>(state.range(0));
+    const auto dirtyPages = static_cast<size_t>(state.range(1));
+    if (mode == NVMemoryMode::Mapped && !NVMemory16::IsMappingAvailable())
+    {
+        state.SkipWithError("No mapped NVRAM on this host");
+        return;
+    }
+
+    const std::string filename = "bench_nvmemory.bin";
+    WriteZeroedFile(filename);
+
+    {
+        NVMemory16 nvram(0x10000, filename, mode);
+        uint8_t value = 0;
+        for (auto _ : state)
+        {
+            ++value;
+            for (size_t page = 0; page < dirtyPages; ++page)
+            {
+                nvram.Write8(static_cast<uint16_t>(page * NVMemory16::PageSize), value);
+            }
+            nvram.Flush();
+        }
+    }
+    std::remove(filename.c_str());
+}
+BENCHMARK(BM_NVRamFlush)
+    ->ArgNames({"mapped", "dirtyPages"})
+    ->ArgsProduct({{static_cast<int64_t>(NVMemoryMode::Stream),
+                    static_cast<int64_t>(NVMemoryMode::Mapped)},
+                   {1, 16, 256}})
+    ->Unit(benchmark::kMicrosecond);
+
+// Time the guest spends per frame of NVRAM writes when it has to persist them: calling Flush()
+// itself, or leaving it to an NVRamFlusher writing every millisecond in the background.
+static void BM_NVRamGuestStall(benchmark::State& state)
+{
+    const bool background = state.range(0) != 0;
+    const auto dirtyPages = static_cast<size_t>(state.range(1));
+    if (background && !NVRamFlusher::IsAvailable())
+    {
+        state.SkipWithError("No background NVRAM flushing on this host");
+        return;
+    }
+
+    const std::string filename = "bench_nvram_stall.bin";
+    WriteZeroedFile(filename);
+    {
+        NVMemory16 nvram(0x10000, filename);
+        std::unique_ptr<NVRamFlusher> flusher;
+        if (background)
+        {
+            flusher = std::make_unique<NVRamFlusher>(nvram, std::chrono::milliseconds(1));
+        }
+
+        uint8_t value = 0;
+        for (auto _ : state)
+        {
+            ++value;
+            for (size_t page = 0; page < dirtyPages; ++page)
+            {
+                nvram.Write8(static_cast<uint16_t>(page * NVMemory16::PageSize), value);
+            }
+            if (!background)
+            {
+                nvram.Flush();
+            }
+        }
+        if (flusher)
+        {
+            state.counters["captures"] = static_cast<double>(flusher->GetStats().captures);
+        }
+    }
+    std::remove(filename.c_str());
+}
+BENCHMARK(BM_NVRamGuestStall)
+    ->ArgNames({"background", "dirtyPages"})
+    ->ArgsProduct({{0, 1}, {1, 16}})
+    ->Unit(benchmark::kMicrosecond);
+
+// Persisting a single STOR: rewriting the whole Stream mode image, or appending one record to an
+// NVRamJournal. Compaction kicks in every few thousand iterations and is part of the cost.
+static void BM_NVRamPersistSmallWrite(benchmark::State& state)
+{
+    const bool journaled = state.range(0) != 0;
+    if (journaled && !NVRamJournal::IsAvailable())
+    {
+        state.SkipWithError("No NVRAM journal on this host");
+        return;
+    }
+
+    const std::string filename = "bench_nvram_journal.bin";
+    WriteZeroedFile(filename);
+    {
+        NVMemory16 nvram(0x10000,
+                         filename,
+                         journaled ? NVMemoryMode::Journaled : NVMemoryMode::Stream);
+        std::unique_ptr<NVRamJournal> journal;
+        if (journaled)
+        {
+            journal = std::make_unique<NVRamJournal>(nvram);
+        }
+
+        uint16_t value = 0;
+        for (auto _ : state)
+        {
+            ++value;
+            nvram.Write16(static_cast<uint16_t>((value * 2) & 0xfffe), value);
+            if (journal)
+            {
+                journal->Flush();
+            }
+            else
+            {
+                nvram.Flush();
+            }
+        }
+        if (journal)
+        {
+            state.counters["compactions"] = static_cast<double>(journal->GetStats().compactions);
+        }
+    }
+    std::remove(filename.c_str());
+    std::remove(NVRamJournal::JournalPath(filename).c_str());
+}
+BENCHMARK(BM_NVRamPersistSmallWrite)
+    ->ArgNames({"journaled"})
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,448 @@
+#include <benchmark/benchmark.h>
+
+#include "assembler.h"
+#include "memory.h"
+#include "processor.h"
+#include "snapshot_file.h"
+#include "timer_device.h"
+
+using Memory16 = Memory<uint16_t>;
+
+// Runs the program to completion once per benchmark iteration and reports MIPS, given how many
+// instructions a single run retires.
+static void RunProgram(benchmark::State& state,
+                       const std::string& program,
+                       ExecutionEngine engine,
+                       bool superinstructions,
+                       uint64_t instructionsPerRun)
+{
+    if (engine == ExecutionEngine::Jit && !JitCompiler::IsAvailable())
+    {
+        state.SkipWithError("No JIT on this host");
+        return;
+    }
+    Assembler asmObj;
+    auto binProgram = asmObj.AssembleString(program);
+    uint64_t instructions = 0;
+
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        Memory16 programMemory(0x10000);
+        programMemory.WritePayload(0, binProgram);
+        Processor cpu(programMemory);
+        cpu.SetExecutionEngine(engine);
+        cpu.SetSuperinstructions(superinstructions);
+        state.ResumeTiming();
+
+        cpu.ExecuteAll();
+        benchmark::DoNotOptimize(cpu.ReadRegister(RegisterId::R10));
+        instructions += instructionsPerRun;
+    }
+
+    state.counters["MIPS"] =
+        benchmark::Counter(static_cast<double>(instructions) / 1e6, benchmark::Counter::kIsRate);
+}
+
+// Same shape as test/test_program/loop.txt, with a count big enough to dominate setup costs.
+static void BM_LoopMips(benchmark::State& state)
+{
+    const auto iterations = static_cast<uint16_t>(state.range(0));
+    std::string program =
+        "SET R0, " + std::to_string(iterations) +
+        "\n"
+        "SET R10, 0\n"
+        "goto:R2\n"
+        "INC R10\n"
+        "SUB R0, R10, R1\n"
+        "JNZ R1, R2\n"
+        "STOP\n";
+
+    // 3 SETs, the 3 instruction loop body, and the STOP
+    RunProgram(state,
+               program,
+               static_cast<ExecutionEngine>(state.range(1)),
+               state.range(2) != 0,
+               3 + 3 * uint64_t{iterations} + 1);
+}
+BENCHMARK(BM_LoopMips)
+    ->ArgNames({"iterations", "jit", "fused"})
+    ->Args({60000, static_cast<int64_t>(ExecutionEngine::Interpreter), 0})
+    ->Args({60000, static_cast<int64_t>(ExecutionEngine::Interpreter), 1})
+    ->Args({60000, static_cast<int64_t>(ExecutionEngine::Jit), 1})
+    ->Unit(benchmark::kMillisecond);
+
+// Arithmetic heavy loop where nothing reads RFL, so the flags of every ALU instruction but the
+// last are dead. Build with -DLUINUX_EAGER_FLAGS=ON to compare against updating RFL every time.
+static void BM_AluMips(benchmark::State& state)
+{
+    const auto iterations = static_cast<uint16_t>(state.range(0));
+    std::string program =
+        "SET R0, " + std::to_string(iterations) +
+        "\n"
+        "SET R10, 0\n"
+        "SET R3, 3\n"
+        "SET R4, 5\n"
+        "goto:R2\n"
+        "ADD R3, R4, R5\n"
+        "SUB R5, R3, R6\n"
+        "MUL R6, R4, R7\n"
+        "ADD R7, R5, R3\n"
+        "SMUL R3, R6, R8\n"
+        "SUB R8, R4, R4\n"
+        "INC R10\n"
+        "SUB R0, R10, R1\n"
+        "JNZ R1, R2\n"
+        "STOP\n";
+
+    // 5 SETs, the 9 instruction loop body, and the STOP
+    RunProgram(state,
+               program,
+               static_cast<ExecutionEngine>(state.range(1)),
+               true,
+               5 + 9 * uint64_t{iterations} + 1);
+}
+BENCHMARK(BM_AluMips)
+    ->ArgNames({"iterations", "jit"})
+    ->Args({60000, static_cast<int64_t>(ExecutionEngine::Interpreter)})
+    ->Args({60000, static_cast<int64_t>(ExecutionEngine::Jit)})
+    ->Unit(benchmark::kMillisecond);
+
+// Loop of memory accesses through LOAD/STOR and the stack, for the cost of the Memory accessors
+static void BM_MemoryMips(benchmark::State& state)
+{
+    const auto iterations = static_cast<uint16_t>(state.range(0));
+    std::string program =
+        "SET R0, " + std::to_string(iterations) +
+        "\n"
+        "SET R10, 0\n"
+        "SET R3, h'2000\n"
+        "goto:R2\n"
+        "STOR R10, R3\n"
+        "LOAD R3, R4\n"
+        "PUSH R4\n"
+        "POP R5\n"
+        "INC R10\n"
+        "SUB R0, R10, R1\n"
+        "JNZ R1, R2\n"
+        "STOP\n";
+
+    // 4 SETs, the 7 instruction loop body, and the STOP
+    RunProgram(state,
+               program,
+               ExecutionEngine::Interpreter,
+               true,
+               4 + 7 * uint64_t{iterations} + 1);
+}
+BENCHMARK(BM_MemoryMips)->ArgName("iterations")->Arg(60000)->Unit(benchmark::kMillisecond);
+
+// The loop from BM_LoopMips, run the way a scheduler time-slicing guests would, as a sequence of
+// Run() calls of slice instructions each.
+static void BM_RunSlices(benchmark::State& state)
+{
+    const auto slice = static_cast<uint64_t>(state.range(0));
+    Assembler asmObj;
+    auto binProgram = asmObj.AssembleString(
+        "SET R0, 60000\n"
+        "SET R10, 0\n"
+        "goto:R2\n"
+        "INC R10\n"
+        "SUB R0, R10, R1\n"
+        "JNZ R1, R2\n"
+        "STOP\n");
+    uint64_t instructions = 0;
+
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        Memory16 programMemory(0x10000);
+        programMemory.WritePayload(0, binProgram);
+        Processor cpu(programMemory);
+        state.ResumeTiming();
+
+        while (cpu.Run(slice) == StopReason::BudgetExhausted)
+        {
+        }
+        instructions += cpu.GetInstructionCount();
+    }
+
+    state.counters["MIPS"] =
+        benchmark::Counter(static_cast<double>(instructions) / 1e6, benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_RunSlices)->ArgName("slice")->Arg(10)->Arg(100)->Arg(10000)->Unit(
+    benchmark::kMillisecond);
+
+// Writes one word to each of the first pages of SRAM
+static std::string TouchPagesProgram(uint16_t pages)
+{
+    return "SET R0, 0\n"
+           "SET R1, " +
+           std::to_string(pages) +
+           "\n"
+           "SET R3, 256\n"
+           "goto:R2\n"
+           "STOR R1, R0\n"
+           "ADD R0, R3, R0\n"
+           "DEC R1\n"
+           "JNZ R1, R2\n"
+           "STOP\n";
+}
+
+// Forking a warm processor, given how many SRAM pages it has written. Pages are shared with the
+// fork, so the cost should barely move with the amount of memory in use.
+static void BM_Fork(benchmark::State& state)
+{
+    Assembler asmObj;
+    Memory16 programMemory(0x10000);
+    programMemory.WritePayload(
+        0, asmObj.AssembleString(TouchPagesProgram(static_cast<uint16_t>(state.range(0)))));
+    Processor cpu(programMemory);
+    cpu.ExecuteAll();
+
+    for (auto _ : state)
+    {
+        auto fork = cpu.Fork();
+        benchmark::DoNotOptimize(fork.get());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Fork)->ArgName("pages")->Arg(1)->Arg(64)->Arg(255);
+
+// Rewinding a processor to a checkpoint, in memory and through the snapshot file format
+static void BM_SnapshotRestore(benchmark::State& state)
+{
+    const bool throughFile = state.range(1) != 0;
+    Assembler asmObj;
+    Memory16 programMemory(0x10000);
+    programMemory.WritePayload(
+        0, asmObj.AssembleString(TouchPagesProgram(static_cast<uint16_t>(state.range(0)))));
+    Processor cpu(programMemory);
+    cpu.ExecuteAll();
+    const ProcessorSnapshot checkpoint = cpu.Snapshot();
+
+    std::stringstream file;
+    SnapshotFile::Write(file, checkpoint);
+    const std::string image = file.str();
+
+    for (auto _ : state)
+    {
+        if (throughFile)
+        {
+            std::stringstream in(image);
+            cpu.Restore(SnapshotFile::Read(in));
+        }
+        else
+        {
+            cpu.Restore(checkpoint);
+        }
+        benchmark::DoNotOptimize(cpu.ReadRegister(RegisterId::R0));
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["fileBytes"] = static_cast<double>(image.size());
+}
+BENCHMARK(BM_SnapshotRestore)
+    ->ArgNames({"pages", "file"})
+    ->ArgsProduct({{1, 255}, {0, 1}})
+    ->Unit(benchmark::kMicrosecond);
+
+// A guest waiting for 100 periods of a 10000 cycle timer, polling its status register or idling
+// in a jump to itself until the timer interrupt. Idle loops are skipped to the next event.
+static void BM_TimerWait(benchmark::State& state)
+{
+    const bool idle = state.range(0) != 0;
+    const std::string setup =
+        "SET R0, h'fb00\n"
+        "SET R1, h'fb02\n"
+        "SET R6, h'fb04\n"
+        "SET R3, 10000\n"
+        "STOR R3, R0\n"
+        "SET R9, 100\n"
+        "SET R10, 0\n";
+    const std::string polling = setup +
+                                "SET R3, 3 ; enabled, periodic\n"
+                                "STOR R3, R1\n"
+                                "goto:R2\n"
+                                "LOAD R6, R4\n"
+                                "ADD R10, R4, R10\n"
+                                "SUB R9, R10, R5\n"
+                                "JNZ R5, R2\n"
+                                "STOP\n";
+    const std::string idling = "JMP Main\n"
+                               ":Handler\n"
+                               "INC R10\n"
+                               "SUB R9, R10, R4\n"
+                               "SET R5, Return\n"
+                               "JNZ R4, R5\n"
+                               "STOP\n"
+                               ":Return\n"
+                               "POP RFL\n"
+                               "POP RIP\n"
+                               ":Main\n"
+                               "SET R7, h'0100\n"
+                               "SET R8, Handler\n"
+                               "STOR R8, R7\n" +
+                               setup +
+                               "SET R3, 7 ; enabled, periodic, interrupting\n"
+                               "STOR R3, R1\n"
+                               ":Idle\n"
+                               "JMP Idle\n";
+
+    Assembler asmObj;
+    const auto binProgram = asmObj.AssembleString(idle ? idling : polling);
+    uint64_t cycles = 0;
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        Memory16 programMemory(0x10000);
+        programMemory.WritePayload(0, binProgram);
+        Processor cpu(programMemory);
+        cpu.GetBus().Map(
+            TimerDevice::DefaultBase, DeviceBus::PageSize, std::make_shared<TimerDevice>(cpu));
+        cpu.SetVectorTable(0x0100);
+        state.ResumeTiming();
+
+        cpu.ExecuteAll();
+        cycles += cpu.GetInstructionCount();
+    }
+    state.counters["guestCycles"] =
+        benchmark::Counter(static_cast<double>(cycles), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_TimerWait)->ArgName("idle")->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+
+// A guest recovering from an out of range LOAD on every turn of a loop, its handler stepping over
+// the LOAD. Faults take the error code path and cost about as much as a short handler runs for.
+static void BM_HandledFaults(benchmark::State& state)
+{
+    Assembler asmObj;
+    const auto binProgram = asmObj.AssembleString(
+        "JMP Main\n"
+        ":Handler\n"
+        "POP R6\n"
+        "POP R7\n"
+        "INC R7\n"
+        "INC R7\n"
+        "PUSH R7\n"
+        "PUSH R6\n"
+        "POP RFL\n"
+        "POP RIP\n"
+        ":Main\n"
+        "SET R7, h'0104 ; AddressOutOfRange entry\n"
+        "SET R8, Handler\n"
+        "STOR R8, R7\n"
+        "SET R0, 10000\n"
+        "SET R10, 0\n"
+        "SET R3, h'ffff\n"
+        "goto:R2\n"
+        "LOAD R3, R4\n"
+        "INC R10\n"
+        "SUB R0, R10, R1\n"
+        "JNZ R1, R2\n"
+        "STOP\n");
+    uint64_t faults = 0;
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        Memory16 programMemory(0x10000);
+        programMemory.WritePayload(0, binProgram);
+        Processor cpu(programMemory);
+        cpu.SetVectorTable(0x0100);
+        state.ResumeTiming();
+
+        cpu.ExecuteAll();
+        faults += cpu.GetHandledFaultCount();
+    }
+    state.counters["faults"] =
+        benchmark::Counter(static_cast<double>(faults), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_HandledFaults)->Unit(benchmark::kMillisecond);
+
+// Cost of each instruction on its own, 16 copies of it in a loop of 1000 turns. The loop adds a
+// DEC and a JNZ per 16, BM_OpcodeCost/NOP is the baseline to compare against. Jumps are not taken
+// but JMP's, which goes to the next instruction. STOP, TRAP and SWM would end or change the run
+// and are left out, PUSH and POP are measured as a pair so the stack stays put.
+static void OpcodeCost(benchmark::State& state, const std::string& instruction)
+{
+    constexpr uint64_t Copies = 16;
+    constexpr uint64_t Turns = 1000;
+    std::string program =
+        "SET R0, 3\n"
+        "SET R1, 5\n"
+        "SET R3, 0\n"
+        "SET R9, " +
+        std::to_string(Turns) +
+        "\n"
+        "goto:R8\n";
+    for (uint64_t copy = 0; copy < Copies; ++copy)
+    {
+        if (instruction == "JMP")
+        {
+            const std::string tag = "Next" + std::to_string(copy);
+            program += "JMP " + tag + "\n:" + tag + "\n";
+            continue;
+        }
+        program += instruction + "\n";
+    }
+    program +=
+        "DEC R9\n"
+        "JNZ R9, R8\n"
+        "STOP\n";
+
+    Assembler asmObj;
+    const auto binProgram = asmObj.AssembleString(program);
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        Memory16 programMemory(0x10000);
+        programMemory.WritePayload(0, binProgram);
+        Processor cpu(programMemory);
+        state.ResumeTiming();
+
+        cpu.ExecuteAll();
+        benchmark::DoNotOptimize(cpu.ReadRegister(RegisterId::R2));
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * Copies * Turns));
+}
+
+static const bool opcodeCostRegistered = [] {
+    const std::vector<std::pair<std::string, std::string>> instructions = {
+        {"ADD", "ADD R0, R1, R2"},
+        {"SUB", "SUB R0, R1, R2"},
+        {"MUL", "MUL R0, R1, R2"},
+        {"DIV", "DIV R0, R1, R2"},
+        {"SMUL", "SMUL R0, R1, R2"},
+        {"SDIV", "SDIV R0, R1, R2"},
+        {"AND", "AND R0, R1, R2"},
+        {"OR", "OR R0, R1, R2"},
+        {"XOR", "XOR R0, R1, R2"},
+        {"JZ", "JZ R0, R1"},
+        {"JNZ", "JNZ R3, R1"},
+        {"MOV", "MOV R0, R2"},
+        {"JE", "JE R0, R1"},
+        {"JNE", "JNE R3, R1"},
+        {"TSTB", "TSTB R0, R1"},
+        {"LOAD", "LOAD R0, R2"},
+        {"STOR", "STOR R0, R1"},
+        {"SETZ", "SETZ R2"},
+        {"SETO", "SETO R2"},
+        {"SET", "SET R2, 7"},
+        {"PUSH_POP", "PUSH R0\nPOP R2"},
+        {"NOT", "NOT R2"},
+        {"SHFR", "SHFR R2"},
+        {"SHFL", "SHFL R2"},
+        {"INC", "INC R2"},
+        {"DEC", "DEC R2"},
+        {"NOP", "NOP"},
+        {"JMP", "JMP"},
+    };
+    for (const auto& [name, instruction] : instructions)
+    {
+        benchmark::RegisterBenchmark(("BM_OpcodeCost/" + name).c_str(),
+                                     [instruction = instruction](benchmark::State& state) {
+                                         OpcodeCost(state, instruction);
+                                     })
+            ->Unit(benchmark::kMicrosecond);
+    }
+    return true;
+}();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,85 @@
+#include <benchmark/benchmark.h>
+
+#include <filesystem>
+
+#include "assembler.h"
+#include "processor.h"
+
+// End to end runs of the sample programs in test/test_program, registered as
+// BM_TestProgram/<file>, and of the workloads tools/generate_workload.py made at build time,
+// registered as BM_Workload/<file>. Every iteration rewinds the processor to a snapshot and runs
+// the program again, the rewind is part of the cost but small next to a workload.
+namespace
+{
+// Enough for any of them to stop, a program still running after this is reported
+constexpr uint64_t Budget = 100000000;
+
+void RunProgramFile(benchmark::State& state, const std::filesystem::path& path)
+{
+    std::ifstream file(path);
+    std::stringstream source;
+    source << file.rdbuf();
+
+    std::vector<uint8_t> binProgram;
+    try
+    {
+        Assembler asmObj;
+        binProgram = asmObj.AssembleString(source.str());
+    }
+    catch (const std::exception& e)
+    {
+        state.SkipWithError(e.what());
+        return;
+    }
+
+    // Programs are only as long as their code, running off the end faults like a STOP would
+    Memory16 programMemory(0x10000);
+    programMemory.WritePayload(0, binProgram);
+    Processor cpu(programMemory);
+    const ProcessorSnapshot start = cpu.Snapshot();
+    const StopReason stop = cpu.Run(Budget);
+    if (stop != StopReason::Halted && stop != StopReason::Fault)
+    {
+        state.SkipWithError("The program doesn't stop");
+        return;
+    }
+    const uint64_t instructionsPerRun = cpu.GetInstructionCount();
+
+    uint64_t instructions = 0;
+    for (auto _ : state)
+    {
+        cpu.Restore(start);
+        cpu.Run(Budget);
+        instructions += instructionsPerRun;
+    }
+    state.counters["MIPS"] =
+        benchmark::Counter(static_cast<double>(instructions) / 1e6, benchmark::Counter::kIsRate);
+    state.counters["instructions"] = static_cast<double>(instructionsPerRun);
+}
+
+void RegisterPrograms(const std::string& prefix, const std::filesystem::path& directory)
+{
+    std::vector<std::filesystem::path> programs;
+    for (const auto& entry : std::filesystem::directory_iterator(directory))
+    {
+        if (entry.path().extension() == ".txt")
+        {
+            programs.push_back(entry.path());
+        }
+    }
+    std::sort(programs.begin(), programs.end());
+    for (const auto& path : programs)
+    {
+        benchmark::RegisterBenchmark(
+            (prefix + path.stem().string()).c_str(),
+            [path](benchmark::State& state) { RunProgramFile(state, path); })
+            ->Unit(benchmark::kMicrosecond);
+    }
+}
+
+const bool registered = [] {
+    RegisterPrograms("BM_TestProgram/", LUINUX_TEST_PROGRAM_DIR);
+    RegisterPrograms("BM_Workload/", LUINUX_WORKLOAD_DIR);
+    return true;
+}();
+}  // namespace
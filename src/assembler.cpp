@@ -180,7 +180,7 @@ std::vector<uint8_t> Assembler::AssembleFile()
     }
     while (std::getline(_inFileStream, stringLine))
     {
-        stringProgram += "\n" + stringLine;
+        stringProgram += stringLine + "\n";
     }
 
     _inFileStream.close();
@@ -207,9 +207,11 @@ std::string Assembler::_GetTag(std::string line) const
 
 std::vector<uint8_t> Assembler::AssembleString(std::string program)
 {
+    _tagAddressMap.clear();
     // First time just so that we can calculate the addresses of all tags
     (void)_AssembleStringHelper(program);
     _assembledPayload.clear();
+    _asmIndex.clear();
     _pendingLiteralValue = false;
     _literalValue = 0;
     // Now we do want to keep the code
@@ -303,6 +305,20 @@ void Assembler::WriteBinaryFile(std::vector<uint8_t>& program, bool stdOutPayloa
     }
 }
 
+DebugLineTable Assembler::GetLineTable() const
+{
+    DebugLineTable table;
+    for (const auto& index : _asmIndex)
+    {
+        table.AddLine(index.address, index.lineNumber);
+    }
+    for (const auto& [tag, address] : _tagAddressMap)
+    {
+        table.AddTag(tag, address);
+    }
+    return table;
+}
+
 bool Assembler::_IsSpecialInstruction(OpCodeId opcodeId) const
 {
     switch (opcodeId)
@@ -0,0 +1,225 @@
+#include "batch_runner.h"
+
+#include <chrono>
+#include <filesystem>
+
+#include "utils.h"
+#include "work_stealing_pool.h"
+
+namespace
+{
+std::vector<uint8_t> ReadFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("Could not open " + path);
+    }
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), {});
+}
+
+std::string Resolve(const std::string& path, const std::string& baseDirectory)
+{
+    std::filesystem::path resolved(path);
+    if (resolved.is_relative() && !baseDirectory.empty())
+    {
+        resolved = std::filesystem::path(baseDirectory) / resolved;
+    }
+    return resolved.string();
+}
+}  // namespace
+
+std::vector<BatchJob> BatchRunner::ParseManifest(std::istream& manifest,
+                                                 const std::string& baseDirectory)
+{
+    std::vector<BatchJob> jobs;
+    std::string line;
+    unsigned lineNumber = 0;
+    while (std::getline(manifest, line))
+    {
+        ++lineNumber;
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+
+        std::string program;
+        if (!(fields >> program))
+        {
+            continue;
+        }
+        BatchJob job;
+        job.program = Resolve(program, baseDirectory);
+
+        std::string nvram;
+        if (fields >> nvram && nvram != "-")
+        {
+            job.nvram = Resolve(nvram, baseDirectory);
+        }
+
+        std::string budget;
+        if (fields >> budget)
+        {
+            try
+            {
+                // stoull would take "-1" for the largest budget there is
+                if (budget.front() == '-')
+                {
+                    throw std::invalid_argument(budget);
+                }
+                size_t parsed = 0;
+                job.budget = std::stoull(budget, &parsed);
+                if (parsed != budget.size())
+                {
+                    throw std::invalid_argument(budget);
+                }
+            }
+            catch (const std::logic_error&)
+            {
+                throw std::runtime_error("Manifest line " + std::to_string(lineNumber) +
+                                         ": bad budget " + budget);
+            }
+        }
+        jobs.push_back(std::move(job));
+    }
+    return jobs;
+}
+
+std::vector<BatchJob> BatchRunner::LoadManifest(const std::string& path)
+{
+    std::ifstream manifest(path);
+    if (!manifest.is_open())
+    {
+        throw std::runtime_error("Could not open the manifest " + path);
+    }
+    return ParseManifest(manifest, std::filesystem::path(path).parent_path().string());
+}
+
+BatchJobResult BatchRunner::RunJob(const BatchJob& job, ExecutionEngine engine)
+{
+    BatchJobResult result;
+    const auto start = std::chrono::steady_clock::now();
+    try
+    {
+        auto binProgram = ReadFile(job.program);
+        if (binProgram.empty())
+        {
+            throw std::runtime_error("Empty program " + job.program);
+        }
+        Memory16 programMemory(MainMemorySize);
+        programMemory.WritePayload(0, binProgram);
+
+        std::shared_ptr<NVMemory16> nvram;
+        if (!job.nvram.empty())
+        {
+            nvram = std::make_shared<NVMemory16>(MainMemorySize,
+                                                 job.nvram,
+                                                 NVMemory16::IsMappingAvailable()
+                                                     ? NVMemoryMode::Mapped
+                                                     : NVMemoryMode::Stream);
+        }
+
+        Processor cpu(programMemory, nvram);
+        cpu.SetExecutionEngine(engine);
+        result.reason = cpu.Run(job.budget);
+        result.fault = cpu.GetFaultMessage();
+        result.instructions = cpu.GetInstructionCount();
+        for (size_t i = 0; i < result.registers.size(); ++i)
+        {
+            result.registers[i] = cpu.ReadRegister(static_cast<RegisterId>(i));
+        }
+    }
+    catch (const std::exception& e)
+    {
+        result.reason = StopReason::Fault;
+        result.fault = e.what();
+    }
+    result.seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+BatchReport BatchRunner::Run(const std::vector<BatchJob>& jobs) const
+{
+    // Compared as canonical paths, "./a.bin" and "a.bin" are the same file
+    std::set<std::filesystem::path> nvramFiles;
+    for (const auto& job : jobs)
+    {
+        if (!job.nvram.empty() &&
+            !nvramFiles.insert(std::filesystem::weakly_canonical(job.nvram)).second)
+        {
+            throw std::runtime_error("More than one job uses the NVRAM file " + job.nvram);
+        }
+    }
+
+    BatchReport report;
+    report.jobs = jobs;
+    report.results.resize(jobs.size());
+
+    const auto start = std::chrono::steady_clock::now();
+    WorkStealingPool pool(_options.threads, _options.cpus);
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        // Every task writes its own slot, nothing is shared
+        pool.Submit([&report, &jobs, i, engine = _options.engine] {
+            report.results[i] = RunJob(jobs[i], engine);
+        });
+    }
+    pool.Wait();
+
+    report.threads = pool.Size();
+    report.stolenJobs = pool.StolenCount();
+    report.wallSeconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return report;
+}
+
+std::string BatchReport::ToJson() const
+{
+    uint64_t instructions = 0;
+    std::map<StopReason, size_t> reasons;
+    for (const auto& result : results)
+    {
+        instructions += result.instructions;
+        ++reasons[result.reason];
+    }
+
+    std::ostringstream out;
+    out << "{\n  \"summary\": {\n";
+    out << "    \"jobs\": " << results.size() << ",\n";
+    out << "    \"threads\": " << threads << ",\n";
+    out << "    \"wall_seconds\": " << wallSeconds << ",\n";
+    out << "    \"instructions\": " << instructions << ",\n";
+    out << "    \"mips\": " << (wallSeconds > 0 ? instructions / wallSeconds / 1e6 : 0) << ",\n";
+    out << "    \"stolen_jobs\": " << stolenJobs << ",\n";
+    out << "    \"stop_reasons\": {";
+    for (auto it = reasons.begin(); it != reasons.end(); ++it)
+    {
+        out << (it == reasons.begin() ? "" : ", ") << JsonString(StopReasonName(it->first)) << ": "
+            << it->second;
+    }
+    out << "}\n  },\n  \"jobs\": [";
+
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const auto& job = jobs[i];
+        const auto& result = results[i];
+        out << (i == 0 ? "\n" : ",\n") << "    {";
+        out << "\"program\": " << JsonString(job.program);
+        out << ", \"nvram\": " << (job.nvram.empty() ? "null" : JsonString(job.nvram));
+        out << ", \"reason\": " << JsonString(StopReasonName(result.reason));
+        if (result.reason == StopReason::Fault)
+        {
+            out << ", \"fault\": " << JsonString(result.fault);
+        }
+        out << ", \"instructions\": " << result.instructions;
+        out << ", \"seconds\": " << result.seconds;
+        out << ", \"registers\": {";
+        for (size_t r = 0; r < result.registers.size(); ++r)
+        {
+            out << (r == 0 ? "" : ", ") << JsonString(registerNameTable[r]) << ": "
+                << result.registers[r];
+        }
+        out << "}}";
+    }
+    out << (results.empty() ? "]\n}\n" : "\n  ]\n}\n");
+    return out.str();
+}
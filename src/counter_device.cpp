@@ -0,0 +1,28 @@
+#include "counter_device.h"
+
+uint16_t CounterDevice::Read16(uint16_t offset)
+{
+    uint64_t* sample = nullptr;
+    if (offset >= CycleRegister && offset < CycleRegister + 8)
+    {
+        sample = &_cycles;
+        offset -= CycleRegister;
+    }
+    else if (offset >= InstretRegister && offset < InstretRegister + 8)
+    {
+        sample = &_instret;
+        offset -= InstretRegister;
+    }
+    else
+    {
+        return 0;
+    }
+
+    if (offset == 0)
+    {
+        // Same as PerfCounters
+        const uint64_t cycles = _cpu.GetInstructionCount();
+        *sample = (sample == &_cycles) ? cycles : cycles - _cpu.GetIdleInstructionCount();
+    }
+    return static_cast<uint16_t>(*sample >> (8 * (offset & ~1)));
+}
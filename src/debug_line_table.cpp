@@ -0,0 +1,95 @@
+#include "debug_line_table.h"
+
+namespace
+{
+constexpr std::string_view Header = "luinux-lines 1";
+}  // namespace
+
+void DebugLineTable::AddLine(uint16_t address, unsigned line)
+{
+    _lines[address] = line;
+}
+
+void DebugLineTable::AddTag(const std::string& name, uint16_t address)
+{
+    _tags.insert({address, name});
+}
+
+unsigned DebugLineTable::LineAt(uint16_t address) const
+{
+    auto it = _lines.upper_bound(address);
+    if (it == _lines.begin())
+    {
+        return 0;
+    }
+    --it;
+    // Instructions are a word, or two with a literal
+    return (address - it->first < 4) ? it->second : 0;
+}
+
+std::string DebugLineTable::TagAt(uint16_t address) const
+{
+    auto it = _tags.upper_bound(address);
+    if (it == _tags.begin())
+    {
+        return "";
+    }
+    return std::prev(it)->second;
+}
+
+void DebugLineTable::Write(std::ostream& out) const
+{
+    out << Header << '\n';
+    for (const auto& [address, line] : _lines)
+    {
+        out << "L " << address << ' ' << line << '\n';
+    }
+    for (const auto& [address, name] : _tags)
+    {
+        out << "T " << address << ' ' << name << '\n';
+    }
+}
+
+DebugLineTable DebugLineTable::Read(std::istream& in)
+{
+    std::string record;
+    if (!std::getline(in, record) || record != Header)
+    {
+        throw std::runtime_error("Not a line table, or one of an unknown version");
+    }
+    DebugLineTable table;
+    while (std::getline(in, record))
+    {
+        std::istringstream fields(record);
+        char kind = 0;
+        unsigned address = 0;
+        fields >> kind >> address;
+        if (!fields || address > 0xffff)
+        {
+            throw std::runtime_error("Malformed line table record: " + record);
+        }
+        if (kind == 'L')
+        {
+            unsigned line = 0;
+            if (!(fields >> line))
+            {
+                throw std::runtime_error("Malformed line table record: " + record);
+            }
+            table.AddLine(static_cast<uint16_t>(address), line);
+        }
+        else if (kind == 'T')
+        {
+            std::string name;
+            if (!(fields >> name))
+            {
+                throw std::runtime_error("Malformed line table record: " + record);
+            }
+            table.AddTag(name, static_cast<uint16_t>(address));
+        }
+        else
+        {
+            throw std::runtime_error("Malformed line table record: " + record);
+        }
+    }
+    return table;
+}
@@ -0,0 +1,66 @@
+#include "device_bus.h"
+
+void DeviceBus::Map(uint16_t base, size_t size, std::shared_ptr<Device> device)
+{
+    if (device == nullptr || size == 0 || base % PageSize != 0 || size % PageSize != 0 ||
+        size_t{base} + size > Pages * PageSize)
+    {
+        throw std::invalid_argument("Devices are mapped to whole pages inside the address space");
+    }
+    const size_t first = base / PageSize;
+    const size_t last = first + size / PageSize;
+    for (size_t page = first; page < last; ++page)
+    {
+        if (_pages[page].device != nullptr)
+        {
+            throw std::invalid_argument("Device mapping overlaps another device");
+        }
+    }
+
+    for (size_t page = first; page < last; ++page)
+    {
+        _pages[page] = {device.get(), base};
+    }
+    _devices.push_back(std::move(device));
+}
+
+void DeviceBus::Unmap(const Device* device)
+{
+    for (Region& region : _pages)
+    {
+        if (region.device == device)
+        {
+            region = {};
+        }
+    }
+    _devices.erase(std::remove_if(_devices.begin(),
+                                  _devices.end(),
+                                  [device](const auto& mapped) { return mapped.get() == device; }),
+                   _devices.end());
+}
+
+uint16_t ConsoleDevice::Read16(uint16_t offset)
+{
+    const bool inputWaiting = _inputPosition < _input.size();
+    switch (offset)
+    {
+        case DataRegister:
+            if (!inputWaiting)
+            {
+                return 0xffff;
+            }
+            return static_cast<uint8_t>(_input[_inputPosition++]);
+        case StatusRegister:
+            return inputWaiting ? 1 : 0;
+        default:
+            return 0;
+    }
+}
+
+void ConsoleDevice::Write16(uint16_t offset, uint16_t value)
+{
+    if (offset == DataRegister)
+    {
+        _out.put(static_cast<char>(value & 0xff));
+    }
+}
@@ -0,0 +1,62 @@
+#include "disassembler.h"
+
+std::string Disassembler::_LiteralToString(uint16_t literal)
+{
+    std::ostringstream out;
+    out << "h'" << std::hex << std::setfill('0') << std::setw(4) << literal;
+    return out.str();
+}
+
+std::string Disassembler::InstructionToString(uint16_t instruction,
+                                              std::optional<uint16_t> literal)
+{
+    const DecodedInstruction& decoded = decodeTable[instruction];
+    if (!decoded.IsValid())
+    {
+        return "UNKNOWN_INSTR";
+    }
+
+    std::string result = opCodeMnemonicTable.at(decoded.opCodeId);
+    for (int i = 0; i < decoded.argCount; ++i)
+    {
+        result += (i == 0) ? " " : ", ";
+        result += registerNameTable.at(static_cast<uint8_t>(decoded.args[i]));
+    }
+
+    if (decoded.hasLiteral)
+    {
+        result += (decoded.argCount == 0) ? " " : ", ";
+        result += literal ? _LiteralToString(*literal) : "VALUE";
+    }
+    return result;
+}
+
+std::string Disassembler::Disassemble(const std::vector<uint8_t>& program) const
+{
+    std::ostringstream out;
+    out << std::hex << std::setfill('0');
+
+    for (size_t address = 0; address + 1 < program.size(); address += 2)
+    {
+        const uint16_t word = (program[address] << 8) | program[address + 1];
+        const DecodedInstruction& decoded = decodeTable[word];
+        const size_t instructionAddress = address;
+
+        if (!decoded.IsValid())
+        {
+            out << "; UNKNOWN_INSTR " << _LiteralToString(word) << " ; 0x" << std::setw(4)
+                << instructionAddress << "\n";
+            continue;
+        }
+
+        std::optional<uint16_t> literal;
+        if (decoded.hasLiteral && address + 3 < program.size())
+        {
+            address += 2;
+            literal = (program[address] << 8) | program[address + 1];
+        }
+        out << InstructionToString(word, literal) << " ; 0x" << std::setw(4) << instructionAddress
+            << "\n";
+    }
+    return out.str();
+}
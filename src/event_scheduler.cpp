@@ -0,0 +1,84 @@
+#include "event_scheduler.h"
+
+EventScheduler::OwnerId EventScheduler::AddOwner(Rearm rearm)
+{
+    const OwnerId owner = _nextOwner++;
+    _owners.emplace(owner, std::move(rearm));
+    return owner;
+}
+
+void EventScheduler::RemoveOwner(OwnerId owner)
+{
+    _owners.erase(owner);
+}
+
+EventScheduler::EventId EventScheduler::Schedule(uint64_t cycle,
+                                                 Callback callback,
+                                                 std::optional<OwnerId> owner)
+{
+    const EventId id = _nextId++;
+    _heap.push_back({cycle, id, std::move(callback), owner});
+    std::push_heap(_heap.begin(), _heap.end(), _Later);
+    return id;
+}
+
+void EventScheduler::Cancel(EventId id)
+{
+    // Only a handful of events are ever pending, a linear search beats keeping an index
+    auto event =
+        std::find_if(_heap.begin(), _heap.end(), [id](const Event& e) { return e.id == id; });
+    if (event != _heap.end())
+    {
+        _heap.erase(event);
+        std::make_heap(_heap.begin(), _heap.end(), _Later);
+    }
+}
+
+void EventScheduler::RunDue(uint64_t cycle)
+{
+    while (!_heap.empty() && _heap.front().cycle <= cycle)
+    {
+        std::pop_heap(_heap.begin(), _heap.end(), _Later);
+        Event event = std::move(_heap.back());
+        _heap.pop_back();
+        event.callback(event.cycle);
+    }
+}
+
+EventScheduler::OwnedEvents EventScheduler::GetOwnedEvents(uint64_t now) const
+{
+    OwnedEvents events;
+    for (const Event& event : _heap)
+    {
+        if (event.owner)
+        {
+            // Overdue ones are due right away
+            events.emplace_back(*event.owner, event.cycle - std::min(event.cycle, now));
+        }
+    }
+    std::sort(events.begin(), events.end());
+    return events;
+}
+
+void EventScheduler::Rebase(uint64_t from, uint64_t to, const OwnedEvents& events)
+{
+    for (Event& event : _heap)
+    {
+        event.cycle = to + (event.cycle - std::min(event.cycle, from));
+    }
+    std::make_heap(_heap.begin(), _heap.end(), _Later);
+    // A copy, rearming may add or remove owners
+    const auto owners = _owners;
+    for (const auto& [owner, rearm] : owners)
+    {
+        std::optional<uint64_t> cycle;
+        for (const auto& [eventOwner, distance] : events)
+        {
+            if (eventOwner == owner)
+            {
+                cycle = to + distance;
+            }
+        }
+        rearm(cycle);
+    }
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include "common.h"
+#include "debug_line_table.h"
 #include "opcode.h"
 #include "register.h"
 
@@ -22,6 +23,8 @@ class Assembler
     std::vector<uint8_t> AssembleString(std::string program);
     void WriteBinaryFile(std::vector<uint8_t>& program, bool stdOutPayload = false);
     std::string GetAssembledPayloadHex() const;
+    // Lines and tags of the program last assembled
+    DebugLineTable GetLineTable() const;
 
    protected:
     struct AssembledIndex
@@ -0,0 +1,65 @@
+#pragma once
+#include "common.h"
+#include "processor.h"
+
+// One guest program to run, as listed in a batch manifest
+struct BatchJob
+{
+    std::string program;
+    // Empty when the job runs without NVRAM
+    std::string nvram;
+    uint64_t budget = std::numeric_limits<uint64_t>::max();
+};
+
+struct BatchJobResult
+{
+    StopReason reason = StopReason::Fault;
+    // Fault text, or why the job couldn't be set up
+    std::string fault;
+    uint64_t instructions = 0;
+    double seconds = 0;
+    std::array<uint16_t, static_cast<size_t>(RegisterId::END_OF_REGLIST)> registers{};
+};
+
+struct BatchOptions
+{
+    // 0 for one worker per hardware thread
+    size_t threads = 0;
+    // Pins worker i to cpus[i % cpus.size()] when not empty
+    std::vector<int> cpus;
+    ExecutionEngine engine = ExecutionEngine::Interpreter;
+};
+
+struct BatchReport
+{
+    std::vector<BatchJob> jobs;
+    // Same order as jobs
+    std::vector<BatchJobResult> results;
+    size_t threads = 0;
+    double wallSeconds = 0;
+    uint64_t stolenJobs = 0;
+
+    std::string ToJson() const;
+};
+
+// Runs many independent guests at once, each on its own Processor, over a WorkStealingPool.
+class BatchRunner
+{
+   public:
+    BatchRunner(BatchOptions options) : _options(std::move(options)) {}
+
+    // A manifest has one job per line: "<program> [<nvram>|- [<budget>]]". Relative paths are
+    // relative to baseDirectory, and # starts a comment.
+    static std::vector<BatchJob> ParseManifest(std::istream& manifest,
+                                               const std::string& baseDirectory);
+    static std::vector<BatchJob> LoadManifest(const std::string& path);
+
+    // Throws if two jobs share an NVRAM file, they would overwrite each other's
+    BatchReport Run(const std::vector<BatchJob>& jobs) const;
+
+    // Runs a single job on the calling thread. Never throws, setup errors come back as faults.
+    static BatchJobResult RunJob(const BatchJob& job, ExecutionEngine engine);
+
+   protected:
+    BatchOptions _options;
+};
@@ -7,17 +7,23 @@
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <map>
 #include <memory>
+#include <optional>
 #include <regex>
+#include <set>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 #include <string_view>
 #include <tuple>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
-inline void LuinuxAssert(bool assrt, std::string str)
+// Takes a C string so that passing checks never build a std::string on the hot path
+inline void LuinuxAssert(bool assrt, const char* str)
 {
     if (assrt)
         return;
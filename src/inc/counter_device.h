@@ -0,0 +1,26 @@
+#pragma once
+#include "device_bus.h"
+#include "processor.h"
+
+// The processor's cycle and instret counters, as the guest sees them. Each is 64 bits over four
+// words, least significant first. Reading the first word samples the whole counter, so the other
+// three come from the same moment however long the guest takes to read them. Writes are ignored.
+class CounterDevice : public Device
+{
+   public:
+    // Below TimerDevice, and like it out of the stack's way
+    static constexpr uint16_t DefaultBase = 0xfa00;
+
+    static constexpr uint16_t CycleRegister = 0;
+    static constexpr uint16_t InstretRegister = 8;
+
+    CounterDevice(const Processor& cpu) : _cpu(cpu) {}
+
+    uint16_t Read16(uint16_t offset) override;
+    void Write16(uint16_t, uint16_t) override {}
+
+   protected:
+    const Processor& _cpu;
+    uint64_t _cycles = 0;
+    uint64_t _instret = 0;
+};
@@ -0,0 +1,36 @@
+#pragma once
+#include "common.h"
+
+// Maps guest addresses back to the assembly source they came from: the line each instruction was
+// on and the :Tags. luinuxasm writes one next to every binary, see PathFor().
+class DebugLineTable
+{
+   public:
+    // The binary's name with .lines appended
+    static std::string PathFor(const std::string& binaryFilename)
+    {
+        return binaryFilename + ".lines";
+    }
+
+    void AddLine(uint16_t address, unsigned line);
+    // The first tag added at an address is the one it's known by
+    void AddTag(const std::string& name, uint16_t address);
+
+    // Line of the instruction covering address, literal words included. 0 when unknown.
+    unsigned LineAt(uint16_t address) const;
+    // The closest tag at or before address, empty when there's none
+    std::string TagAt(uint16_t address) const;
+    bool Empty() const
+    {
+        return _lines.empty();
+    }
+
+    // One "L <address> <line>" or "T <address> <tag>" record per line, after a version header.
+    // Read() throws on anything else.
+    void Write(std::ostream& out) const;
+    static DebugLineTable Read(std::istream& in);
+
+   protected:
+    std::map<uint16_t, unsigned> _lines;
+    std::map<uint16_t, std::string> _tags;
+};
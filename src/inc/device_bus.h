@@ -0,0 +1,94 @@
+#pragma once
+#include "common.h"
+#include "memory.h"
+
+// A peripheral in the guest's address space. The guest only moves words to and from memory, so
+// that's all a device sees, addressed relative to where it is mapped.
+class Device
+{
+   public:
+    virtual ~Device() = default;
+    virtual uint16_t Read16(uint16_t offset) = 0;
+    virtual void Write16(uint16_t offset, uint16_t value) = 0;
+};
+
+// Routes the processor's data accesses either to RAM or to the device mapped there. Mappings are
+// page granular and looked up in a table of every page, so a RAM access costs one table load and
+// never a virtual call. A word straddling two pages goes wherever its first byte is.
+class DeviceBus
+{
+   public:
+    static constexpr size_t PageSize = Memory<uint16_t>::PageSize;
+    static constexpr size_t Pages = Memory<uint16_t>::AddressSpaceSize / PageSize;
+
+    // Maps size bytes from base to device. Both have to be multiples of the page size, and the
+    // range can't overlap another device. Copies of the bus share the devices.
+    void Map(uint16_t base, size_t size, std::shared_ptr<Device> device);
+    void Unmap(const Device* device);
+
+    // Device mapped at address, if any
+    Device* DeviceAt(uint16_t address) const
+    {
+        return _pages[address / PageSize].device;
+    }
+
+    // False when the word isn't inside RAM, devices take any access
+    bool TryRead16(const Memory<uint16_t>& ram, uint16_t address, uint16_t& value) const
+    {
+        const Region& region = _pages[address / PageSize];
+        if (region.device == nullptr) [[likely]]
+        {
+            return ram.TryRead16(address, value);
+        }
+        value = region.device->Read16(static_cast<uint16_t>(address - region.base));
+        return true;
+    }
+
+    bool TryWrite16(Memory<uint16_t>& ram, uint16_t address, uint16_t value) const
+    {
+        const Region& region = _pages[address / PageSize];
+        if (region.device == nullptr) [[likely]]
+        {
+            return ram.TryWrite16(address, value);
+        }
+        region.device->Write16(static_cast<uint16_t>(address - region.base), value);
+        return true;
+    }
+
+   protected:
+    struct Region
+    {
+        Device* device = nullptr;
+        uint16_t base = 0;
+    };
+
+    std::array<Region, Pages> _pages{};
+    std::vector<std::shared_ptr<Device>> _devices;
+};
+
+// Text console. Writing the data register prints its low byte, reading it takes the next byte of
+// input, or 0xffff when there is none. The status register reads 1 while input is waiting.
+class ConsoleDevice : public Device
+{
+   public:
+    // The stack starts at the last byte of page 0xfd and grows up, devices go below it
+    static constexpr uint16_t DefaultBase = 0xfc00;
+    static constexpr uint16_t DataRegister = 0;
+    static constexpr uint16_t StatusRegister = 2;
+
+    ConsoleDevice(std::ostream& out) : _out(out) {}
+
+    // Queues bytes for the guest to read
+    void PushInput(std::string_view input)
+    {
+        _input.append(input);
+    }
+
+    uint16_t Read16(uint16_t offset) override;
+    void Write16(uint16_t offset, uint16_t value) override;
+
+   protected:
+    std::ostream& _out;
+    std::string _input;
+    size_t _inputPosition = 0;
+};
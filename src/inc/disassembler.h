@@ -0,0 +1,21 @@
+#pragma once
+#include "common.h"
+#include "opcode.h"
+
+class Disassembler
+{
+   public:
+    Disassembler() {}
+
+    // Turns one instruction word into the assembly the assembler accepts. Instructions that carry a
+    // literal (SET, JMP) print it when one is given, or a VALUE placeholder otherwise.
+    static std::string InstructionToString(uint16_t instruction,
+                                           std::optional<uint16_t> literal = std::nullopt);
+
+    // Produces a listing of a whole binary, one instruction per line with its address as a
+    // comment. Words that don't decode are listed as comments so the output still assembles.
+    std::string Disassemble(const std::vector<uint8_t>& program) const;
+
+   protected:
+    static std::string _LiteralToString(uint16_t literal);
+};
@@ -0,0 +1,74 @@
+#pragma once
+#include <functional>
+
+#include "common.h"
+
+// Discrete events on the processor's clock, which counts instructions. Kept in a min-heap, so the
+// run loop only has to compare the clock against NextEventCycle() between basic blocks.
+//
+// Restoring a snapshot moves the clock, see Rebase(). Something keeping one event pending at a
+// time, like a timer, can be an owner so its event goes back to where the snapshot had it.
+class EventScheduler
+{
+   public:
+    using EventId = uint64_t;
+    using OwnerId = uint32_t;
+    // Gets the cycle the event was due at
+    using Callback = std::function<void(uint64_t cycle)>;
+    // Gets the cycle the owner's event is due at again, or nothing when it had none pending
+    using Rearm = std::function<void(std::optional<uint64_t> cycle)>;
+    // Cycles from a snapshot's clock until the event of each owner that had one pending
+    using OwnedEvents = std::vector<std::pair<OwnerId, uint64_t>>;
+    static constexpr uint64_t Never = std::numeric_limits<uint64_t>::max();
+
+    // Owners are numbered in the order they're added, so processors set up the same way agree on
+    // them. rearm cancels the owner's event and schedules it anew where Rebase() says.
+    OwnerId AddOwner(Rearm rearm);
+    void RemoveOwner(OwnerId owner);
+
+    EventId Schedule(uint64_t cycle,
+                     Callback callback,
+                     std::optional<OwnerId> owner = std::nullopt);
+    // Does nothing when the event already ran or was cancelled
+    void Cancel(EventId id);
+
+    // Cycle of the earliest pending event, Never when there is none
+    uint64_t NextEventCycle() const
+    {
+        return _heap.empty() ? Never : _heap.front().cycle;
+    }
+    size_t Pending() const
+    {
+        return _heap.size();
+    }
+
+    // Runs every event due by cycle, earliest first. Events due on the same cycle run in the
+    // order they were scheduled, including ones the callbacks schedule.
+    void RunDue(uint64_t cycle);
+
+    // Pending events of owners, as far from now as they are due
+    OwnedEvents GetOwnedEvents(uint64_t now) const;
+    // Moves the clock from one cycle to another. Owners are rearmed that far from the new clock
+    // when they're in events, and without an event when they aren't. Everything else pending
+    // keeps its distance from the clock.
+    void Rebase(uint64_t from, uint64_t to, const OwnedEvents& events);
+
+   protected:
+    struct Event
+    {
+        uint64_t cycle;
+        EventId id;
+        Callback callback;
+        std::optional<OwnerId> owner;
+    };
+    // Orders the heap so the earliest, then first scheduled, event is at the front
+    static bool _Later(const Event& a, const Event& b)
+    {
+        return a.cycle != b.cycle ? a.cycle > b.cycle : a.id > b.id;
+    }
+
+    std::vector<Event> _heap;
+    EventId _nextId = 0;
+    std::map<OwnerId, Rearm> _owners;
+    OwnerId _nextOwner = 0;
+};
@@ -0,0 +1,39 @@
+#pragma once
+#include "common.h"
+#include "opcode.h"
+#include "translation_cache.h"
+
+// Counts the instruction pairs and triples that run back to back inside a basic block. Those are
+// the sequences superinstruction fusion can cover, so the report is what to look at when tuning
+// the patterns in translation_cache.cpp.
+class InstructionProfile
+{
+   public:
+    struct Sequence
+    {
+        std::vector<OpCodeId> opCodes;
+        uint64_t count;
+    };
+
+    InstructionProfile();
+
+    // Counts the sequences in the first count instructions of a block, the ones that just ran
+    void Record(const std::vector<TranslatedInstruction>& instructions, size_t count);
+
+    // The most frequent sequences of length 2 or 3, most frequent first
+    std::vector<Sequence> Top(size_t length, size_t limit) const;
+
+    // Top pairs and triples as text, one "count MNEMONIC MNEMONIC..." per line
+    std::string Report(size_t limit = 10) const;
+
+   protected:
+    static constexpr size_t OpCodeCount = static_cast<size_t>(OpCodeId::INVALID_INSTR);
+
+    static size_t _Index(OpCodeId opCodeId)
+    {
+        return static_cast<size_t>(opCodeId);
+    }
+
+    std::vector<uint64_t> _pairs;
+    std::vector<uint64_t> _triples;
+};
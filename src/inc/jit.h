@@ -0,0 +1,57 @@
+#pragma once
+#include "common.h"
+#include "register.h"
+#include "translation_cache.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#define LUINUX_HAS_JIT 1
+#endif
+
+enum class ExecutionEngine
+{
+    Interpreter = 0,
+    Jit
+};
+
+struct JitStats
+{
+    uint64_t compiledBlocks = 0;
+    uint64_t executedBlocks = 0;
+};
+
+// Translates hot basic blocks into x86-64 code. Only the register to register instructions are
+// compiled (ALU, MOV, SET*, jumps). Compilation stops at the first instruction that touches
+// memory, the stack, SWM, TRAP, STOP, the dividers, or RIP, and the interpreter runs the rest of
+// the block from there. The generated code works straight on the processor's register storage.
+class JitCompiler
+{
+   public:
+    // Blocks run this many times through the interpreter before they are compiled
+    static constexpr uint32_t HotThreshold = 16;
+    static constexpr size_t ArenaSize = 1 << 20;
+
+    JitCompiler();
+    ~JitCompiler();
+    JitCompiler(const JitCompiler&) = delete;
+    JitCompiler& operator=(const JitCompiler&) = delete;
+
+    static bool IsAvailable();
+
+    // Fills in block.jitCode and block.jitInstructionCount. Returns false when the arena is full,
+    // in which case every block that has code must be dropped before calling Reset().
+    bool Compile(BasicBlock& block);
+    void Reset();
+
+    JitStats& GetStats()
+    {
+        return _stats;
+    }
+
+   protected:
+    // Sets the protection of the arena pages holding [offset, offset + size)
+    void _Protect(size_t offset, size_t size, int protection);
+
+    uint8_t* _arena = nullptr;
+    size_t _arenaUsed = 0;
+    JitStats _stats;
+};
@@ -0,0 +1,89 @@
+#pragma once
+#include "common.h"
+#include "processor.h"
+
+struct LockstepStats
+{
+    // Basic blocks run as vector code, and the lane-instructions they amounted to
+    uint64_t vectorBlocks = 0;
+    uint64_t laneInstructions = 0;
+    // Lanes left idle by the mask, summed over vector blocks
+    uint64_t maskedLaneBlocks = 0;
+    // Lanes handed over to a scalar Processor
+    size_t scalarLanes = 0;
+};
+
+// Runs many instances of the same program side by side, for parameter sweeps where only the
+// initial registers differ. Registers are kept structure-of-arrays, one row per register, and
+// the ALU instructions run as AVX2/SSE2 kernels over all lanes at once.
+//
+// Every step runs the basic block at the lowest RIP of the running lanes, with the lanes sitting
+// elsewhere masked off. Lanes that have been masked off for too long, and lanes reaching an
+// instruction the kernels don't cover (memory, MUL/DIV, TRAP, ...), carry on in a scalar
+// Processor of their own.
+class LockstepEngine
+{
+   public:
+    // Lanes masked off for this many vector blocks in a row move to a scalar Processor
+    static constexpr uint32_t MaxMaskedBlocks = 64;
+
+    LockstepEngine(const std::vector<uint8_t>& program, size_t lanes);
+    LockstepEngine(const LockstepEngine&) = delete;
+    LockstepEngine& operator=(const LockstepEngine&) = delete;
+
+    size_t Lanes() const
+    {
+        return _lanes.size();
+    }
+
+    // Lanes start out the way a fresh Processor does
+    void WriteRegister(size_t lane, RegisterId reg, uint16_t value);
+    uint16_t ReadRegister(size_t lane, RegisterId reg) const;
+
+    // Runs every lane until it stops, or until it ran maxInstructions. Meant to be called once.
+    void Run(uint64_t maxInstructions = std::numeric_limits<uint64_t>::max());
+
+    StopReason GetStopReason(size_t lane) const;
+    uint64_t GetInstructionCount(size_t lane) const;
+    // Whether the lane finished in a scalar Processor
+    bool IsScalar(size_t lane) const;
+
+    const LockstepStats& GetStats() const
+    {
+        return _stats;
+    }
+
+    // Instruction set the kernels run with on this host: "avx2", "sse2" or "scalar"
+    static const char* KernelName();
+
+   protected:
+    struct Lane
+    {
+        bool running = true;
+        StopReason reason = StopReason::BudgetExhausted;
+        uint64_t instructions = 0;
+        uint32_t maskedBlocks = 0;
+        std::unique_ptr<Processor> scalar;
+    };
+
+    uint16_t* _Row(RegisterId reg)
+    {
+        return _registers.data() + static_cast<size_t>(reg) * _stride;
+    }
+    // Builds the mask for the block at the lowest running RIP, returns false once nothing runs
+    bool _SelectBlock(uint16_t& address, uint64_t maxInstructions);
+    void _ExecuteBlock(const BasicBlock& block, uint64_t maxInstructions);
+    void _CountBlock(size_t executed);
+    // Hands the lane over to a Processor and runs it there
+    void _Evict(size_t lane, uint64_t maxInstructions);
+
+    Memory16 _programMemory;
+    TranslationCache _translationCache;
+    // Lanes rounded up to a multiple of the widest vector, padding lanes never run
+    size_t _stride;
+    std::vector<uint16_t> _registers;
+    // 0xffff for the lanes taking part in the current block
+    std::vector<uint16_t> _mask;
+    std::vector<Lane> _lanes;
+    LockstepStats _stats;
+};
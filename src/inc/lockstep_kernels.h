@@ -0,0 +1,251 @@
+#pragma once
+// Vector kernels of the lockstep engine, written once against a small vector interface V and
+// instantiated per instruction set (see lockstep_engine.cpp and lockstep_avx2.cpp). Only
+// intrinsics and plain arithmetic belong in here: the AVX2 instantiation is built with -mavx2, and
+// any out of line helper it pulled in could end up shared with the baseline build.
+#include <cstddef>
+#include <cstdint>
+
+#include "opcode.h"
+
+// Everything a kernel works on. Rows are one register across all lanes, lanes is a multiple of
+// every vector width, and mask has 0xffff for the lanes taking part.
+struct LockstepKernelArgs
+{
+    OpCodeId opCodeId;
+    const uint16_t* a;
+    const uint16_t* b;
+    uint16_t* dest;
+    uint16_t* flags;
+    const uint16_t* mask;
+    uint16_t literal;
+    size_t lanes;
+};
+
+// The instructions the lockstep engine runs as vector code
+constexpr bool IsLockstepAluOp(OpCodeId opCodeId)
+{
+    switch (opCodeId)
+    {
+        case OpCodeId::ADD:
+        case OpCodeId::SUB:
+        case OpCodeId::AND:
+        case OpCodeId::OR:
+        case OpCodeId::XOR:
+        case OpCodeId::NOT:
+        case OpCodeId::SHFL:
+        case OpCodeId::SHFR:
+        case OpCodeId::INC:
+        case OpCodeId::DEC:
+        case OpCodeId::MOV:
+        case OpCodeId::SET:
+        case OpCodeId::SETZ:
+        case OpCodeId::SETO:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Register to register instructions: dest = op(a, b), where a and b are rows as named by the
+// instruction (b unused for one operand ops). ADD and SUB also merge their flags into the flags
+// row the way Processor::_EvaluateFlags() computes them.
+template <typename V>
+void LockstepAlu(const LockstepKernelArgs& args)
+{
+    using T = typename V::Type;
+    const T ones = V::Set1(0xffff);
+    // Zero, Carry, Negative, Overflow and Exception, the flags an ALU operation rewrites
+    const T keepFlags = V::Set1(static_cast<uint16_t>(~0x67));
+
+    for (size_t lane = 0; lane < args.lanes; lane += V::Width)
+    {
+        const T mask = V::Load(args.mask + lane);
+        const T a = V::Load(args.a + lane);
+        T result;
+        switch (args.opCodeId)
+        {
+            case OpCodeId::ADD:
+            case OpCodeId::SUB:
+            {
+                const T b = V::Load(args.b + lane);
+                T carry;
+                T overflow;
+                if (args.opCodeId == OpCodeId::ADD)
+                {
+                    result = V::Add(a, b);
+                    // The saturated sum only differs from the wrapped one when it carried out
+                    carry = V::Xor(V::CmpEq(V::AddsU(a, b), result), ones);
+                    overflow = V::Sra15(V::AndNot(V::Xor(a, b), V::Xor(a, result)));
+                }
+                else
+                {
+                    result = V::Sub(a, b);
+                    // b - a only saturates to 0 when a >= b
+                    carry = V::Xor(V::CmpEq(V::SubsU(b, a), V::Set1(0)), ones);
+                    overflow = V::Sra15(V::And(V::Xor(a, b), V::Xor(a, result)));
+                }
+                const T zero = V::CmpEq(result, V::Set1(0));
+                const T negative = V::Sra15(result);
+
+                T flags = V::And(V::Load(args.flags + lane), keepFlags);
+                flags = V::Or(flags, V::And(zero, V::Set1(0x01)));
+                flags = V::Or(flags, V::And(carry, V::Set1(0x02)));
+                flags = V::Or(flags, V::And(negative, V::Set1(0x04)));
+                flags = V::Or(flags, V::And(overflow, V::Set1(0x20)));
+                V::Store(args.flags + lane, V::Blend(V::Load(args.flags + lane), flags, mask));
+                break;
+            }
+            case OpCodeId::AND:
+                result = V::And(a, V::Load(args.b + lane));
+                break;
+            case OpCodeId::OR:
+                result = V::Or(a, V::Load(args.b + lane));
+                break;
+            case OpCodeId::XOR:
+                result = V::Xor(a, V::Load(args.b + lane));
+                break;
+            case OpCodeId::NOT:
+                result = V::Xor(a, ones);
+                break;
+            case OpCodeId::SHFL:
+                result = V::Shl1(a);
+                break;
+            case OpCodeId::SHFR:
+                result = V::Shr1(a);
+                break;
+            case OpCodeId::INC:
+                result = V::Add(a, V::Set1(1));
+                break;
+            case OpCodeId::DEC:
+                result = V::Sub(a, V::Set1(1));
+                break;
+            case OpCodeId::MOV:
+                result = a;
+                break;
+            case OpCodeId::SET:
+                result = V::Set1(args.literal);
+                break;
+            case OpCodeId::SETZ:
+                result = V::Set1(0);
+                break;
+            case OpCodeId::SETO:
+                result = ones;
+                break;
+            default:
+                return;
+        }
+        V::Store(args.dest + lane, V::Blend(V::Load(args.dest + lane), result, mask));
+    }
+}
+
+// Conditional jumps: for the masked lanes, dest (RIP) becomes b (the target) where the condition
+// on a holds. JE and JNE compare a against the row in flags, which holds RAC for them.
+template <typename V>
+void LockstepBranch(const LockstepKernelArgs& args)
+{
+    using T = typename V::Type;
+    const T ones = V::Set1(0xffff);
+
+    for (size_t lane = 0; lane < args.lanes; lane += V::Width)
+    {
+        const T a = V::Load(args.a + lane);
+        T taken;
+        switch (args.opCodeId)
+        {
+            case OpCodeId::JZ:
+                taken = V::CmpEq(a, V::Set1(0));
+                break;
+            case OpCodeId::JNZ:
+                taken = V::Xor(V::CmpEq(a, V::Set1(0)), ones);
+                break;
+            case OpCodeId::JE:
+                taken = V::CmpEq(a, V::Load(args.flags + lane));
+                break;
+            case OpCodeId::JNE:
+                taken = V::Xor(V::CmpEq(a, V::Load(args.flags + lane)), ones);
+                break;
+            default:
+                return;
+        }
+        taken = V::And(taken, V::Load(args.mask + lane));
+        V::Store(args.dest + lane,
+                 V::Blend(V::Load(args.dest + lane), V::Load(args.b + lane), taken));
+    }
+}
+
+// One lane at a time, for hosts without a vector unit we know about
+struct ScalarVector
+{
+    using Type = uint16_t;
+    static constexpr size_t Width = 1;
+
+    static Type Load(const uint16_t* p)
+    {
+        return *p;
+    }
+    static void Store(uint16_t* p, Type v)
+    {
+        *p = v;
+    }
+    static Type Set1(uint16_t v)
+    {
+        return v;
+    }
+    static Type Add(Type a, Type b)
+    {
+        return static_cast<Type>(a + b);
+    }
+    static Type Sub(Type a, Type b)
+    {
+        return static_cast<Type>(a - b);
+    }
+    static Type AddsU(Type a, Type b)
+    {
+        return (a + b > 0xffff) ? Type{0xffff} : static_cast<Type>(a + b);
+    }
+    static Type SubsU(Type a, Type b)
+    {
+        return (a > b) ? static_cast<Type>(a - b) : Type{0};
+    }
+    static Type And(Type a, Type b)
+    {
+        return a & b;
+    }
+    static Type AndNot(Type a, Type b)
+    {
+        return static_cast<Type>(~a & b);
+    }
+    static Type Or(Type a, Type b)
+    {
+        return a | b;
+    }
+    static Type Xor(Type a, Type b)
+    {
+        return a ^ b;
+    }
+    static Type CmpEq(Type a, Type b)
+    {
+        return (a == b) ? Type{0xffff} : Type{0};
+    }
+    static Type Sra15(Type a)
+    {
+        return (a & 0x8000) ? Type{0xffff} : Type{0};
+    }
+    static Type Shl1(Type a)
+    {
+        return static_cast<Type>(a << 1);
+    }
+    static Type Shr1(Type a)
+    {
+        return a >> 1;
+    }
+    static Type Blend(Type old, Type updated, Type mask)
+    {
+        return static_cast<Type>((updated & mask) | (old & ~mask));
+    }
+};
+
+// Entry points per instruction set, picked at runtime by the engine
+void LockstepAluAvx2(const LockstepKernelArgs& args);
+void LockstepBranchAvx2(const LockstepKernelArgs& args);
@@ -1,114 +1,540 @@
 #pragma once
+#include <bit>
+
 #include "common.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define LUINUX_HAS_MMAP 1
+#endif
+
+// Gets told about every write to a Memory it is attached to, after the write happened. Used by
+// anything caching what's in memory, like the processor's translation cache.
+class MemoryObserver
+{
+   public:
+    virtual ~MemoryObserver() = default;
+    virtual void OnMemoryWrite(size_t address, size_t size) = 0;
+};
+
+// Guest words are big-endian. Compilers turn the swap into a single rotate.
+constexpr uint16_t BigEndianToHost16(uint16_t value)
+{
+    if constexpr (std::endian::native == std::endian::little)
+    {
+        return static_cast<uint16_t>((value << 8) | (value >> 8));
+    }
+    else
+    {
+        return value;
+    }
+}
+
 // TODO: Consider implementing uninitialized memory checks
+// Guest memory is kept in fixed size pages, shared between copies of the same Memory. Copying
+// only copies the page table, and a page is duplicated the first time either side writes to it.
+// Pages never written to all share one zero page, so a fresh 64 KiB memory costs a page table.
+// A memory as big as its address space (64 KiB for uint16_t) has no address to check, so Read16
+// and Write16 skip the checks there and move whole words unless they straddle two pages.
 template <typename TAddressSpace>
 class Memory
 {
    public:
-    Memory(size_t size)
+    static constexpr size_t PageSize = 256;
+    using Page = std::array<uint8_t, PageSize>;
+    // Size of a memory every TAddressSpace value is a valid address of
+    static constexpr size_t AddressSpaceSize =
+        size_t{std::numeric_limits<TAddressSpace>::max()} + 1;
+
+    Memory(size_t size) : _size(size), _pages((size + PageSize - 1) / PageSize, _ZeroPage()) {}
+
+    // Observers belong to the object they were attached to, copies start without any
+    Memory(const Memory& other) : _size(other._size), _pages(other._pages) {}
+    Memory& operator=(const Memory& other)
+    {
+        _size = other._size;
+        _pages = other._pages;
+        _NotifyWrite(0, _size);
+        return *this;
+    }
+
+    void AddObserver(MemoryObserver* observer)
+    {
+        _observers.push_back(observer);
+    }
+
+    void RemoveObserver(MemoryObserver* observer)
     {
-        _memory.reserve(size);
-        _memory.resize(size, 0);
+        _observers.erase(std::remove(_observers.begin(), _observers.end(), observer),
+                         _observers.end());
     }
 
     uint8_t Read8(TAddressSpace address) const
     {
         _ValidateAddress(address);
-        return _memory.at(address);
+        return (*_pages[address / PageSize])[address % PageSize];
     }
 
     uint16_t Read16(TAddressSpace address) const
     {
-        _ValidateAddress(address);
-
-        return (static_cast<TAddressSpace>(_memory.at(address)) << 8) |
-               static_cast<TAddressSpace>(_memory.at(address + 1));
+        uint16_t value;
+        if (!TryRead16(address, value))
+        {
+            throw std::out_of_range("Used address is out of range");
+        }
+        return value;
     }
 
     void Write8(TAddressSpace address, uint8_t value)
     {
         _ValidateAddress(address);
-        _memory[address] = value;
+        _WritablePage(address / PageSize)[address % PageSize] = value;
+        _NotifyWrite(address, 1);
     }
 
     void Write16(TAddressSpace address, uint16_t value)
     {
-        Write8(address, static_cast<uint8_t>(value >> 8));
-        Write8(address + 1, static_cast<uint8_t>(value & 0x00ff));
+        if (!TryWrite16(address, value))
+        {
+            throw std::out_of_range("Used address is out of range");
+        }
+    }
+
+    // Same as Read16/Write16, but returning false instead of throwing when the word isn't inside
+    // the memory. For the processor, which turns that into a guest fault.
+    bool TryRead16(TAddressSpace address, uint16_t& value) const
+    {
+        const size_t offset = address % PageSize;
+        if (_CoversAddressSpace() && offset != PageSize - 1)
+        {
+            std::memcpy(&value, _pages[address / PageSize]->data() + offset, sizeof(value));
+            value = BigEndianToHost16(value);
+            return true;
+        }
+
+        const size_t nextAddress = size_t{address} + 1;
+        if (!(nextAddress < _size))
+        {
+            return false;
+        }
+        value = static_cast<uint16_t>(((*_pages[address / PageSize])[offset] << 8) |
+                                      (*_pages[nextAddress / PageSize])[nextAddress % PageSize]);
+        return true;
+    }
+
+    bool TryWrite16(TAddressSpace address, uint16_t value)
+    {
+        const size_t offset = address % PageSize;
+        if (_CoversAddressSpace() && offset != PageSize - 1)
+        {
+            const uint16_t bigEndian = BigEndianToHost16(value);
+            std::memcpy(
+                _WritablePage(address / PageSize).data() + offset, &bigEndian, sizeof(bigEndian));
+            _NotifyWrite(address, 2);
+            return true;
+        }
+
+        const TAddressSpace nextAddress = address + 1;
+        if (!(address < _size) || !(nextAddress < _size))
+        {
+            return false;
+        }
+        _WritablePage(address / PageSize)[offset] = static_cast<uint8_t>(value >> 8);
+        _WritablePage(nextAddress / PageSize)[nextAddress % PageSize] =
+            static_cast<uint8_t>(value & 0x00ff);
+
+        // The second byte wraps around at the top of the address space
+        if (nextAddress > address)
+        {
+            _NotifyWrite(address, 2);
+        }
+        else
+        {
+            _NotifyWrite(address, 1);
+            _NotifyWrite(nextAddress, 1);
+        }
+        return true;
     }
 
     void WritePayload(TAddressSpace address, const char* shellCode, size_t size)
     {
         _ValidateAddress(address);
-        std::memcpy(&_memory[address], shellCode, size);
+        if (size_t{address} + size > _size)
+        {
+            throw std::out_of_range("Payload does not fit in memory");
+        }
+        _CopyIn(address, reinterpret_cast<const uint8_t*>(shellCode), size);
+        _NotifyWrite(address, size);
     }
 
     void WritePayload(TAddressSpace address, std::vector<uint8_t> payload)
     {
         _ValidateAddress(address);
-        std::memcpy(&_memory[address], &payload.at(0), payload.size());
+        if (payload.empty() || size_t{address} + payload.size() > _size)
+        {
+            throw std::out_of_range("Payload does not fit in memory");
+        }
+        const size_t oldSize = _size;
+        _CopyIn(address, payload.data(), payload.size());
         // This will help us catch if the CPU tries to fetch non-payload
         // instructions
-        _memory.resize(payload.size());
+        _size = payload.size();
+        _pages.resize((_size + PageSize - 1) / PageSize);
+        // Everything past the payload is gone too
+        _NotifyWrite(address, oldSize - address);
     }
 
     size_t Size() const
     {
-        return _memory.size();
+        return _size;
+    }
+
+    // Copies size bytes starting at address out, for saving memory somewhere else
+    void ReadRange(size_t address, uint8_t* data, size_t size) const
+    {
+        if (address + size > _size)
+        {
+            throw std::out_of_range("Used address is out of range");
+        }
+        _CopyOut(address, data, size);
+    }
+
+    // Pages this memory had to duplicate because they were shared when written to
+    uint64_t CopiedPages() const
+    {
+        return _copiedPages;
     }
 
    protected:
-    std::vector<uint8_t> _memory;
+    size_t _size;
+    std::vector<std::shared_ptr<Page>> _pages;
+    std::vector<MemoryObserver*> _observers;
+    uint64_t _copiedPages = 0;
+
+    static const std::shared_ptr<Page>& _ZeroPage()
+    {
+        static const std::shared_ptr<Page> zeroPage = std::make_shared<Page>();
+        return zeroPage;
+    }
+
+    // No address can be out of range then, and only a word starting on the last byte of a page
+    // has to look at two pages. Address types wider than size_t always get checked.
+    bool _CoversAddressSpace() const
+    {
+        if constexpr (sizeof(TAddressSpace) < sizeof(size_t))
+        {
+            return _size == AddressSpaceSize;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    // Only the page table's reference left means nobody else can see the page change. use_count()
+    // is no synchronization, so whatever hands pages to another thread has to take its references
+    // back on this memory's thread, after a handshake with the other one.
+    Page& _WritablePage(size_t index)
+    {
+        auto& page = _pages[index];
+        if (page.use_count() != 1)
+        {
+            page = std::make_shared<Page>(*page);
+            ++_copiedPages;
+        }
+        return *page;
+    }
+
+    void _CopyIn(size_t address, const uint8_t* data, size_t size)
+    {
+        while (size > 0)
+        {
+            const size_t offset = address % PageSize;
+            const size_t chunk = std::min(size, PageSize - offset);
+            std::memcpy(_WritablePage(address / PageSize).data() + offset, data, chunk);
+            address += chunk;
+            data += chunk;
+            size -= chunk;
+        }
+    }
+
+    void _CopyOut(size_t address, uint8_t* data, size_t size) const
+    {
+        while (size > 0)
+        {
+            const size_t offset = address % PageSize;
+            const size_t chunk = std::min(size, PageSize - offset);
+            std::memcpy(data, _pages[address / PageSize]->data() + offset, chunk);
+            address += chunk;
+            data += chunk;
+            size -= chunk;
+        }
+    }
+
     void _ValidateAddress(TAddressSpace address) const
     {
-        if (!(address < _memory.size()))
+        if (!(address < _size))
         {
             throw std::out_of_range("Used address is out of range");
         }
     }
+
+    void _NotifyWrite(size_t address, size_t size)
+    {
+        for (auto* observer : _observers)
+        {
+            observer->OnMemoryWrite(address, size);
+        }
+    }
+};
+
+enum class NVMemoryMode
+{
+    Stream = 0,  // Read whole at startup, the whole file is rewritten on every flush
+    Mapped,      // The file is mapped in, flushing writes back the pages written since the last one
+    Journaled    // Read whole at startup and never written, an NVRamJournal attached to it persists
 };
 
 template <typename TAddressSpace>
-class NVMemory : public Memory<TAddressSpace>
+class NVMemory : public Memory<TAddressSpace>, public MemoryObserver
 {
    public:
-    NVMemory(size_t size, std::string filename) : Memory<TAddressSpace>(size), _filename(filename)
+    using Page = typename Memory<TAddressSpace>::Page;
+
+    NVMemory(size_t size, std::string filename, NVMemoryMode mode = NVMemoryMode::Stream)
+        : Memory<TAddressSpace>(size),
+          _filename(filename),
+          _mode(mode),
+          _dirty(this->_pages.size(), false)
     {
-        _FlushIn();
+        if (_mode == NVMemoryMode::Mapped)
+        {
+            _Map();
+        }
+        else
+        {
+            _FlushIn();
+        }
+        this->AddObserver(this);
     }
 
     ~NVMemory()
     {
         _FlushOut();
+        _Unmap();
     }
 
+    NVMemory(const NVMemory&) = delete;
+    NVMemory& operator=(const NVMemory&) = delete;
+
+    // Mapped memory already is the file, it's only read back in Stream mode. Journaled memory
+    // is flushed through its NVRamJournal instead.
     void Flush()
     {
         _FlushOut();
-        _FlushIn();
+        if (_mode == NVMemoryMode::Stream)
+        {
+            _FlushIn();
+        }
+    }
+
+    NVMemoryMode Mode() const
+    {
+        return _mode;
+    }
+
+    // Pages written since the last flush
+    size_t DirtyPages() const
+    {
+        return static_cast<size_t>(std::count(_dirty.begin(), _dirty.end(), true));
+    }
+
+    // The pages written since the last flush or the last call, by index, and forgets they were
+    // written. They stay shared with this memory, copy on write keeps them as they are now however
+    // this memory gets written to afterwards. Used by NVRamFlusher to persist them on its own
+    // thread.
+    std::vector<std::pair<size_t, std::shared_ptr<Page>>> TakeDirtyPages()
+    {
+        std::vector<std::pair<size_t, std::shared_ptr<Page>>> pages;
+        for (size_t page = 0; page < _dirty.size(); ++page)
+        {
+            if (_dirty[page])
+            {
+                pages.emplace_back(page, this->_pages[page]);
+                _dirty[page] = false;
+            }
+        }
+        return pages;
+    }
+
+    const std::string& Filename() const
+    {
+        return _filename;
+    }
+
+    // Whether this build can map files, Mapped mode throws otherwise
+    static constexpr bool IsMappingAvailable()
+    {
+#ifdef LUINUX_HAS_MMAP
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void OnMemoryWrite(size_t address, size_t size) override
+    {
+        using Base = Memory<TAddressSpace>;
+        for (size_t page = address / Base::PageSize;
+             page * Base::PageSize < address + size && page < _dirty.size();
+             ++page)
+        {
+            _dirty[page] = true;
+        }
     }
 
    protected:
     void _FlushOut()
     {
+        if (_mode == NVMemoryMode::Mapped)
+        {
+            _WriteBackDirty();
+            return;
+        }
+        if (_mode == NVMemoryMode::Journaled)
+        {
+            // Rewriting the image in place is exactly what the journal is there to avoid
+            return;
+        }
+        std::vector<uint8_t> image(this->_size);
+        this->_CopyOut(0, image.data(), image.size());
+        std::fill(_dirty.begin(), _dirty.end(), false);
         _outFile.open(_filename, std::ios::binary | std::ios::trunc | std::ios::out);
-        _outFile.write(reinterpret_cast<char*>(&(this->_memory[0])), this->_memory.size());
+        _outFile.write(reinterpret_cast<char*>(image.data()), image.size());
         _outFile.close();
     }
 
+    // Mapped NVRAM never reads the file in, the mapping is the file
     void _FlushIn()
     {
         _inFile.open(_filename, std::ios::binary | std::ios::in);
         LuinuxAssert(_inFile.is_open(), "Failed to open the file for NVRAM");
 
-        _inFile.read(reinterpret_cast<char*>(&(this->_memory[0])), this->_memory.size());
+        std::vector<uint8_t> image(this->_size);
+        _inFile.read(reinterpret_cast<char*>(image.data()), image.size());
+        // A short file only fills the start of memory
+        const auto read = static_cast<size_t>(_inFile.gcount());
         _inFile.close();
+        this->_CopyIn(0, image.data(), read);
+        this->_NotifyWrite(0, this->_size);
+        // Same as what's in the file
+        std::fill(_dirty.begin(), _dirty.end(), false);
+    }
+
+#ifdef LUINUX_HAS_MMAP
+    void _Map()
+    {
+        _fd = ::open(_filename.c_str(), O_RDWR);
+        LuinuxAssert(_fd >= 0, "Failed to open the file for NVRAM");
+
+        // A short file only fills the start of memory, same as reading it in
+        struct stat status;
+        const bool sized = ::fstat(_fd, &status) == 0 &&
+                           (static_cast<size_t>(status.st_size) >= this->_size ||
+                            ::ftruncate(_fd, static_cast<off_t>(this->_size)) == 0);
+        if (!sized)
+        {
+            ::close(_fd);
+            throw std::runtime_error("Failed to size the file for NVRAM");
+        }
+
+        void* mapping = ::mmap(nullptr, this->_size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+        if (mapping == MAP_FAILED)
+        {
+            ::close(_fd);
+            throw std::runtime_error("Failed to map the file for NVRAM");
+        }
+        _mapping = static_cast<uint8_t*>(mapping);
+        // Pages are only read in from the file once something touches them
+        for (size_t page = 0; page < this->_pages.size(); ++page)
+        {
+            this->_pages[page] = _MappedPage(page);
+        }
+    }
+
+    void _Unmap()
+    {
+        if (_mapping != nullptr)
+        {
+            ::munmap(_mapping, this->_size);
+            ::close(_fd);
+            _mapping = nullptr;
+        }
+    }
+
+    // Pages in the mapping own nothing. The base class's copy on write still applies to them, so
+    // a page may have moved off the mapping while a copy of this memory shared it.
+    std::shared_ptr<Page> _MappedPage(size_t page)
+    {
+        using Base = Memory<TAddressSpace>;
+        return std::shared_ptr<Page>(reinterpret_cast<Page*>(_mapping + page * Base::PageSize),
+                                     [](Page*) {});
+    }
+
+    void _WriteBackDirty()
+    {
+        using Base = Memory<TAddressSpace>;
+        const size_t systemPage = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        for (size_t first = 0; first < _dirty.size();)
+        {
+            if (!_dirty[first])
+            {
+                ++first;
+                continue;
+            }
+            size_t end = first;
+            for (; end < _dirty.size() && _dirty[end]; ++end)
+            {
+                uint8_t* mapped = _mapping + end * Base::PageSize;
+                if (this->_pages[end].get() != reinterpret_cast<Page*>(mapped))
+                {
+                    std::memcpy(mapped,
+                                this->_pages[end]->data(),
+                                std::min(Base::PageSize, this->_size - end * Base::PageSize));
+                }
+                _dirty[end] = false;
+            }
+
+            // msync wants the start aligned to a system page
+            const size_t start = first * Base::PageSize / systemPage * systemPage;
+            const size_t stop = std::min(end * Base::PageSize, this->_size);
+            ::msync(_mapping + start, stop - start, MS_ASYNC);
+            first = end;
+        }
+    }
+#else
+    void _Map()
+    {
+        throw std::runtime_error("Mapped NVRAM is not available on this host.");
+    }
+    void _Unmap() {}
+    std::shared_ptr<Page> _MappedPage(size_t)
+    {
+        return nullptr;
     }
+    void _WriteBackDirty() {}
+#endif
 
     std::fstream _inFile;
     std::fstream _outFile;
     std::string _filename;
+    NVMemoryMode _mode;
+    std::vector<bool> _dirty;
+    uint8_t* _mapping = nullptr;
+    int _fd = -1;
 };
 
 template <typename TAddressSpace>
@@ -122,8 +548,8 @@ class NonByteAddressableMemory : public Memory<TAddressSpace>
         _ValidateAddress(address);
         size_t realAddress = address * sizeof(TAddressSpace);
         // If this processor was little endian, we'd just put a ptr and return *p
-        return (static_cast<TAddressSpace>(this->_memory.at(realAddress) << 8) |
-                static_cast<TAddressSpace>(this->_memory.at(realAddress + 1)));
+        return (static_cast<TAddressSpace>(this->Read8(realAddress) << 8) |
+                static_cast<TAddressSpace>(this->Read8(realAddress + 1)));
     }
 
     void Write16(TAddressSpace address, uint16_t value)
@@ -135,7 +561,7 @@ class NonByteAddressableMemory : public Memory<TAddressSpace>
    private:
     void _ValidateAddress(TAddressSpace address) const
     {
-        if (!(address * sizeof(TAddressSpace) < this->_memory.size()))
+        if (!(address * sizeof(TAddressSpace) < this->_size))
         {
             throw std::out_of_range("Used address is out of range");
         }
@@ -0,0 +1,108 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include "common.h"
+#include "event_scheduler.h"
+#include "memory.h"
+
+class Processor;
+using NVMemory16 = NVMemory<uint16_t>;
+
+struct NVRamFlusherStats
+{
+    // Sets of dirty pages handed to the writer thread
+    uint64_t captures = 0;
+    uint64_t pagesWritten = 0;
+    uint64_t syncs = 0;
+};
+
+// Persists a Stream mode NVMemory from a thread of its own, so the guest never waits on file I/O.
+// Once per interval, the next write to the NVRAM captures the pages written since the last
+// capture. That only copies their page pointers, copy on write keeps them consistent while the
+// guest carries on, and the writer thread puts them in the file. A guest that stops writing is
+// caught up with by Poll(), which Attach() has the processor's event scheduler call. The writer
+// hands written pages back under the mutex and the guest's thread drops them on its next capture,
+// so the guest only writes a page in place again once the writer is done with it. Mapped NVRAM
+// doesn't need this, the kernel writes it back already.
+//
+// Everything but the writer thread runs on the thread running the guest. Must go away before
+// the NVMemory, and the processor it's attached to, do.
+class NVRamFlusher : public MemoryObserver
+{
+   public:
+    NVRamFlusher(NVMemory16& nvram,
+                 std::chrono::milliseconds interval = std::chrono::milliseconds(10));
+    // Waits for everything written so far to be in the file
+    ~NVRamFlusher();
+    NVRamFlusher(const NVRamFlusher&) = delete;
+    NVRamFlusher& operator=(const NVRamFlusher&) = delete;
+
+    static constexpr uint64_t DefaultPollPeriod = 10000;
+
+    // Captures if the interval is up. Writes only capture when it's up at the time they happen,
+    // so the last pages a guest writes before going quiet wait for this.
+    void Poll();
+    // Polls every period instructions on cpu's event scheduler from now on
+    void Attach(Processor& cpu, uint64_t period = DefaultPollPeriod);
+
+    // Blocks until everything written to the NVRAM so far is in the file. Rethrows the first
+    // error the writer thread ran into.
+    void Barrier();
+    // Barrier(), then waits for the file to be on disk
+    void Sync();
+
+    NVRamFlusherStats GetStats() const;
+
+    // Whether this host can write the file from another thread, the constructor throws otherwise
+    static bool IsAvailable();
+
+    void OnMemoryWrite(size_t address, size_t size) override;
+
+   protected:
+    using Pages = std::vector<std::pair<size_t, std::shared_ptr<NVMemory16::Page>>>;
+    struct Batch
+    {
+        Pages pages;
+        bool sync = false;
+        uint64_t sequence = 0;
+    };
+
+    // Queues the pages written since the last capture, returns the sequence to wait on
+    uint64_t _Capture(bool sync);
+    void _Wait(uint64_t sequence);
+    void _ArmPoll(uint64_t now);
+    void _WriterLoop();
+    void _Write(const Batch& batch);
+
+    NVMemory16& _nvram;
+    std::chrono::milliseconds _interval;
+    int _fd = -1;
+    Processor* _cpu = nullptr;
+    uint64_t _pollPeriod = 0;
+    std::optional<EventScheduler::EventId> _pollEvent;
+
+    // Guards everything up to _error
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _written;
+    std::deque<Batch> _batches;
+    // Pages the writer is done with, for the guest's thread to let go of
+    std::vector<Pages> _donePages;
+    uint64_t _queuedSequence = 0;
+    uint64_t _writtenSequence = 0;
+    bool _stop = false;
+    std::exception_ptr _error;
+
+    // Set by the writer thread once the interval is up, the next NVRAM write captures
+    std::atomic<bool> _captureDue{false};
+    std::atomic<uint64_t> _captures{0};
+    std::atomic<uint64_t> _pagesWritten{0};
+    std::atomic<uint64_t> _syncs{0};
+    std::thread _writer;
+};
@@ -0,0 +1,84 @@
+#pragma once
+#include <atomic>
+#include <thread>
+
+#include "common.h"
+#include "memory.h"
+
+using NVMemory16 = NVMemory<uint16_t>;
+
+struct NVRamJournalStats
+{
+    uint64_t recordsReplayed = 0;
+    uint64_t recordsAppended = 0;
+    uint64_t bytesAppended = 0;
+    uint64_t compactions = 0;
+};
+
+// Write-ahead log for a Journaled mode NVMemory. Every write to the NVRAM becomes an (address,
+// bytes, checksum) record appended to "<image>.journal", so persisting a STOR costs a few bytes
+// of sequential write instead of the whole image, and a crash at any point leaves the image plus
+// a valid prefix of the log. Opening replays the log, up to the first torn or corrupt record.
+//
+// Once the log outgrows the compaction threshold, the NVRAM is copied (copy on write, so that is
+// cheap) and a background thread writes it to the image through a temporary file and a rename.
+// New records go to "<image>.journal.next" meanwhile, which replaces the old log once the image
+// is in place. Replaying a log onto an image that already has its records is harmless, so there
+// is no crash window.
+//
+// Runs on the guest's thread, except for compaction. Must go away before the NVMemory does.
+class NVRamJournal : public MemoryObserver
+{
+   public:
+    static constexpr size_t DefaultCompactionThreshold = 0x10000;
+
+    NVRamJournal(NVMemory16& nvram, size_t compactionThreshold = DefaultCompactionThreshold);
+    // Flushes and waits for compaction to finish
+    ~NVRamJournal();
+    NVRamJournal(const NVRamJournal&) = delete;
+    NVRamJournal& operator=(const NVRamJournal&) = delete;
+
+    // Appends the records buffered since the last flush to the log
+    void Flush();
+    // Flush(), then waits for the log to be on disk
+    void Sync();
+    // Rewrites the image from the current NVRAM contents in the background and starts a new log
+    void Compact();
+    void WaitForCompaction();
+
+    NVRamJournalStats GetStats() const
+    {
+        return _stats;
+    }
+
+    // Whether this host has what the journal needs, the constructor throws otherwise
+    static bool IsAvailable();
+    static std::string JournalPath(const std::string& imagePath);
+
+    void OnMemoryWrite(size_t address, size_t size) override;
+
+   protected:
+    // Records are buffered until there's this much, or until Flush()
+    static constexpr size_t BufferSize = 4096;
+
+    void _Replay(const std::string& path);
+    void _Append(const std::vector<uint8_t>& bytes);
+    // Writes image to the image file through a temporary and a rename, then drops the old log
+    void _WriteImage(const Memory<uint16_t>& image, int oldJournal);
+
+    NVMemory16& _nvram;
+    std::string _imagePath;
+    std::string _journalPath;
+    size_t _compactionThreshold;
+    int _fd = -1;
+    size_t _journalSize = 0;
+    std::vector<uint8_t> _buffer;
+    NVRamJournalStats _stats;
+
+    // The copy of the NVRAM being compacted. It shares pages with the NVRAM, so it's released on
+    // the guest's thread once the compaction thread is joined, never on that thread.
+    std::unique_ptr<Memory<uint16_t>> _image;
+    std::thread _compaction;
+    std::atomic<bool> _compacting{false};
+    std::exception_ptr _compactionError;
+};
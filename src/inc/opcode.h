@@ -1,7 +1,8 @@
 #pragma once
 #include "common.h"
+#include "register.h"
 
-enum class OpCodeId
+enum class OpCodeId : uint8_t
 {
     ADD = 0,
     SUB,
@@ -44,8 +45,67 @@ struct OpCode
     uint8_t argCount;
 };
 
+// What a single instruction word decodes to. tools/generate_opcodes.py precomputes one of these
+// for every possible word, so decoding is a table lookup.
+struct DecodedInstruction
+{
+    OpCodeId opCodeId;
+    uint8_t argCount;
+    // The next word in memory is a literal operand (SET, JMP)
+    bool hasLiteral;
+    std::array<RegisterId, 3> args;
+
+    constexpr bool IsValid() const
+    {
+        return opCodeId != OpCodeId::INVALID_INSTR;
+    }
+};
+
+// The register an instruction stores its result in, if any. The flag updates done by the ALU
+// instructions don't count, TSTB does since setting RFL is all it does.
+constexpr std::optional<RegisterId> DestinationRegister(const DecodedInstruction& instr)
+{
+    switch (instr.opCodeId)
+    {
+        case OpCodeId::ADD:
+        case OpCodeId::SUB:
+        case OpCodeId::MUL:
+        case OpCodeId::DIV:
+        case OpCodeId::SMUL:
+        case OpCodeId::SDIV:
+        case OpCodeId::AND:
+        case OpCodeId::OR:
+        case OpCodeId::XOR:
+            return instr.args[2];
+        case OpCodeId::MOV:
+        case OpCodeId::LOAD:
+            return instr.args[1];
+        case OpCodeId::SETZ:
+        case OpCodeId::SETO:
+        case OpCodeId::SET:
+        case OpCodeId::POP:
+        case OpCodeId::NOT:
+        case OpCodeId::SHFR:
+        case OpCodeId::SHFL:
+        case OpCodeId::INC:
+        case OpCodeId::DEC:
+            return instr.args[0];
+        case OpCodeId::TSTB:
+            return RegisterId::RFL;
+        default:
+            return std::nullopt;
+    }
+}
+
+constexpr bool IsConditionalJump(OpCodeId opCodeId)
+{
+    return opCodeId == OpCodeId::JZ || opCodeId == OpCodeId::JNZ || opCodeId == OpCodeId::JE ||
+           opCodeId == OpCodeId::JNE;
+}
+
 extern const std::unordered_map<std::string, OpCodeId> mnemonicTable;
 extern const std::unordered_map<OpCodeId, std::string> opCodeMnemonicTable;
 extern const std::unordered_map<OpCodeId, OpCode> opCodeTable;
 extern const std::unordered_map<uint16_t, OpCodeId> opCodeValuesTable;
-extern const std::array<std::string_view, 16> registerNameTable;
\ No newline at end of file
+extern const std::array<std::string_view, 16> registerNameTable;
+extern const std::array<DecodedInstruction, 0x10000> decodeTable;
\ No newline at end of file
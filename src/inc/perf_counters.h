@@ -0,0 +1,45 @@
+#pragma once
+#include "common.h"
+#include "opcode.h"
+
+// Event counts in the spirit of a hardware PMU. Processor only keeps them when built with
+// -DLUINUX_PERF_COUNTERS=ON, otherwise its hooks compile to nothing and the events read 0.
+// cycles and instret are always there, they come from counts the processor keeps anyway.
+struct PerfCounters
+{
+#ifdef LUINUX_PERF_COUNTERS
+    static constexpr bool Enabled = true;
+#else
+    static constexpr bool Enabled = false;
+#endif
+    static constexpr size_t OpCodeCount = static_cast<size_t>(OpCodeId::INVALID_INSTR);
+
+    // The memory bank SWM left selected
+    enum Bank : size_t
+    {
+        Sram,
+        NVRam,
+        BankCount
+    };
+
+    // Every instruction is a cycle, including the idle loop turns that were skipped over
+    uint64_t cycles = 0;
+    // Instructions that actually ran, what retired adds up to
+    uint64_t instret = 0;
+
+    std::array<uint64_t, OpCodeCount> retired{};
+    // JZ, JNZ, JE and JNE
+    uint64_t branchesTaken = 0;
+    uint64_t branchesNotTaken = 0;
+    // LOAD and STOR, the stack is counted on its own
+    std::array<uint64_t, BankCount> loads{};
+    std::array<uint64_t, BankCount> stores{};
+    uint64_t pushes = 0;
+    uint64_t pops = 0;
+    // Divisions by zero, which set the Exception flag
+    uint64_t flagExceptions = 0;
+
+    // One "name count" per line, opcodes that never ran left out
+    std::string Report() const;
+    std::string ToJson() const;
+};
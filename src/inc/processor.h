@@ -1,7 +1,15 @@
 #pragma once
+#include "device_bus.h"
+#include "event_scheduler.h"
+#include "instruction_profile.h"
+#include "jit.h"
 #include "memory.h"
 #include "opcode.h"
+#include "perf_counters.h"
 #include "register.h"
+#include "trace_format.h"
+#include "trace_writer.h"
+#include "translation_cache.h"
 
 // 256 bytes of internal memory, used for 8x register banks
 constexpr size_t InternalMemorySize = 256;
@@ -13,6 +21,47 @@ using NVMemory16 = NVMemory<uint16_t>;
 using Memory8 = Memory<uint8_t>;
 
 typedef std::pair<uint16_t, uint16_t> ConstantPair;
+
+// The processor's registers, indexed by RegisterId and kept in host byte order.
+using RegisterFile = std::array<uint16_t, static_cast<size_t>(RegisterId::END_OF_REGLIST)>;
+
+// Registers an instruction operates on, in encoding order. This lives on the stack of the execute
+// stage and is handed to the instruction handlers by reference, so executing an instruction never
+// touches the heap.
+struct InstructionOperands
+{
+    std::array<uint16_t*, 3> regs{};
+    uint8_t count = 0;
+
+    uint16_t& operator[](size_t i) const
+    {
+        return *regs[i];
+    }
+};
+
+// ALU operation whose flags haven't been folded into RFL yet
+enum class FlagsOperation : uint8_t
+{
+    None = 0,
+    Add,
+    Sub,
+    Mul,
+    SMul,
+    Div,
+    SDiv
+};
+
+// Most ALU flags get overwritten before anything looks at them, so the ALU only records what it
+// did. Zero/Carry/Negative/Overflow/Exception are worked out from this when RFL is read.
+struct PendingFlags
+{
+    FlagsOperation operation = FlagsOperation::None;
+    uint16_t a = 0;
+    uint16_t b = 0;
+    // Result before truncating to 16 bits
+    uint32_t result = 0;
+};
+
 enum class InstructionCycle
 {
     Idle = 0,
@@ -22,28 +71,244 @@ enum class InstructionCycle
     Halted
 };
 
+// Why Processor::Run() returned
+enum class StopReason
+{
+    Halted = 0,       // STOP ran
+    Trap,             // the Trap flag is set
+    BudgetExhausted,  // ran the number of instructions it was given
+    Breakpoint,       // about to run an instruction with a breakpoint on it
+    Fault             // the instruction could not be run, see GetFaultMessage()
+};
+
+constexpr const char* StopReasonName(StopReason reason)
+{
+    switch (reason)
+    {
+        case StopReason::Halted:
+            return "Halted";
+        case StopReason::Trap:
+            return "Trap";
+        case StopReason::BudgetExhausted:
+            return "BudgetExhausted";
+        case StopReason::Breakpoint:
+            return "Breakpoint";
+        case StopReason::Fault:
+            return "Fault";
+    }
+    return "Unknown";
+}
+
+// Guest faults. Each one is also the index of its handler in the vector table, whose entry 0 is
+// the handler for interrupts.
+enum class Fault : uint8_t
+{
+    None = 0,
+    InvalidInstruction,  // RIP is outside program memory, or the word there doesn't decode
+    AddressOutOfRange,   // a data access that doesn't fit in memory
+    NVRamUnavailable,    // SWM without NVRAM
+    DivideByZero,        // DIV or SDIV by zero, raised once the Exception flag is set
+    END_OF_FAULTS
+};
+constexpr size_t InterruptVector = 0;
+
+constexpr const char* FaultName(Fault fault)
+{
+    switch (fault)
+    {
+        case Fault::None:
+            return "None";
+        case Fault::InvalidInstruction:
+            return "InvalidInstruction";
+        case Fault::AddressOutOfRange:
+            return "AddressOutOfRange";
+        case Fault::NVRamUnavailable:
+            return "NVRamUnavailable";
+        case Fault::DivideByZero:
+            return "DivideByZero";
+        case Fault::END_OF_FAULTS:
+            break;
+    }
+    return "Unknown";
+}
+
+// Everything Processor::Restore() needs to put a processor back where it was. SRAM is a copy on
+// write copy, so taking one costs about as much as a page table. NVRAM contents are not part of
+// it, only whether NVRAM was the selected bank.
+struct ProcessorSnapshot
+{
+    // RFL with the pending ALU flags folded in. The internal memory bank is built from these.
+    RegisterFile registers{};
+    Memory16 sram{MainMemorySize};
+    bool nvramSelected = false;
+    uint64_t instructionCount = 0;
+    std::optional<uint16_t> stoppedAtBreakpoint;
+
+    // Where PerformExecutionCycle() is at
+    InstructionCycle instructionStatus = InstructionCycle::Idle;
+    OpCodeId decodedOpCodeId = OpCodeId::INVALID_INSTR;
+    uint16_t literalValue = 0;
+    uint16_t fetchedInstruction = 0;
+    std::array<RegisterId, 3> instructionArgs{};
+    uint8_t instructionArgCount = 0;
+    uint16_t twoWordOperand = 0;
+
+    // Raised but not taken yet
+    bool interruptPending = false;
+    Fault fault = Fault::None;
+    // See EventScheduler::Rebase(), events nobody owns just keep their distance
+    EventScheduler::OwnedEvents ownedEvents;
+
+    // Of instructionCount, so instret goes back with it. cycles and instret are left at 0.
+    uint64_t idleInstructionCount = 0;
+    PerfCounters counters;
+};
+
 class Processor
 {
    public:
     Processor(Memory16& programMemory, std::shared_ptr<NVMemory16> nvram = nullptr);
 
+    // A new processor in the same state, running the same program. SRAM pages are shared with
+    // this one until either side writes to them, so forking costs the pages touched afterwards.
+    // NVRAM is not forked, both keep using the same one.
+    std::unique_ptr<Processor> Fork() const;
+
+    // See ProcessorSnapshot. Restoring a snapshot that had NVRAM selected throws if this processor
+    // has no NVRAM. Breakpoints, engine and profiling settings are left alone.
+    ProcessorSnapshot Snapshot() const;
+    void Restore(const ProcessorSnapshot& snapshot);
+
     void WriteRegister(RegisterId reg, uint16_t value);
     uint16_t ReadRegister(RegisterId reg) const;
 
+    // Runs one instruction, after any events due and a pending interrupt like ExecuteAll() would
     void PerformExecutionCycle();
-    void ExecuteAll()
+    // Runs until STOP, until the Trap flag is set, or until a breakpoint. Executes whole basic
+    // blocks out of the translation cache instead of fetching and decoding every instruction.
+    // Throws on faults without a handler. Single cycles throw for those too.
+    void ExecuteAll();
+
+    // Same as ExecuteAll, but gives up after maxInstructions and reports faults without a handler
+    // instead of throwing. Host errors, like an NVRAM file that can't be written, still throw.
+    // Stop conditions are only checked between basic blocks. Calling it again carries on where
+    // the last call stopped, past the breakpoint it stopped at if that's the case. A fault leaves
+    // RIP at the instruction that faulted.
+    StopReason Run(uint64_t maxInstructions);
+    const std::string& GetFaultMessage() const
     {
-        while (_instructionStatus != InstructionCycle::Halted)
-        {
-            FlagsObject f(ReadRegister(RegisterId::RFL));
-            if (f.flags.Trap == 1)
-            {
-                break;
-            }
-            _DoPerformExecutionCycle();
-        }
+        return _faultMessage;
+    }
+    // The fault the last Run() stopped for
+    Fault GetLastFault() const
+    {
+        return _lastFault;
+    }
+    // Instructions run since construction, by any of the entry points
+    uint64_t GetInstructionCount() const
+    {
+        return _instructionCount;
+    }
+
+    // Run() and ExecuteAll() stop right before running the instruction at address
+    void AddBreakpoint(uint16_t address);
+    void RemoveBreakpoint(uint16_t address);
+
+    const TranslationCacheStats& GetTranslationCacheStats() const
+    {
+        return _translationCache.GetStats();
+    }
+
+    // Devices mapped over main memory, LOAD/STOR/PUSH/POP go through it. Forks map the same
+    // devices, snapshots don't include any.
+    DeviceBus& GetBus()
+    {
+        return _bus;
+    }
+
+    // Events on the instruction count, every instruction being one cycle. Run() and ExecuteAll()
+    // fire them between basic blocks, cutting a block short when one falls due inside it. Restore()
+    // moves pending events along with the clock, forks start without any.
+    EventScheduler& GetScheduler()
+    {
+        return _scheduler;
+    }
+
+    // Where the vector table starts in SRAM, whichever bank is selected. Entry n is the handler
+    // address for Fault n, entry 0 the one for interrupts, and 0 means no handler. There is no
+    // table to begin with.
+    //
+    // A handler is entered with the return address and then RFL pushed, and the Interrupt flag
+    // set. It returns with POP RFL, POP RIP. Faults return to the instruction that faulted, so
+    // the handler has to fix its cause or move the return address on. DivideByZero returns past
+    // the division. Faults are taken even with the Interrupt flag set.
+    void SetVectorTable(std::optional<uint16_t> address)
+    {
+        _vectorTable = address;
+    }
+    std::optional<uint16_t> GetVectorTable() const
+    {
+        return _vectorTable;
+    }
+    uint64_t GetHandledFaultCount() const
+    {
+        return _handledFaults;
+    }
+
+    // Run() and ExecuteAll() take interrupts between basic blocks. A raised interrupt waits while
+    // the Interrupt flag is set or while there is no handler for it.
+    void RaiseInterrupt()
+    {
+        _interruptPending = true;
+    }
+
+    // A block of nothing but jumps that keeps jumping back to itself can't change anything until
+    // the next event, so it's skipped ahead to it instead of run. Skipped instructions count as
+    // run, this is how many of them there were.
+    uint64_t GetIdleInstructionCount() const
+    {
+        return _idleInstructionCount;
+    }
+
+    // See PerfCounters. Only cycles and instret are counted unless built with
+    // LUINUX_PERF_COUNTERS.
+    PerfCounters GetPerfCounters() const;
+
+    // Picks how ExecuteAll runs blocks, can be switched at any time. Throws if the JIT is not
+    // available on this host.
+    void SetExecutionEngine(ExecutionEngine engine);
+    ExecutionEngine GetExecutionEngine() const
+    {
+        return _executionEngine;
+    }
+    JitStats GetJitStats() const
+    {
+        return _jit ? _jit->GetStats() : JitStats{};
+    }
+
+    // Folding common instruction sequences into superinstructions is on by default
+    void SetSuperinstructions(bool enabled)
+    {
+        _translationCache.SetFusion(enabled);
+    }
+
+    // Starts counting the instruction pairs and triples ExecuteAll runs, see InstructionProfile.
+    // Costs a few percent while on.
+    void EnableProfiling(bool enabled);
+    const InstructionProfile* GetProfile() const
+    {
+        return _profile.get();
     }
 
+    // Traces every instruction run from here on into writer, in the format TraceEncoder describes.
+    // Blocks run an instruction at a time and idle loops aren't skipped while tracing, so expect
+    // it to be a lot slower. nullptr stops tracing, the writer is left for its owner to Close().
+    void SetTraceWriter(std::shared_ptr<TraceWriter> writer);
+
+    // The registers laid out the way the hardware keeps them, big-endian in the internal memory
+    // bank. Built from the register file on every call, so keep it off hot paths.
+    const Memory8& GetInternalMemory() const;
+
     // TODO:
     // execute
     // alu
@@ -51,74 +316,184 @@ class Processor
     // pause
 
    protected:
-    void _DoPerformExecutionCycle();
+    // Whether the instruction ran, which it didn't when it raised a fault other than a trap
+    bool _DoPerformExecutionCycle();
     void _FetchInstruction();
     void _DecodeInstruction();
     void _ExecuteInstruction();
+    void _DispatchInstruction(OpCodeId opCodeId, const InstructionOperands& operands);
+    StopReason _Run(uint64_t maxInstructions);
+    // Runs at most limit instructions of the block, returns how many it ran. Counts them as it
+    // goes, so devices see the exact cycle an instruction runs at.
+    size_t _ExecuteBlock(BasicBlock& block, size_t limit);
+    void _ExecuteFused(const TranslatedInstruction* group);
+    size_t _RunJitCode(BasicBlock& block);
+    // False when the handler couldn't be entered, see _EnterHandler()
+    bool _TakeInterrupt();
+    void _RaiseFault(Fault fault)
+    {
+        _fault = fault;
+    }
+    // Right after the instruction at instructionAddress raised a fault. Leaves RIP where the
+    // handler returns to and tells whether the instruction counts as run, which only traps do.
+    bool _SettleFault(uint16_t instructionAddress);
+    // Hands the settled fault to its handler, false when it has none or it couldn't be entered
+    bool _TakeFault();
+    // Handler address in the vector table, 0 when there's none
+    uint16_t _VectorEntry(size_t index) const;
+    // Pushes RIP and RFL and jumps to handler. When either word doesn't fit in RAM at RSP, nothing
+    // changes and it's a double fault, reason goes in the message.
+    bool _EnterHandler(uint16_t handler, const char* reason);
+    std::string _DescribeFault(Fault fault) const;
+    // Skips whole turns of an idle loop block, up to the next event or the end of the budget
+    void _FastForward(const BasicBlock& block, uint64_t& remaining);
     void _CleanInstructionCycle();
-    uint16_t _DereferenceRegisterRead(RegisterId reg) const;
-    void _DereferenceRegisterWrite(RegisterId reg, uint16_t value);
+    // PMU hooks, empty unless built with LUINUX_PERF_COUNTERS. A conditional jump is taken when
+    // it left RIP somewhere other than nextAddress.
+    void _CountRetired(OpCodeId opCodeId, uint16_t nextAddress)
+    {
+        if constexpr (PerfCounters::Enabled)
+        {
+            ++_counters.retired[static_cast<size_t>(opCodeId)];
+            if (IsConditionalJump(opCodeId))
+            {
+                ++(_Reg(RegisterId::RIP) != nextAddress ? _counters.branchesTaken
+                                                        : _counters.branchesNotTaken);
+            }
+        }
+    }
+    void _CountEvent(uint64_t& counter)
+    {
+        if constexpr (PerfCounters::Enabled)
+        {
+            ++counter;
+        }
+    }
+    void _TraceInstruction(uint16_t rip);
+    void _TraceStore(uint16_t address, uint16_t value)
+    {
+        if (_traceEncoder) [[unlikely]]
+        {
+            _traceEncoder->AddStore(address, value);
+        }
+    }
+    PerfCounters::Bank _SelectedBank() const
+    {
+        return _mainMemory == _sram ? PerfCounters::Sram : PerfCounters::NVRam;
+    }
+    void _BindOperands(InstructionOperands& operands,
+                       const std::array<RegisterId, 3>& args,
+                       uint8_t count);
+    // Unchecked access for the execute stage, decoded register ids are always in range
+    uint16_t& _Reg(RegisterId reg)
+    {
+        return _registers[static_cast<size_t>(reg)];
+    }
+    uint16_t _Reg(RegisterId reg) const
+    {
+        return _registers[static_cast<size_t>(reg)];
+    }
+    void _SetPendingFlags(FlagsOperation operation, ConstantPair values, uint32_t result)
+    {
+        _pendingFlags = {operation, values.first, values.second, result};
+#ifdef LUINUX_EAGER_FLAGS
+        _Flags();
+#endif
+    }
+    // RFL with the pending ALU flags applied
+    uint16_t _EvaluateFlags() const;
+    // Folds the pending ALU flags into RFL, for anything about to read or modify it in place
+    uint16_t& _Flags();
+    // The word in main memory the register points at. Raise AddressOutOfRange and return false
+    // when it isn't in memory.
+    bool _DereferenceRegisterRead(RegisterId reg, uint16_t& value);
+    bool _DereferenceRegisterWrite(RegisterId reg, uint16_t value);
     std::string _InstructionToString(uint16_t instruction) const;
 
     // All the instructions!
 
     // TODO: Org some of these into ALU
-    ConstantPair _Get_RR(std::vector<std::shared_ptr<Register>> args) const;
-    void _Base_ADD(ConstantPair values, std::shared_ptr<Register> dest);
-    void _Base_SUB(ConstantPair values, std::shared_ptr<Register> dest);
-    void _Base_MUL(ConstantPair values, std::shared_ptr<Register> dest);
-    void _Base_DIV(ConstantPair values, std::shared_ptr<Register> dest);
-    void _Base_SMUL(ConstantPair values, std::shared_ptr<Register> dest);
-    void _Base_SDIV(ConstantPair values, std::shared_ptr<Register> dest);
-    void _Base_AND(ConstantPair values, std::shared_ptr<Register> dest);
-    void _Base_OR(ConstantPair values, std::shared_ptr<Register> dest);
-    void _Base_XOR(ConstantPair values, std::shared_ptr<Register> dest);
+    ConstantPair _Get_RR(const InstructionOperands& args) const;
+    void _Base_ADD(ConstantPair values, uint16_t& dest);
+    void _Base_SUB(ConstantPair values, uint16_t& dest);
+    void _Base_MUL(ConstantPair values, uint16_t& dest);
+    void _Base_DIV(ConstantPair values, uint16_t& dest);
+    void _Base_SMUL(ConstantPair values, uint16_t& dest);
+    void _Base_SDIV(ConstantPair values, uint16_t& dest);
+    void _Base_AND(ConstantPair values, uint16_t& dest);
+    void _Base_OR(ConstantPair values, uint16_t& dest);
+    void _Base_XOR(ConstantPair values, uint16_t& dest);
     void _Base_JZ(ConstantPair values);
     void _Base_JNZ(ConstantPair values);
-    void ADD(std::vector<std::shared_ptr<Register>> args);
-    void SUB(std::vector<std::shared_ptr<Register>> args);
-    void MUL(std::vector<std::shared_ptr<Register>> args);
-    void SMUL(std::vector<std::shared_ptr<Register>> args);
-    void STOP(std::vector<std::shared_ptr<Register>> args);
-    void SET(std::vector<std::shared_ptr<Register>> args);
-    void DIV(std::vector<std::shared_ptr<Register>> args);
-    void SDIV(std::vector<std::shared_ptr<Register>> args);
-    void AND(std::vector<std::shared_ptr<Register>> args);
-    void OR(std::vector<std::shared_ptr<Register>> args);
-    void XOR(std::vector<std::shared_ptr<Register>> args);
-    void JZ(std::vector<std::shared_ptr<Register>> args);
-    void JNZ(std::vector<std::shared_ptr<Register>> args);
-    void JE(std::vector<std::shared_ptr<Register>> args);
-    void JNE(std::vector<std::shared_ptr<Register>> args);
-    void MOV(std::vector<std::shared_ptr<Register>> args);
-    void LOAD(std::vector<std::shared_ptr<Register>> args);
-    void STOR(std::vector<std::shared_ptr<Register>> args);
-    void TSTB(std::vector<std::shared_ptr<Register>> args);
-    void SETZ(std::vector<std::shared_ptr<Register>> args);
-    void SETO(std::vector<std::shared_ptr<Register>> args);
-    void PUSH(std::vector<std::shared_ptr<Register>> args);
-    void POP(std::vector<std::shared_ptr<Register>> args);
-    void NOT(std::vector<std::shared_ptr<Register>> args);
-    void SHFR(std::vector<std::shared_ptr<Register>> args);
-    void SHFL(std::vector<std::shared_ptr<Register>> args);
-    void INC(std::vector<std::shared_ptr<Register>> args);
-    void DEC(std::vector<std::shared_ptr<Register>> args);
-    void NOP(std::vector<std::shared_ptr<Register>> args);
-    void TRAP(std::vector<std::shared_ptr<Register>> args);
-    void SWM(std::vector<std::shared_ptr<Register>> args);
-    void JMP(std::vector<std::shared_ptr<Register>> args);
+    void ADD(const InstructionOperands& args);
+    void SUB(const InstructionOperands& args);
+    void MUL(const InstructionOperands& args);
+    void SMUL(const InstructionOperands& args);
+    void STOP(const InstructionOperands& args);
+    void SET(const InstructionOperands& args);
+    void DIV(const InstructionOperands& args);
+    void SDIV(const InstructionOperands& args);
+    void AND(const InstructionOperands& args);
+    void OR(const InstructionOperands& args);
+    void XOR(const InstructionOperands& args);
+    void JZ(const InstructionOperands& args);
+    void JNZ(const InstructionOperands& args);
+    void JE(const InstructionOperands& args);
+    void JNE(const InstructionOperands& args);
+    void MOV(const InstructionOperands& args);
+    void LOAD(const InstructionOperands& args);
+    void STOR(const InstructionOperands& args);
+    void TSTB(const InstructionOperands& args);
+    void SETZ(const InstructionOperands& args);
+    void SETO(const InstructionOperands& args);
+    void PUSH(const InstructionOperands& args);
+    void POP(const InstructionOperands& args);
+    void NOT(const InstructionOperands& args);
+    void SHFR(const InstructionOperands& args);
+    void SHFL(const InstructionOperands& args);
+    void INC(const InstructionOperands& args);
+    void DEC(const InstructionOperands& args);
+    void NOP(const InstructionOperands& args);
+    void TRAP(const InstructionOperands& args);
+    void SWM(const InstructionOperands& args);
+    void JMP(const InstructionOperands& args);
 
     Memory16& _programMemory;
     std::shared_ptr<Memory16> _mainMemory;
     std::shared_ptr<Memory16> _sram;
     std::shared_ptr<NVMemory16> _nvram;
-    Memory8 _internalMemory;
-    std::unordered_map<RegisterId, Register> _registers;
+    // Devices cancel their events on the way out, so the scheduler goes after the bus
+    EventScheduler _scheduler;
+    DeviceBus _bus;
+    RegisterFile _registers{};
+    PendingFlags _pendingFlags;
+    mutable Memory8 _internalMemory;
 
     OpCodeId _decodedOpCodeId = OpCodeId::INVALID_INSTR;
     uint16_t _literalValue = 0;
     uint16_t _fetchedInstruction = 0;
-    std::vector<RegisterId> _instructionArgs;
-    uint16_t _2wordOperand;
+    std::array<RegisterId, 3> _instructionArgs{};
+    uint8_t _instructionArgCount = 0;
+    uint16_t _2wordOperand = 0;
     InstructionCycle _instructionStatus = InstructionCycle::Idle;
+    TranslationCache _translationCache;
+    ExecutionEngine _executionEngine = ExecutionEngine::Interpreter;
+    std::unique_ptr<JitCompiler> _jit;
+    std::unique_ptr<InstructionProfile> _profile;
+    uint64_t _instructionCount = 0;
+    std::string _faultMessage;
+    std::set<uint16_t> _breakpoints;
+    std::optional<uint16_t> _vectorTable;
+    bool _interruptPending = false;
+    // Raised by the instruction running, until _SettleFault()
+    Fault _fault = Fault::None;
+    Fault _lastFault = Fault::None;
+    uint64_t _handledFaults = 0;
+    uint64_t _idleInstructionCount = 0;
+    PerfCounters _counters;
+    std::shared_ptr<TraceWriter> _traceWriter;
+    std::unique_ptr<TraceEncoder> _traceEncoder;
+    std::vector<uint8_t> _traceBuffer;
+    // Where the last Run() stopped for a breakpoint, the next one steps over it
+    std::optional<uint16_t> _stoppedAtBreakpoint;
 };
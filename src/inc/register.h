@@ -31,7 +31,7 @@ enum class FlagsRegister : uint16_t
     Carry = 0x0002,
     Negative = 0x0004,
     Trap = 0x0008,
-    Reserved = 0x0010,
+    Interrupt = 0x0010,  // Set while an interrupt is handled, holds off further ones
     Overflow = 0x0020,
     Exception = 0x0040,
     Memory = 0x0080  // 0=SRAM, 1=NVRAM
@@ -71,7 +71,7 @@ struct FlagsUnion
     unsigned Carry : 1;
     unsigned Negative : 1;
     unsigned Trap : 1;
-    unsigned Reserved : 1;
+    unsigned Interrupt : 1;
     unsigned Overflow : 1;
     unsigned Exception : 1;
     unsigned Memory : 1;
@@ -0,0 +1,44 @@
+#pragma once
+#include "common.h"
+#include "debug_line_table.h"
+#include "processor.h"
+
+// Samples a processor's RIP every period instructions, on its event scheduler, and attributes the
+// samples to source lines and tags through the program's DebugLineTable. RIP is sampled between
+// instructions, so a sample is the instruction about to run.
+//
+// The ISA has no call instruction to unwind, the folded stacks are the tag a sample is in and its
+// line below that. Code before the first tag goes under _start.
+class SamplingProfiler
+{
+   public:
+    SamplingProfiler(Processor& cpu, uint64_t period);
+    ~SamplingProfiler();
+    SamplingProfiler(const SamplingProfiler&) = delete;
+    SamplingProfiler& operator=(const SamplingProfiler&) = delete;
+
+    // Samples per RIP
+    const std::map<uint16_t, uint64_t>& GetSamples() const
+    {
+        return _samples;
+    }
+    uint64_t GetSampleCount() const
+    {
+        return _sampleCount;
+    }
+
+    // The hottest lines and tags, most samples first
+    std::string Report(const DebugLineTable& lines, size_t limit = 10) const;
+    // One "tag;line count" per line, for flamegraph.pl and the like
+    void WriteFoldedStacks(std::ostream& out, const DebugLineTable& lines) const;
+
+   protected:
+    void _Arm(uint64_t now);
+    void _Sample(uint64_t cycle);
+
+    Processor& _cpu;
+    uint64_t _period;
+    std::optional<EventScheduler::EventId> _event;
+    std::map<uint16_t, uint64_t> _samples;
+    uint64_t _sampleCount = 0;
+};
@@ -0,0 +1,19 @@
+#pragma once
+#include "common.h"
+#include "processor.h"
+
+// On-disk form of a ProcessorSnapshot. All fields are big-endian like the guest, after a "LXSN"
+// magic and a format version. SRAM is stored as the pages that aren't all zeros, each as its index
+// and its bytes, so untouched memory takes no room and the rest at most a page index more.
+class SnapshotFile
+{
+   public:
+    static constexpr uint16_t Version = 4;
+
+    static void Write(std::ostream& out, const ProcessorSnapshot& snapshot);
+    // Throws on anything that isn't a snapshot of this version, or is cut short
+    static ProcessorSnapshot Read(std::istream& in);
+
+    static void Save(const std::string& path, const ProcessorSnapshot& snapshot);
+    static ProcessorSnapshot Load(const std::string& path);
+};
@@ -0,0 +1,72 @@
+#pragma once
+#include <atomic>
+#include <bit>
+
+#include "common.h"
+
+// Bounded queue between exactly one producer thread and one consumer thread, without locks. Each
+// side owns one index and only reads the other's, keeping a copy of it so it only goes back to
+// the other side's cache line when the copy says there's not enough room, or items.
+template <typename T>
+class SpscRing
+{
+   public:
+    // Rounded up to a power of two
+    explicit SpscRing(size_t capacity) : _buffer(std::bit_ceil(std::max<size_t>(capacity, 2)))
+    {
+        _mask = _buffer.size() - 1;
+    }
+
+    size_t Capacity() const
+    {
+        return _buffer.size();
+    }
+
+    // Producer side. Pushes all of items or, when they don't fit right now, none of them.
+    bool TryPush(const T* items, size_t count)
+    {
+        const size_t head = _head.load(std::memory_order_relaxed);
+        if (head + count - _cachedTail > _buffer.size())
+        {
+            _cachedTail = _tail.load(std::memory_order_acquire);
+            if (head + count - _cachedTail > _buffer.size())
+            {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            _buffer[(head + i) & _mask] = items[i];
+        }
+        _head.store(head + count, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Takes up to max items, returns how many it took.
+    size_t Pop(T* items, size_t max)
+    {
+        const size_t tail = _tail.load(std::memory_order_relaxed);
+        if (_cachedHead - tail < max)
+        {
+            _cachedHead = _head.load(std::memory_order_acquire);
+        }
+        const size_t count = std::min(max, _cachedHead - tail);
+        for (size_t i = 0; i < count; ++i)
+        {
+            items[i] = _buffer[(tail + i) & _mask];
+        }
+        _tail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+   protected:
+    std::vector<T> _buffer;
+    size_t _mask;
+
+    // Producer's, the next slot to write
+    alignas(64) std::atomic<size_t> _head{0};
+    size_t _cachedTail = 0;
+    // Consumer's, the next slot to read
+    alignas(64) std::atomic<size_t> _tail{0};
+    size_t _cachedHead = 0;
+};
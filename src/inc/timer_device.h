@@ -0,0 +1,47 @@
+#pragma once
+#include "device_bus.h"
+#include "processor.h"
+
+// Programmable interval timer on a processor's clock. Counts down the period from when the
+// control register is written, on expiry bumps the status register and optionally raises an
+// interrupt, then starts over when periodic.
+//
+// Belongs to the processor it was made for, forks mapping it keep interrupting that one. Its
+// expiry is an event the scheduler knows it owns, so restoring a snapshot puts the next one back
+// where it was. The registers aren't part of snapshots though.
+class TimerDevice : public Device
+{
+   public:
+    // Below ConsoleDevice, and like it out of the stack's way
+    static constexpr uint16_t DefaultBase = 0xfb00;
+
+    // Cycles between expiries
+    static constexpr uint16_t PeriodRegister = 0;
+    static constexpr uint16_t ControlRegister = 2;
+    // Expiries since it was last read, reading clears it
+    static constexpr uint16_t StatusRegister = 4;
+
+    static constexpr uint16_t ControlEnable = 0x0001;
+    static constexpr uint16_t ControlPeriodic = 0x0002;
+    static constexpr uint16_t ControlInterrupt = 0x0004;
+
+    TimerDevice(Processor& cpu);
+    ~TimerDevice();
+    TimerDevice(const TimerDevice&) = delete;
+    TimerDevice& operator=(const TimerDevice&) = delete;
+
+    uint16_t Read16(uint16_t offset) override;
+    void Write16(uint16_t offset, uint16_t value) override;
+
+   protected:
+    void _Arm(uint64_t due);
+    void _Disarm();
+    void _Expire(uint64_t cycle);
+
+    Processor& _cpu;
+    EventScheduler::OwnerId _owner;
+    uint16_t _period = 0;
+    uint16_t _control = 0;
+    uint16_t _expiries = 0;
+    std::optional<EventScheduler::EventId> _event;
+};
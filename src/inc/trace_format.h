@@ -0,0 +1,89 @@
+#pragma once
+#include "common.h"
+#include "opcode.h"
+#include "register.h"
+
+// Binary execution traces. A "LXTR" magic, a version byte and the registers tracing started
+// with, then one record per instruction run:
+//
+//   flags           bit 0: RIP isn't right after the last instruction, bit 1: registers
+//                   changed, bit 2: memory was written
+//   RIP             zigzag varint of its distance from right after the last instruction
+//   word, literal   the instruction as it is in memory, the literal only when it has one
+//   registers       varint count, then register id and zigzag varint of the change per register
+//   memory          varint count, then zigzag varint of the distance from the last address
+//                   written and the word stored, per word
+//
+// Words are big-endian like the guest. Changes are relative to the last record, so whatever ran
+// in between, like entering a fault handler, shows up in the next one.
+using TraceRegisters = std::array<uint16_t, static_cast<size_t>(RegisterId::END_OF_REGLIST)>;
+
+struct TraceRecord
+{
+    uint16_t rip = 0;
+    uint16_t instruction = 0;
+    std::optional<uint16_t> literal;
+    // Register values after the instruction, RIP left out
+    std::vector<std::pair<RegisterId, uint16_t>> registers;
+    // Words stored, address and value
+    std::vector<std::pair<uint16_t, uint16_t>> memory;
+};
+
+class TraceEncoder
+{
+   public:
+    static constexpr std::array<char, 4> Magic = {'L', 'X', 'T', 'R'};
+    static constexpr uint8_t Version = 1;
+
+    // Appends the header to out
+    TraceEncoder(const TraceRegisters& registers, std::vector<uint8_t>& out);
+
+    // Memory written by the next record, or by whatever runs before it
+    void AddStore(uint16_t address, uint16_t value)
+    {
+        _stores.push_back({address, value});
+    }
+    // Appends the record of the instruction at rip, given the registers it left behind
+    void AddInstruction(uint16_t rip,
+                        uint16_t instruction,
+                        uint16_t literal,
+                        const TraceRegisters& registers,
+                        std::vector<uint8_t>& out);
+
+   protected:
+    TraceRegisters _registers;
+    uint16_t _expectedRip;
+    uint16_t _lastStore = 0;
+    std::vector<std::pair<uint16_t, uint16_t>> _stores;
+};
+
+class TraceDecoder
+{
+   public:
+    // Reads the header, throws when in isn't a trace of this version
+    explicit TraceDecoder(std::istream& in);
+
+    // False at the end of the trace, throws when it's cut short in the middle of a record
+    bool Next(TraceRecord& record);
+
+    // After the last record read
+    const TraceRegisters& Registers() const
+    {
+        return _registers;
+    }
+    uint64_t RecordsRead() const
+    {
+        return _records;
+    }
+
+   protected:
+    uint8_t _Byte();
+    uint16_t _Word();
+    uint64_t _Varint();
+
+    std::istream& _in;
+    TraceRegisters _registers{};
+    uint16_t _expectedRip = 0;
+    uint16_t _lastStore = 0;
+    uint64_t _records = 0;
+};
@@ -0,0 +1,46 @@
+#pragma once
+#include <atomic>
+#include <exception>
+#include <thread>
+
+#include "common.h"
+#include "spsc_ring.h"
+
+struct TraceWriterStats
+{
+    uint64_t bytesWritten = 0;
+    // Times the guest found the ring full and had to wait for the writer thread
+    uint64_t stalls = 0;
+};
+
+// Puts a trace in a file from a thread of its own. The thread running the guest hands bytes over
+// through an SpscRing, and only ever waits when the writer falls a whole ring behind. Nothing is
+// dropped.
+class TraceWriter
+{
+   public:
+    explicit TraceWriter(const std::string& filename, size_t ringBytes = 1 << 20);
+    // Close()s, reporting errors on stderr
+    ~TraceWriter();
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+    // From the one thread producing the trace
+    void Write(const uint8_t* data, size_t size);
+    // Waits for everything written to be in the file and stops the writer thread. Rethrows the
+    // first error it ran into.
+    void Close();
+
+    TraceWriterStats GetStats() const;
+
+   protected:
+    void _WriterLoop();
+
+    SpscRing<uint8_t> _ring;
+    std::ofstream _file;
+    std::atomic<bool> _stop{false};
+    std::atomic<uint64_t> _bytesWritten{0};
+    uint64_t _stalls = 0;
+    std::exception_ptr _error;
+    std::thread _writer;
+};
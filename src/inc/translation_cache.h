@@ -0,0 +1,144 @@
+#pragma once
+#include "common.h"
+#include "memory.h"
+#include "opcode.h"
+
+using Memory16 = Memory<uint16_t>;
+
+// Instruction sequences the translator folds into one superinstruction, so they run without
+// going through dispatch for every member. Only register operands other than RIP and RFL are
+// allowed in a group, which lets the group skip the intermediate RIP updates.
+enum class FusedOp : uint8_t
+{
+    None = 0,
+    IncSubJnz,  // INC, SUB, JNZ: counting loop tail
+    DecDecJnz,  // DEC, DEC, JNZ: stepping a word address down
+    SubJnz,     // SUB, JNZ: compare and branch
+    IncSub,     // INC, SUB: bump and compare
+    SetSet,     // SET, SET: setup code, goto: targets
+};
+
+constexpr size_t FusedLength(FusedOp op)
+{
+    switch (op)
+    {
+        case FusedOp::IncSubJnz:
+        case FusedOp::DecDecJnz:
+            return 3;
+        case FusedOp::SubJnz:
+        case FusedOp::IncSub:
+        case FusedOp::SetSet:
+            return 2;
+        default:
+            return 1;
+    }
+}
+
+// An instruction fetched and decoded ahead of time, along with its literal word when it has one.
+struct TranslatedInstruction
+{
+    DecodedInstruction decoded;
+    uint16_t literal;
+    // RIP once this instruction has been fetched
+    uint16_t nextAddress;
+    // Set on the first instruction of a superinstruction. The rest of the group is left as is, so
+    // execution may still start in the middle of it.
+    FusedOp fused = FusedOp::None;
+};
+
+// Native code for the leading instructions of a block. Gets the processor's register file, one
+// host-order uint16_t per RegisterId.
+using JitFunction = void (*)(uint16_t* registers);
+
+// A run of instructions that always executes start to end. It ends on anything that may change
+// control flow: jumps, STOP, TRAP, and writes to RIP or RFL (which may set the Trap flag).
+struct BasicBlock
+{
+    uint16_t startAddress;
+    // One past the last byte of the block, as a size_t because the block may end at 0x10000
+    size_t endAddress;
+    std::vector<TranslatedInstruction> instructions;
+    // Nothing but jumps and NOPs. Jumping back to its own start, the block is an idle loop that
+    // can't get anywhere until something outside of it changes the state.
+    bool onlyBranches = false;
+
+    // Bookkeeping for the JIT engine, see JitCompiler
+    uint32_t executionCount = 0;
+    JitFunction jitCode = nullptr;
+    // How many of the leading instructions jitCode covers
+    uint8_t jitInstructionCount = 0;
+};
+
+struct TranslationCacheStats
+{
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    // Blocks thrown away because their bytes were written to
+    uint64_t invalidations = 0;
+    // Superinstructions formed while translating
+    uint64_t fusedGroups = 0;
+};
+
+// Caches the basic blocks found in program memory, keyed by their start address. It watches the
+// program memory and drops exactly the blocks whose bytes get written to.
+class TranslationCache : public MemoryObserver
+{
+   public:
+    static constexpr size_t MaxBlockInstructions = 64;
+    static constexpr size_t PageSize = 256;
+
+    TranslationCache(Memory16& programMemory);
+    ~TranslationCache();
+    TranslationCache(const TranslationCache&) = delete;
+    TranslationCache& operator=(const TranslationCache&) = delete;
+
+    // Returns the block starting at address, translating it on a miss. The block has no
+    // instructions when the first one can't be fetched or decoded. The pointer stays valid until
+    // the next Lookup() even if the block gets invalidated meanwhile.
+    BasicBlock* Lookup(uint16_t address);
+
+    // Drops every block
+    void Clear();
+
+    // Superinstruction fusion is on by default. Changing it drops every block.
+    void SetFusion(bool enabled);
+    bool IsFusionEnabled() const
+    {
+        return _fusion;
+    }
+
+    // Makes sure no block runs across address, a block starts there instead. Used for
+    // breakpoints, so that only block entries need checking.
+    void AddBlockBoundary(uint16_t address);
+    void RemoveBlockBoundary(uint16_t address);
+
+    // Changes every time a block gets dropped, so whoever is running a block can tell
+    uint64_t Generation() const
+    {
+        return _generation;
+    }
+
+    const TranslationCacheStats& GetStats() const
+    {
+        return _stats;
+    }
+
+    void OnMemoryWrite(size_t address, size_t size) override;
+
+   protected:
+    std::unique_ptr<BasicBlock> _Translate(uint16_t address);
+    void _Fuse(BasicBlock& block);
+    void _InvalidateRange(size_t address, size_t size);
+    void _Retire(std::unordered_map<uint16_t, std::unique_ptr<BasicBlock>>::iterator block);
+
+    Memory16& _programMemory;
+    std::unordered_map<uint16_t, std::unique_ptr<BasicBlock>> _blocks;
+    // Number of cached blocks touching each page, lets most writes bail out after a single load
+    std::array<uint16_t, 0x10000 / PageSize + 1> _pageBlockCount{};
+    // Invalidated blocks are kept alive until the next Lookup() in case one of them is running
+    std::vector<std::unique_ptr<BasicBlock>> _retiredBlocks;
+    uint64_t _generation = 0;
+    bool _fusion = true;
+    std::set<uint16_t> _blockBoundaries;
+    TranslationCacheStats _stats;
+};
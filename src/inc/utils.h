@@ -1,6 +1,8 @@
 #pragma once
+#include <iomanip>
 #include <iostream>
 #include <sstream>
+#include <string_view>
 #include <vector>
 
 inline std::string HexEscapedString(const std::vector<uint8_t>& bytes)
@@ -15,4 +17,38 @@ inline std::string HexEscapedString(const std::vector<uint8_t>& bytes)
     }
 
     return out.str();
-}
\ No newline at end of file
+}
+
+// Quotes and escapes text for use as a JSON string
+inline std::string JsonString(std::string_view text)
+{
+    std::ostringstream out;
+    out << '"';
+    for (char c : text)
+    {
+        switch (c)
+        {
+            case '"':
+                out << "\\\"";
+                break;
+            case '\\':
+                out << "\\\\";
+                break;
+            case '\n':
+                out << "\\n";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    out << "\\u" << std::hex << std::setfill('0') << std::setw(4)
+                        << static_cast<unsigned>(c) << std::dec;
+                }
+                else
+                {
+                    out << c;
+                }
+        }
+    }
+    out << '"';
+    return out.str();
+}
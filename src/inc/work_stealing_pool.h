@@ -0,0 +1,67 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "common.h"
+
+// A fixed set of worker threads, each with its own task deque. Workers take from the back of
+// their own deque and steal from the front of the others' once it runs dry, so a batch of uneven
+// tasks keeps every thread busy without everyone contending on one shared queue.
+class WorkStealingPool
+{
+   public:
+    // A threads of 0 means one per hardware thread. When cpus is not empty, worker i gets pinned
+    // to cpus[i % cpus.size()]; throws if the host refuses.
+    explicit WorkStealingPool(size_t threads, std::vector<int> cpus = {});
+    ~WorkStealingPool();
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // Tasks are spread round-robin over the workers' deques
+    void Submit(std::function<void()> task);
+
+    // Blocks until every task submitted so far has run. Rethrows the first exception a task threw.
+    void Wait();
+
+    size_t Size() const
+    {
+        return _workers.size();
+    }
+
+    // Tasks that ran on another worker than the one they were queued on
+    uint64_t StolenCount() const
+    {
+        return _stolen.load();
+    }
+
+   protected:
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+        std::thread thread;
+    };
+
+    void _WorkerLoop(size_t index);
+    bool _TryTake(size_t index, std::function<void()>& task);
+    void _Stop();
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+    // Guards everything below but the atomics
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _idle;
+    // Sitting in a deque
+    size_t _queued = 0;
+    // Submitted and not finished yet
+    size_t _pending = 0;
+    size_t _nextWorker = 0;
+    bool _stopping = false;
+    std::exception_ptr _error;
+    std::atomic<uint64_t> _stolen{0};
+};
@@ -0,0 +1,77 @@
+#include "instruction_profile.h"
+
+InstructionProfile::InstructionProfile()
+    : _pairs(OpCodeCount * OpCodeCount, 0), _triples(OpCodeCount * OpCodeCount * OpCodeCount, 0)
+{
+}
+
+void InstructionProfile::Record(const std::vector<TranslatedInstruction>& instructions,
+                                size_t count)
+{
+    for (size_t i = 1; i < count; ++i)
+    {
+        const size_t previous = _Index(instructions[i - 1].decoded.opCodeId);
+        const size_t current = _Index(instructions[i].decoded.opCodeId);
+        ++_pairs[previous * OpCodeCount + current];
+        if (i >= 2)
+        {
+            const size_t first = _Index(instructions[i - 2].decoded.opCodeId);
+            ++_triples[(first * OpCodeCount + previous) * OpCodeCount + current];
+        }
+    }
+}
+
+std::vector<InstructionProfile::Sequence> InstructionProfile::Top(size_t length,
+                                                                  size_t limit) const
+{
+    if (length != 2 && length != 3)
+    {
+        throw std::invalid_argument("Only pairs and triples are profiled");
+    }
+    const auto& counts = (length == 2) ? _pairs : _triples;
+
+    std::vector<Sequence> sequences;
+    for (size_t index = 0; index < counts.size(); ++index)
+    {
+        if (counts[index] == 0)
+        {
+            continue;
+        }
+        Sequence sequence{std::vector<OpCodeId>(length), counts[index]};
+        size_t remainder = index;
+        for (size_t i = length; i-- > 0;)
+        {
+            sequence.opCodes[i] = static_cast<OpCodeId>(remainder % OpCodeCount);
+            remainder /= OpCodeCount;
+        }
+        sequences.push_back(std::move(sequence));
+    }
+
+    std::stable_sort(sequences.begin(), sequences.end(), [](const auto& a, const auto& b) {
+        return a.count > b.count;
+    });
+    if (sequences.size() > limit)
+    {
+        sequences.resize(limit);
+    }
+    return sequences;
+}
+
+std::string InstructionProfile::Report(size_t limit) const
+{
+    std::ostringstream out;
+    for (size_t length : {2, 3})
+    {
+        out << ((length == 2) ? "Pairs:\n" : "Triples:\n");
+        for (const auto& sequence : Top(length, limit))
+        {
+            out << std::setw(12) << sequence.count;
+            for (OpCodeId opCodeId : sequence.opCodes)
+            {
+                out << ' ' << opCodeMnemonicTable.at(opCodeId);
+            }
+            out << '\n';
+        }
+    }
+    return out.str();
+}
@@ -0,0 +1,414 @@
+#include "jit.h"
+
+#ifdef LUINUX_HAS_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace
+{
+// The x86 registers the generated code uses. All of them are caller saved in the SysV ABI, and
+// rdi holds the pointer to the guest registers for the whole function.
+enum HostRegister : uint8_t
+{
+    EAX = 0,
+    ECX = 1,
+    EDX = 2,
+    ESI = 6,
+};
+
+// Condition codes for SETcc and CMOVcc
+enum Condition : uint8_t
+{
+    Overflow = 0x0,
+    Carry = 0x2,
+    Zero = 0x4,
+    NotZero = 0x5,
+    Sign = 0x8,
+};
+
+// Guest flags the ALU writes, everything else in RFL is left alone
+constexpr uint8_t AluFlagsMask = static_cast<uint8_t>(FlagsRegister::Zero) |
+                                 static_cast<uint8_t>(FlagsRegister::Carry) |
+                                 static_cast<uint8_t>(FlagsRegister::Negative) |
+                                 static_cast<uint8_t>(FlagsRegister::Overflow) |
+                                 static_cast<uint8_t>(FlagsRegister::Exception);
+
+class X86Emitter
+{
+   public:
+    std::vector<uint8_t> code;
+
+    // Guest registers are host-order uint16_t, indexed by RegisterId, starting at rdi
+    void LoadGuest(HostRegister reg, RegisterId guest)
+    {
+        // movzx reg, word [rdi + disp8]
+        _Emit({0x0f, 0xb7, _ModRmRdiDisp8(reg), _GuestOffset(guest)});
+    }
+
+    void StoreGuest(RegisterId guest, HostRegister reg)
+    {
+        // mov word [rdi + disp8], reg16
+        _Emit({0x66, 0x89, _ModRmRdiDisp8(reg), _GuestOffset(guest)});
+    }
+
+    void MovImmediate(HostRegister reg, uint32_t value)
+    {
+        _Emit({static_cast<uint8_t>(0xb8 | reg)});
+        _Emit({static_cast<uint8_t>(value),
+               static_cast<uint8_t>(value >> 8),
+               static_cast<uint8_t>(value >> 16),
+               static_cast<uint8_t>(value >> 24)});
+    }
+
+    // Two operand 16 bit ALU op in its "op r/m16, r16" form, dst = dst op src
+    void Alu16(uint8_t opCode, HostRegister dst, HostRegister src)
+    {
+        _Emit({0x66, opCode, static_cast<uint8_t>(0xc0 | (src << 3) | dst)});
+    }
+
+    // Single operand 16 bit op selected by the ModRM reg field (NOT, MUL, SHL, INC...)
+    void Group16(uint8_t opCode, uint8_t extension, HostRegister reg)
+    {
+        _Emit({0x66, opCode, static_cast<uint8_t>(0xc0 | (extension << 3) | reg)});
+    }
+
+    void Test16(HostRegister reg)
+    {
+        Alu16(0x85, reg, reg);
+    }
+
+    void CMov(Condition condition, HostRegister dst, HostRegister src)
+    {
+        _Emit({0x0f, static_cast<uint8_t>(0x40 | condition),
+               static_cast<uint8_t>(0xc0 | (dst << 3) | src)});
+    }
+
+    // Guest flag bits are gathered in r8b (Zero), r9b (Carry), r10b (Negative), r11b (Overflow)
+    void SetFlag(Condition condition, uint8_t extendedRegister)
+    {
+        _Emit({0x41, 0x0f, static_cast<uint8_t>(0x90 | condition),
+               static_cast<uint8_t>(0xc0 | (extendedRegister - 8))});
+    }
+
+    void ClearOverflowFlag()
+    {
+        // xor r11d, r11d
+        _Emit({0x45, 0x31, 0xdb});
+    }
+
+    // Merges r8b..r11b into the guest's RFL, and clears its Exception flag like the ALU does
+    void WriteGuestFlags()
+    {
+        static_assert(static_cast<uint16_t>(FlagsRegister::Zero) == 1 << 0);
+        static_assert(static_cast<uint16_t>(FlagsRegister::Carry) == 1 << 1);
+        static_assert(static_cast<uint16_t>(FlagsRegister::Negative) == 1 << 2);
+        static_assert(static_cast<uint16_t>(FlagsRegister::Overflow) == 1 << 5);
+
+        // movzx r8d..r11d, r8b..r11b
+        _Emit({0x45, 0x0f, 0xb6, 0xc0});
+        _Emit({0x45, 0x0f, 0xb6, 0xc9});
+        _Emit({0x45, 0x0f, 0xb6, 0xd2});
+        _Emit({0x45, 0x0f, 0xb6, 0xdb});
+        // shl r9d, 1; shl r10d, 2; shl r11d, 5
+        _Emit({0x41, 0xd1, 0xe1});
+        _Emit({0x41, 0xc1, 0xe2, 0x02});
+        _Emit({0x41, 0xc1, 0xe3, 0x05});
+        // or r8d, r9d; or r8d, r10d; or r8d, r11d
+        _Emit({0x45, 0x09, 0xc8});
+        _Emit({0x45, 0x09, 0xd0});
+        _Emit({0x45, 0x09, 0xd8});
+
+        // All the ALU flags live in the low byte of RFL, which comes first on x86
+        const uint8_t flagsByte = _GuestOffset(RegisterId::RFL);
+        // and byte [rdi + disp8], ~mask; or byte [rdi + disp8], r8b
+        _Emit({0x80, 0x67, flagsByte, static_cast<uint8_t>(~AluFlagsMask)});
+        _Emit({0x44, 0x08, 0x47, flagsByte});
+    }
+
+    void Ret()
+    {
+        _Emit({0xc3});
+    }
+
+   protected:
+    void _Emit(std::initializer_list<uint8_t> bytes)
+    {
+        code.insert(code.end(), bytes);
+    }
+
+    static uint8_t _GuestOffset(RegisterId guest)
+    {
+        return static_cast<uint8_t>(guest) * 2;
+    }
+
+    static uint8_t _ModRmRdiDisp8(HostRegister reg)
+    {
+        return static_cast<uint8_t>(0x40 | (reg << 3) | 0x7);
+    }
+};
+
+bool CanCompile(const TranslatedInstruction& instruction)
+{
+    const DecodedInstruction& decoded = instruction.decoded;
+    switch (decoded.opCodeId)
+    {
+        case OpCodeId::ADD:
+        case OpCodeId::SUB:
+        case OpCodeId::MUL:
+        case OpCodeId::SMUL:
+        case OpCodeId::AND:
+        case OpCodeId::OR:
+        case OpCodeId::XOR:
+        case OpCodeId::MOV:
+        case OpCodeId::SET:
+        case OpCodeId::SETZ:
+        case OpCodeId::SETO:
+        case OpCodeId::NOT:
+        case OpCodeId::SHFR:
+        case OpCodeId::SHFL:
+        case OpCodeId::INC:
+        case OpCodeId::DEC:
+        case OpCodeId::NOP:
+        case OpCodeId::JZ:
+        case OpCodeId::JNZ:
+        case OpCodeId::JE:
+        case OpCodeId::JNE:
+        case OpCodeId::JMP:
+            break;
+        default:
+            return false;
+    }
+
+    // The generated code doesn't keep RIP up to date between instructions, and it writes RFL
+    // through the flags path only
+    for (int i = 0; i < decoded.argCount; ++i)
+    {
+        if (decoded.args[i] == RegisterId::RIP)
+        {
+            return false;
+        }
+    }
+    auto dest = DestinationRegister(decoded);
+    return !(dest && *dest == RegisterId::RFL);
+}
+
+// Returns true when the instruction set RIP itself
+bool EmitInstruction(X86Emitter& emitter, const TranslatedInstruction& instruction)
+{
+    const DecodedInstruction& decoded = instruction.decoded;
+    const auto& args = decoded.args;
+
+    switch (decoded.opCodeId)
+    {
+        case OpCodeId::ADD:
+        case OpCodeId::SUB:
+            emitter.LoadGuest(EAX, args[0]);
+            emitter.LoadGuest(ECX, args[1]);
+            emitter.Alu16(decoded.opCodeId == OpCodeId::ADD ? 0x01 : 0x29, EAX, ECX);
+            // x86 computes the same 16 bit Zero/Carry(borrow)/Sign/Overflow as _Base_ADD/_Base_SUB
+            emitter.SetFlag(Zero, 8);
+            emitter.SetFlag(Carry, 9);
+            emitter.SetFlag(Sign, 10);
+            emitter.SetFlag(Overflow, 11);
+            emitter.StoreGuest(args[2], EAX);
+            emitter.WriteGuestFlags();
+            return false;
+        case OpCodeId::MUL:
+        case OpCodeId::SMUL:
+            emitter.LoadGuest(EAX, args[0]);
+            emitter.LoadGuest(ECX, args[1]);
+            // mul cx / imul cx. Carry is set when the product doesn't fit in 16 bits (unsigned or
+            // signed), which is what _Base_MUL and _Base_SMUL use as Carry
+            emitter.Group16(0xf7, decoded.opCodeId == OpCodeId::MUL ? 4 : 5, ECX);
+            emitter.SetFlag(Carry, 9);
+            if (decoded.opCodeId == OpCodeId::MUL)
+            {
+                emitter.ClearOverflowFlag();
+            }
+            else
+            {
+                emitter.SetFlag(Overflow, 11);
+            }
+            emitter.Test16(EAX);
+            emitter.SetFlag(Zero, 8);
+            emitter.SetFlag(Sign, 10);
+            emitter.StoreGuest(args[2], EAX);
+            emitter.WriteGuestFlags();
+            return false;
+        case OpCodeId::AND:
+        case OpCodeId::OR:
+        case OpCodeId::XOR:
+        {
+            const uint8_t opCode = (decoded.opCodeId == OpCodeId::AND)  ? 0x21
+                                   : (decoded.opCodeId == OpCodeId::OR) ? 0x09
+                                                                        : 0x31;
+            emitter.LoadGuest(EAX, args[0]);
+            emitter.LoadGuest(ECX, args[1]);
+            emitter.Alu16(opCode, EAX, ECX);
+            emitter.StoreGuest(args[2], EAX);
+            return false;
+        }
+        case OpCodeId::MOV:
+            emitter.LoadGuest(EAX, args[0]);
+            emitter.StoreGuest(args[1], EAX);
+            return false;
+        case OpCodeId::SET:
+        case OpCodeId::SETZ:
+        case OpCodeId::SETO:
+        {
+            const uint16_t value = (decoded.opCodeId == OpCodeId::SET)    ? instruction.literal
+                                   : (decoded.opCodeId == OpCodeId::SETZ) ? 0x0
+                                                                          : 0xffff;
+            emitter.MovImmediate(EAX, value);
+            emitter.StoreGuest(args[0], EAX);
+            return false;
+        }
+        case OpCodeId::NOT:
+        case OpCodeId::SHFR:
+        case OpCodeId::SHFL:
+        case OpCodeId::INC:
+        case OpCodeId::DEC:
+            emitter.LoadGuest(EAX, args[0]);
+            switch (decoded.opCodeId)
+            {
+                case OpCodeId::NOT:
+                    emitter.Group16(0xf7, 2, EAX);
+                    break;
+                case OpCodeId::SHFR:
+                    emitter.Group16(0xd1, 5, EAX);
+                    break;
+                case OpCodeId::SHFL:
+                    emitter.Group16(0xd1, 4, EAX);
+                    break;
+                case OpCodeId::INC:
+                    emitter.Group16(0xff, 0, EAX);
+                    break;
+                default:
+                    emitter.Group16(0xff, 1, EAX);
+                    break;
+            }
+            emitter.StoreGuest(args[0], EAX);
+            return false;
+        case OpCodeId::NOP:
+            return false;
+        case OpCodeId::JZ:
+        case OpCodeId::JNZ:
+            emitter.LoadGuest(EAX, args[0]);
+            emitter.LoadGuest(ECX, args[1]);
+            emitter.MovImmediate(EDX, instruction.nextAddress);
+            emitter.Test16(EAX);
+            emitter.CMov(decoded.opCodeId == OpCodeId::JZ ? Zero : NotZero, EDX, ECX);
+            emitter.StoreGuest(RegisterId::RIP, EDX);
+            return true;
+        case OpCodeId::JE:
+        case OpCodeId::JNE:
+            emitter.LoadGuest(EAX, args[0]);
+            emitter.LoadGuest(ECX, args[1]);
+            emitter.LoadGuest(ESI, RegisterId::RAC);
+            emitter.MovImmediate(EDX, instruction.nextAddress);
+            // cmp ax, si
+            emitter.Alu16(0x39, EAX, ESI);
+            emitter.CMov(decoded.opCodeId == OpCodeId::JE ? Zero : NotZero, EDX, ECX);
+            emitter.StoreGuest(RegisterId::RIP, EDX);
+            return true;
+        case OpCodeId::JMP:
+            emitter.MovImmediate(EDX, instruction.literal);
+            emitter.StoreGuest(RegisterId::RIP, EDX);
+            return true;
+        default:
+            throw std::logic_error(
+                "The JIT was asked to compile an instruction it doesn't support");
+    }
+}
+}  // namespace
+#endif
+
+JitCompiler::JitCompiler() {}
+
+JitCompiler::~JitCompiler()
+{
+#ifdef LUINUX_HAS_JIT
+    if (_arena != nullptr)
+    {
+        munmap(_arena, ArenaSize);
+    }
+#endif
+}
+
+bool JitCompiler::IsAvailable()
+{
+#ifdef LUINUX_HAS_JIT
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool JitCompiler::Compile(BasicBlock& block)
+{
+#ifdef LUINUX_HAS_JIT
+    X86Emitter emitter;
+    size_t count = 0;
+    bool wroteRip = false;
+    while (count < block.instructions.size() && CanCompile(block.instructions[count]))
+    {
+        wroteRip = EmitInstruction(emitter, block.instructions[count++]);
+    }
+    if (count == 0)
+    {
+        return true;
+    }
+    if (!wroteRip)
+    {
+        emitter.MovImmediate(EDX, block.instructions[count - 1].nextAddress);
+        emitter.StoreGuest(RegisterId::RIP, EDX);
+    }
+    emitter.Ret();
+
+    if (_arena == nullptr)
+    {
+        void* arena =
+            mmap(nullptr, ArenaSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (arena == MAP_FAILED)
+        {
+            throw std::runtime_error("Could not map memory for the JIT");
+        }
+        _arena = static_cast<uint8_t*>(arena);
+    }
+    if (_arenaUsed + emitter.code.size() > ArenaSize)
+    {
+        return false;
+    }
+
+    // Never writable and executable at once, the pages the code lands on are writable only while
+    // it's copied in
+    uint8_t* function = _arena + _arenaUsed;
+    _Protect(_arenaUsed, emitter.code.size(), PROT_READ | PROT_WRITE);
+    std::memcpy(function, emitter.code.data(), emitter.code.size());
+    _Protect(_arenaUsed, emitter.code.size(), PROT_READ | PROT_EXEC);
+    _arenaUsed += emitter.code.size();
+
+    block.jitCode = reinterpret_cast<JitFunction>(function);
+    block.jitInstructionCount = static_cast<uint8_t>(count);
+    ++_stats.compiledBlocks;
+#endif
+    return true;
+}
+
+void JitCompiler::_Protect(size_t offset, size_t size, int protection)
+{
+#ifdef LUINUX_HAS_JIT
+    static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t begin = offset / pageSize * pageSize;
+    const size_t end = (offset + size + pageSize - 1) / pageSize * pageSize;
+    if (mprotect(_arena + begin, end - begin, protection) != 0)
+    {
+        throw std::runtime_error("Could not change the protection of the JIT's code");
+    }
+#endif
+}
+
+void JitCompiler::Reset()
+{
+    _arenaUsed = 0;
+}
@@ -0,0 +1,88 @@
+// Built with -mavx2, only ever called after checking the host supports it
+#include <immintrin.h>
+
+#include "lockstep_kernels.h"
+
+namespace
+{
+struct Avx2Vector
+{
+    using Type = __m256i;
+    static constexpr size_t Width = 16;
+
+    static Type Load(const uint16_t* p)
+    {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    }
+    static void Store(uint16_t* p, Type v)
+    {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v);
+    }
+    static Type Set1(uint16_t v)
+    {
+        return _mm256_set1_epi16(static_cast<short>(v));
+    }
+    static Type Add(Type a, Type b)
+    {
+        return _mm256_add_epi16(a, b);
+    }
+    static Type Sub(Type a, Type b)
+    {
+        return _mm256_sub_epi16(a, b);
+    }
+    static Type AddsU(Type a, Type b)
+    {
+        return _mm256_adds_epu16(a, b);
+    }
+    static Type SubsU(Type a, Type b)
+    {
+        return _mm256_subs_epu16(a, b);
+    }
+    static Type And(Type a, Type b)
+    {
+        return _mm256_and_si256(a, b);
+    }
+    static Type AndNot(Type a, Type b)
+    {
+        return _mm256_andnot_si256(a, b);
+    }
+    static Type Or(Type a, Type b)
+    {
+        return _mm256_or_si256(a, b);
+    }
+    static Type Xor(Type a, Type b)
+    {
+        return _mm256_xor_si256(a, b);
+    }
+    static Type CmpEq(Type a, Type b)
+    {
+        return _mm256_cmpeq_epi16(a, b);
+    }
+    static Type Sra15(Type a)
+    {
+        return _mm256_srai_epi16(a, 15);
+    }
+    static Type Shl1(Type a)
+    {
+        return _mm256_slli_epi16(a, 1);
+    }
+    static Type Shr1(Type a)
+    {
+        return _mm256_srli_epi16(a, 1);
+    }
+    static Type Blend(Type old, Type updated, Type mask)
+    {
+        return _mm256_blendv_epi8(old, updated, mask);
+    }
+};
+}  // namespace
+
+void LockstepAluAvx2(const LockstepKernelArgs& args)
+{
+    LockstepAlu<Avx2Vector>(args);
+}
+
+void LockstepBranchAvx2(const LockstepKernelArgs& args)
+{
+    LockstepBranch<Avx2Vector>(args);
+}
@@ -0,0 +1,393 @@
+#include "lockstep_engine.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "lockstep_kernels.h"
+
+namespace
+{
+#ifdef __SSE2__
+struct Sse2Vector
+{
+    using Type = __m128i;
+    static constexpr size_t Width = 8;
+
+    static Type Load(const uint16_t* p)
+    {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    }
+    static void Store(uint16_t* p, Type v)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v);
+    }
+    static Type Set1(uint16_t v)
+    {
+        return _mm_set1_epi16(static_cast<short>(v));
+    }
+    static Type Add(Type a, Type b)
+    {
+        return _mm_add_epi16(a, b);
+    }
+    static Type Sub(Type a, Type b)
+    {
+        return _mm_sub_epi16(a, b);
+    }
+    static Type AddsU(Type a, Type b)
+    {
+        return _mm_adds_epu16(a, b);
+    }
+    static Type SubsU(Type a, Type b)
+    {
+        return _mm_subs_epu16(a, b);
+    }
+    static Type And(Type a, Type b)
+    {
+        return _mm_and_si128(a, b);
+    }
+    static Type AndNot(Type a, Type b)
+    {
+        return _mm_andnot_si128(a, b);
+    }
+    static Type Or(Type a, Type b)
+    {
+        return _mm_or_si128(a, b);
+    }
+    static Type Xor(Type a, Type b)
+    {
+        return _mm_xor_si128(a, b);
+    }
+    static Type CmpEq(Type a, Type b)
+    {
+        return _mm_cmpeq_epi16(a, b);
+    }
+    static Type Sra15(Type a)
+    {
+        return _mm_srai_epi16(a, 15);
+    }
+    static Type Shl1(Type a)
+    {
+        return _mm_slli_epi16(a, 1);
+    }
+    static Type Shr1(Type a)
+    {
+        return _mm_srli_epi16(a, 1);
+    }
+    static Type Blend(Type old, Type updated, Type mask)
+    {
+        // No blendv before SSE4.1
+        return _mm_or_si128(_mm_and_si128(mask, updated), _mm_andnot_si128(mask, old));
+    }
+};
+using BaselineVector = Sse2Vector;
+constexpr const char* BaselineName = "sse2";
+#else
+using BaselineVector = ScalarVector;
+constexpr const char* BaselineName = "scalar";
+#endif
+
+struct LockstepKernels
+{
+    void (*alu)(const LockstepKernelArgs& args);
+    void (*branch)(const LockstepKernelArgs& args);
+    const char* name;
+};
+
+void LockstepAluBaseline(const LockstepKernelArgs& args)
+{
+    LockstepAlu<BaselineVector>(args);
+}
+
+void LockstepBranchBaseline(const LockstepKernelArgs& args)
+{
+    LockstepBranch<BaselineVector>(args);
+}
+
+const LockstepKernels& Kernels()
+{
+    static const LockstepKernels kernels = []() -> LockstepKernels {
+#ifdef LUINUX_LOCKSTEP_AVX2
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return {LockstepAluAvx2, LockstepBranchAvx2, "avx2"};
+        }
+#endif
+        return {LockstepAluBaseline, LockstepBranchBaseline, BaselineName};
+    }();
+    return kernels;
+}
+
+// Widest vector any kernel uses, in lanes
+constexpr size_t LaneGroup = 16;
+
+// RIP and RFL operands would need per instruction RIP updates and flag evaluation, those lanes
+// are better off in a Processor
+bool UsesControlRegisters(const DecodedInstruction& decoded)
+{
+    for (size_t i = 0; i < decoded.argCount; ++i)
+    {
+        if (decoded.args[i] == RegisterId::RIP || decoded.args[i] == RegisterId::RFL)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool IsVectorizable(const DecodedInstruction& decoded)
+{
+    if (UsesControlRegisters(decoded))
+    {
+        return false;
+    }
+    return IsLockstepAluOp(decoded.opCodeId) || IsConditionalJump(decoded.opCodeId) ||
+           decoded.opCodeId == OpCodeId::JMP || decoded.opCodeId == OpCodeId::NOP ||
+           decoded.opCodeId == OpCodeId::STOP;
+}
+}  // namespace
+
+LockstepEngine::LockstepEngine(const std::vector<uint8_t>& program, size_t lanes)
+    : _programMemory(MainMemorySize),
+      _translationCache(_programMemory),
+      _stride((lanes + LaneGroup - 1) / LaneGroup * LaneGroup),
+      _registers(_stride * static_cast<size_t>(RegisterId::END_OF_REGLIST)),
+      _mask(_stride),
+      _lanes(lanes)
+{
+    if (lanes == 0)
+    {
+        throw std::invalid_argument("LockstepEngine needs at least one lane");
+    }
+    _programMemory.WritePayload(0, program);
+    // Groups are run one member at a time anyway
+    _translationCache.SetFusion(false);
+    std::fill_n(_Row(RegisterId::RSP), _stride, RSP_DefaultAddress);
+}
+
+void LockstepEngine::WriteRegister(size_t lane, RegisterId reg, uint16_t value)
+{
+    const Lane& state = _lanes.at(lane);
+    if (state.scalar)
+    {
+        state.scalar->WriteRegister(reg, value);
+        return;
+    }
+    _registers.at(static_cast<size_t>(reg) * _stride + lane) = value;
+}
+
+uint16_t LockstepEngine::ReadRegister(size_t lane, RegisterId reg) const
+{
+    const Lane& state = _lanes.at(lane);
+    if (state.scalar)
+    {
+        return state.scalar->ReadRegister(reg);
+    }
+    return _registers.at(static_cast<size_t>(reg) * _stride + lane);
+}
+
+StopReason LockstepEngine::GetStopReason(size_t lane) const
+{
+    return _lanes.at(lane).reason;
+}
+
+uint64_t LockstepEngine::GetInstructionCount(size_t lane) const
+{
+    return _lanes.at(lane).instructions;
+}
+
+bool LockstepEngine::IsScalar(size_t lane) const
+{
+    return _lanes.at(lane).scalar != nullptr;
+}
+
+const char* LockstepEngine::KernelName()
+{
+    return Kernels().name;
+}
+
+void LockstepEngine::Run(uint64_t maxInstructions)
+{
+    uint16_t address = 0;
+    while (_SelectBlock(address, maxInstructions))
+    {
+        const BasicBlock& block = *_translationCache.Lookup(address);
+        const size_t size = block.instructions.size();
+        bool any = false;
+        for (size_t lane = 0; lane < _lanes.size(); ++lane)
+        {
+            if (!_mask[lane])
+            {
+                continue;
+            }
+            // Lanes without the budget for the whole block finish it one instruction at a time
+            if (size == 0 || _lanes[lane].instructions + size > maxInstructions)
+            {
+                _mask[lane] = 0;
+                _Evict(lane, maxInstructions);
+                continue;
+            }
+            any = true;
+        }
+        if (any)
+        {
+            _ExecuteBlock(block, maxInstructions);
+        }
+    }
+}
+
+bool LockstepEngine::_SelectBlock(uint16_t& address, uint64_t maxInstructions)
+{
+    const uint16_t* rip = _Row(RegisterId::RIP);
+    bool anyRunning = false;
+    uint16_t lowest = 0xffff;
+    for (size_t lane = 0; lane < _lanes.size(); ++lane)
+    {
+        if (_lanes[lane].running && rip[lane] <= lowest)
+        {
+            lowest = rip[lane];
+            anyRunning = true;
+        }
+    }
+    if (!anyRunning)
+    {
+        return false;
+    }
+
+    for (size_t lane = 0; lane < _lanes.size(); ++lane)
+    {
+        Lane& state = _lanes[lane];
+        const bool selected = state.running && rip[lane] == lowest;
+        _mask[lane] = selected ? 0xffff : 0;
+        if (selected)
+        {
+            state.maskedBlocks = 0;
+        }
+        else if (state.running && ++state.maskedBlocks > MaxMaskedBlocks)
+        {
+            // Too far off the common path to ever catch up
+            _Evict(lane, maxInstructions);
+        }
+    }
+    address = lowest;
+    return true;
+}
+
+void LockstepEngine::_ExecuteBlock(const BasicBlock& block, uint64_t maxInstructions)
+{
+    const LockstepKernels& kernels = Kernels();
+    LockstepKernelArgs args{};
+    args.mask = _mask.data();
+    args.lanes = _stride;
+
+    size_t executed = 0;
+    for (const TranslatedInstruction& instruction : block.instructions)
+    {
+        const DecodedInstruction& decoded = instruction.decoded;
+        if (!IsVectorizable(decoded))
+        {
+            break;
+        }
+        ++executed;
+
+        args.opCodeId = decoded.opCodeId;
+        if (IsLockstepAluOp(decoded.opCodeId))
+        {
+            args.a = _Row(decoded.args[0]);
+            args.b = (decoded.argCount > 1) ? _Row(decoded.args[1]) : nullptr;
+            args.dest = _Row(DestinationRegister(decoded).value());
+            args.flags = _Row(RegisterId::RFL);
+            args.literal = instruction.literal;
+            kernels.alu(args);
+            continue;
+        }
+
+        // Anything else ends the block, so RIP moves past it before jumping
+        uint16_t* rip = _Row(RegisterId::RIP);
+        for (size_t lane = 0; lane < _lanes.size(); ++lane)
+        {
+            if (_mask[lane])
+            {
+                rip[lane] = instruction.nextAddress;
+                _lanes[lane].instructions += executed;
+            }
+        }
+        if (IsConditionalJump(decoded.opCodeId))
+        {
+            args.a = _Row(decoded.args[0]);
+            args.b = _Row(decoded.args[1]);
+            args.dest = rip;
+            args.flags = _Row(RegisterId::RAC);
+            kernels.branch(args);
+        }
+        else if (decoded.opCodeId == OpCodeId::JMP)
+        {
+            for (size_t lane = 0; lane < _lanes.size(); ++lane)
+            {
+                rip[lane] = _mask[lane] ? instruction.literal : rip[lane];
+            }
+        }
+        else if (decoded.opCodeId == OpCodeId::STOP)
+        {
+            for (size_t lane = 0; lane < _lanes.size(); ++lane)
+            {
+                if (_mask[lane])
+                {
+                    _lanes[lane].running = false;
+                    _lanes[lane].reason = StopReason::Halted;
+                }
+            }
+        }
+        _CountBlock(executed);
+        return;
+    }
+
+    // Either the block ran into something only a Processor can do, or it ended without a jump
+    // (block size limit) and simply carries on in the next one
+    const uint16_t next =
+        executed > 0 ? block.instructions[executed - 1].nextAddress : block.startAddress;
+    uint16_t* rip = _Row(RegisterId::RIP);
+    for (size_t lane = 0; lane < _lanes.size(); ++lane)
+    {
+        if (_mask[lane])
+        {
+            rip[lane] = next;
+            _lanes[lane].instructions += executed;
+            if (executed < block.instructions.size())
+            {
+                _Evict(lane, maxInstructions);
+            }
+        }
+    }
+    _CountBlock(executed);
+}
+
+void LockstepEngine::_CountBlock(size_t executed)
+{
+    size_t active = 0;
+    size_t running = 0;
+    for (size_t lane = 0; lane < _lanes.size(); ++lane)
+    {
+        active += _mask[lane] ? 1 : 0;
+        running += _lanes[lane].running ? 1 : 0;
+    }
+    ++_stats.vectorBlocks;
+    _stats.laneInstructions += active * executed;
+    _stats.maskedLaneBlocks += running - std::min(running, active);
+}
+
+void LockstepEngine::_Evict(size_t lane, uint64_t maxInstructions)
+{
+    Lane& state = _lanes[lane];
+    state.scalar = std::make_unique<Processor>(_programMemory);
+    for (size_t reg = 0; reg < static_cast<size_t>(RegisterId::END_OF_REGLIST); ++reg)
+    {
+        state.scalar->WriteRegister(static_cast<RegisterId>(reg), _registers[reg * _stride + lane]);
+    }
+    state.running = false;
+    ++_stats.scalarLanes;
+
+    const uint64_t left = maxInstructions - std::min(maxInstructions, state.instructions);
+    state.reason = state.scalar->Run(left);
+    state.instructions += state.scalar->GetInstructionCount();
+}
@@ -13,6 +13,9 @@ int main(int argc, char* argv[])
         Assembler asmObj(std::string{argv[1]}, std::string{argv[2]});
         auto binProgram = asmObj.AssembleFile();
         asmObj.WriteBinaryFile(binProgram, (argc == 4));
+        // For profiling, see SamplingProfiler
+        std::ofstream lines(DebugLineTable::PathFor(argv[2]), std::ios::trunc);
+        asmObj.GetLineTable().Write(lines);
     }
     catch (const std::exception& e)
     {
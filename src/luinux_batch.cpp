@@ -0,0 +1,99 @@
+#include <thread>
+
+#include "batch_runner.h"
+
+namespace
+{
+void PrintUsage()
+{
+    std::cerr << "Usage: luinuxbatch <manifest> [--threads N] [--pin] [--cpus 0,2,4,...] [--jit]"
+                 " [--report <file>]\n"
+                 "  Each manifest line is: <program_binary_file> [<nvram_file>|- [<budget>]]\n"
+                 "  --pin pins worker i to CPU i, --cpus picks the CPUs to pin to.\n"
+                 "  The JSON report goes to stdout unless --report is given."
+              << std::endl;
+}
+
+std::vector<int> ParseCpuList(const std::string& list)
+{
+    std::vector<int> cpus;
+    std::stringstream stream(list);
+    std::string cpu;
+    while (std::getline(stream, cpu, ','))
+    {
+        cpus.push_back(std::stoi(cpu));
+    }
+    return cpus;
+}
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        PrintUsage();
+        return -1;
+    }
+    try
+    {
+        BatchOptions options;
+        bool pin = false;
+        std::string reportFile;
+        for (int i = 2; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            const bool hasValue = (i + 1 < argc);
+            if (arg == "--threads" && hasValue)
+            {
+                options.threads = std::stoul(argv[++i]);
+            }
+            else if (arg == "--cpus" && hasValue)
+            {
+                options.cpus = ParseCpuList(argv[++i]);
+            }
+            else if (arg == "--pin")
+            {
+                pin = true;
+            }
+            else if (arg == "--jit")
+            {
+                options.engine = ExecutionEngine::Jit;
+            }
+            else if (arg == "--report" && hasValue)
+            {
+                reportFile = argv[++i];
+            }
+            else
+            {
+                PrintUsage();
+                return -1;
+            }
+        }
+        if (pin && options.cpus.empty())
+        {
+            const size_t cpuCount = std::max(1u, std::thread::hardware_concurrency());
+            for (size_t cpu = 0; cpu < cpuCount; ++cpu)
+            {
+                options.cpus.push_back(static_cast<int>(cpu));
+            }
+        }
+
+        BatchRunner runner(options);
+        const BatchReport report = runner.Run(BatchRunner::LoadManifest(argv[1]));
+        if (reportFile.empty())
+        {
+            std::cout << report.ToJson();
+        }
+        else
+        {
+            std::ofstream(reportFile) << report.ToJson();
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return -1;
+    }
+
+    return 0;
+}
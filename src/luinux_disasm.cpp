@@ -0,0 +1,23 @@
+#include "disassembler.h"
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2)
+    {
+        std::cerr << "Usage: luinuxdisasm <program_binary_file>" << std::endl;
+        return -1;
+    }
+
+    std::ifstream inFile(argv[1], std::ios::binary);
+    if (!inFile)
+    {
+        std::cerr << "File does not exist, or cannot be opened." << std::endl;
+        return -1;
+    }
+    std::vector<uint8_t> program((std::istreambuf_iterator<char>(inFile)),
+                                 std::istreambuf_iterator<char>());
+
+    Disassembler disasm;
+    std::cout << disasm.Disassemble(program);
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include "disassembler.h"
+#include "trace_format.h"
+
+namespace
+{
+std::string Hex(uint16_t value)
+{
+    std::ostringstream out;
+    out << "h'" << std::hex << std::setfill('0') << std::setw(4) << value;
+    return out.str();
+}
+
+std::string Instruction(const TraceRecord& record)
+{
+    return decodeTable[record.instruction].IsValid()
+               ? Disassembler::InstructionToString(record.instruction, record.literal)
+               : "; " + Hex(record.instruction);
+}
+
+void PrintText(TraceDecoder& decoder)
+{
+    TraceRecord record;
+    for (uint64_t index = 0; decoder.Next(record); ++index)
+    {
+        std::cout << '#' << index << ' ' << Hex(record.rip) << ' ' << Instruction(record);
+        for (const auto& [reg, value] : record.registers)
+        {
+            std::cout << ' ' << registerNameTable[static_cast<size_t>(reg)] << '=' << Hex(value);
+        }
+        for (const auto& [address, value] : record.memory)
+        {
+            std::cout << " [" << Hex(address) << "]=" << Hex(value);
+        }
+        std::cout << '\n';
+    }
+}
+
+// Chrome's trace event format, which Perfetto reads too. Every instruction is a microsecond long.
+void PrintJson(TraceDecoder& decoder)
+{
+    std::cout << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+    TraceRecord record;
+    for (uint64_t index = 0; decoder.Next(record); ++index)
+    {
+        std::cout << (index == 0 ? "\n" : ",\n") << "{\"name\": \"" << Instruction(record)
+                  << "\", \"cat\": \"instruction\", \"ph\": \"X\", \"ts\": " << index
+                  << ", \"dur\": 1, \"pid\": 1, \"tid\": 1, \"args\": {\"rip\": \""
+                  << Hex(record.rip) << '"';
+        for (const auto& [reg, value] : record.registers)
+        {
+            std::cout << ", \"" << registerNameTable[static_cast<size_t>(reg)] << "\": \""
+                      << Hex(value) << '"';
+        }
+        for (const auto& [address, value] : record.memory)
+        {
+            std::cout << ", \"[" << Hex(address) << "]\": \"" << Hex(value) << '"';
+        }
+        std::cout << "}}";
+    }
+    std::cout << "\n]}\n";
+}
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    const bool json = argc == 3 && std::string(argv[2]) == "--json";
+    if (argc != 2 && !json)
+    {
+        std::cerr << "Usage: luinuxtrace <trace_file> [--json]" << std::endl;
+        std::cerr << "  --json  Chrome trace event JSON, for chrome://tracing or Perfetto"
+                  << std::endl;
+        return -1;
+    }
+
+    std::ifstream inFile(argv[1], std::ios::binary);
+    if (!inFile)
+    {
+        std::cerr << "File does not exist, or cannot be opened." << std::endl;
+        return -1;
+    }
+    try
+    {
+        TraceDecoder decoder(inFile);
+        if (json)
+        {
+            PrintJson(decoder);
+        }
+        else
+        {
+            PrintText(decoder);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return -1;
+    }
+    return 0;
+}
@@ -1,21 +1,122 @@
+#include "counter_device.h"
 #include "processor.h"
+#include "sampling_profiler.h"
 
 using NVMem = NVMemory<uint16_t>;
 
 int main(int argc, char* argv[])
 {
-    if (argc != 3)
+    bool profile = false;
+    bool console = false;
+    bool counters = false;
+    bool countersJson = false;
+    uint64_t samplePeriod = 0;
+    std::string traceFile;
+    bool usage = argc < 3;
+    for (int i = 3; i < argc; ++i)
     {
-        std::cerr << "Usage: luinuxcpu <program_binary_file> <nvram_file> " << std::endl;
+        const std::string option(argv[i]);
+        if (option.rfind("--sample=", 0) == 0)
+        {
+            samplePeriod = std::strtoull(option.c_str() + 9, nullptr, 10);
+            usage |= (samplePeriod == 0);
+            continue;
+        }
+        if (option.rfind("--trace=", 0) == 0)
+        {
+            traceFile = option.substr(8);
+            usage |= traceFile.empty();
+            continue;
+        }
+        profile |= (option == "--profile");
+        console |= (option == "--console");
+        counters |= (option == "--counters");
+        countersJson |= (option == "--counters-json");
+        usage |= (option != "--profile" && option != "--console" && option != "--counters" &&
+                  option != "--counters-json");
+    }
+    if (usage)
+    {
+        std::cerr << "Usage: luinuxcpu <program_binary_file> <nvram_file> [--profile] [--console] "
+                     "[--counters | --counters-json] [--sample=N] [--trace=FILE]"
+                  << std::endl;
+        std::cerr << "  --console        maps a console at h'fc00, prints the low byte of words "
+                     "stored there"
+                  << std::endl;
+        std::cerr << "  --counters       maps the cycle and instret counters at h'fa00, prints "
+                     "the PMU counters at exit"
+                  << std::endl;
+        std::cerr << "  --counters-json  same, printed as JSON" << std::endl;
+        std::cerr << "  --sample=N       samples RIP every N instructions, prints the hot lines "
+                     "and tags and writes <program>.folded"
+                  << std::endl;
+        std::cerr << "  --trace=FILE     writes a binary trace of every instruction, see "
+                     "luinuxtrace"
+                  << std::endl;
         return -1;
     }
     try
     {
         NVMem programMemory(0x10000, std::string(argv[1]));
-        std::shared_ptr<NVMem> nvram = std::make_shared<NVMem>(0x10000, std::string(argv[2]));
+        // Only the pages the guest writes go back to the file
+        const auto mode = NVMem::IsMappingAvailable() ? NVMemoryMode::Mapped : NVMemoryMode::Stream;
+        std::shared_ptr<NVMem> nvram = std::make_shared<NVMem>(0x10000, std::string(argv[2]), mode);
 
         Processor cpu(programMemory, nvram);
+        cpu.EnableProfiling(profile);
+        if (console)
+        {
+            cpu.GetBus().Map(ConsoleDevice::DefaultBase,
+                             DeviceBus::PageSize,
+                             std::make_shared<ConsoleDevice>(std::cout));
+        }
+        if (counters || countersJson)
+        {
+            cpu.GetBus().Map(CounterDevice::DefaultBase,
+                             DeviceBus::PageSize,
+                             std::make_shared<CounterDevice>(cpu));
+        }
+        std::unique_ptr<SamplingProfiler> sampler;
+        if (samplePeriod > 0)
+        {
+            sampler = std::make_unique<SamplingProfiler>(cpu, samplePeriod);
+        }
+        std::shared_ptr<TraceWriter> trace;
+        if (!traceFile.empty())
+        {
+            trace = std::make_shared<TraceWriter>(traceFile);
+            cpu.SetTraceWriter(trace);
+        }
         cpu.ExecuteAll();
+        if (trace)
+        {
+            trace->Close();
+        }
+        if (sampler)
+        {
+            // Written by luinuxasm, without it samples are only known by address
+            DebugLineTable lines;
+            std::ifstream linesFile(DebugLineTable::PathFor(argv[1]));
+            if (linesFile)
+            {
+                lines = DebugLineTable::Read(linesFile);
+            }
+            std::cout << sampler->Report(lines);
+            std::ofstream folded(std::string(argv[1]) + ".folded", std::ios::trunc);
+            sampler->WriteFoldedStacks(folded, lines);
+        }
+        if (profile)
+        {
+            std::cout << cpu.GetProfile()->Report();
+        }
+        if (countersJson)
+        {
+            std::cout << cpu.GetPerfCounters().ToJson() << std::endl;
+        }
+        else if (counters)
+        {
+            std::cout << cpu.GetPerfCounters().Report();
+        }
     }
     catch (const std::exception& e)
     {
@@ -0,0 +1,209 @@
+#include "nvram_flusher.h"
+
+#include "processor.h"
+
+NVRamFlusher::NVRamFlusher(NVMemory16& nvram, std::chrono::milliseconds interval)
+    : _nvram(nvram), _interval(interval)
+{
+    if (!IsAvailable())
+    {
+        throw std::runtime_error("Background NVRAM flushing is not available on this host.");
+    }
+    if (_nvram.Mode() != NVMemoryMode::Stream)
+    {
+        throw std::invalid_argument("Only Stream mode NVRAM needs a background flusher");
+    }
+#ifdef LUINUX_HAS_MMAP
+    _fd = ::open(_nvram.Filename().c_str(), O_WRONLY);
+#endif
+    LuinuxAssert(_fd >= 0, "Failed to open the file for NVRAM");
+
+    _nvram.AddObserver(this);
+    _writer = std::thread([this] { _WriterLoop(); });
+}
+
+NVRamFlusher::~NVRamFlusher()
+{
+    if (_pollEvent)
+    {
+        _cpu->GetScheduler().Cancel(*_pollEvent);
+    }
+    try
+    {
+        Barrier();
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "NVRAM flush failed: " << e.what() << std::endl;
+    }
+    _nvram.RemoveObserver(this);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _wake.notify_all();
+    _writer.join();
+    _donePages.clear();
+#ifdef LUINUX_HAS_MMAP
+    ::close(_fd);
+#endif
+}
+
+bool NVRamFlusher::IsAvailable()
+{
+#ifdef LUINUX_HAS_MMAP
+    return true;
+#else
+    return false;
+#endif
+}
+
+void NVRamFlusher::OnMemoryWrite(size_t address, size_t size)
+{
+    Poll();
+}
+
+void NVRamFlusher::Poll()
+{
+    if (_captureDue.load(std::memory_order_relaxed))
+    {
+        _Capture(false);
+    }
+}
+
+void NVRamFlusher::Attach(Processor& cpu, uint64_t period)
+{
+    if (period == 0)
+    {
+        throw std::invalid_argument("The poll period has to be at least one instruction");
+    }
+    if (_pollEvent)
+    {
+        _cpu->GetScheduler().Cancel(*_pollEvent);
+    }
+    _cpu = &cpu;
+    _pollPeriod = period;
+    _ArmPoll(_cpu->GetInstructionCount());
+}
+
+void NVRamFlusher::Barrier()
+{
+    _Wait(_Capture(false));
+}
+
+void NVRamFlusher::Sync()
+{
+    _Wait(_Capture(true));
+}
+
+NVRamFlusherStats NVRamFlusher::GetStats() const
+{
+    return {_captures.load(), _pagesWritten.load(), _syncs.load()};
+}
+
+uint64_t NVRamFlusher::_Capture(bool sync)
+{
+    _captureDue.store(false, std::memory_order_relaxed);
+    auto pages = _nvram.TakeDirtyPages();
+
+    // Dropped once the lock is released, taking it is what orders them after the writer's reads
+    std::vector<Pages> done;
+    std::lock_guard<std::mutex> lock(_mutex);
+    done.swap(_donePages);
+    if (pages.empty() && !sync)
+    {
+        return _queuedSequence;
+    }
+    _batches.push_back({std::move(pages), sync, ++_queuedSequence});
+    ++_captures;
+    _wake.notify_one();
+    return _queuedSequence;
+}
+
+void NVRamFlusher::_Wait(uint64_t sequence)
+{
+    std::vector<Pages> done;
+    std::unique_lock<std::mutex> lock(_mutex);
+    _written.wait(lock, [&] { return _writtenSequence >= sequence; });
+    done.swap(_donePages);
+    if (_error)
+    {
+        std::rethrow_exception(std::exchange(_error, nullptr));
+    }
+}
+
+void NVRamFlusher::_ArmPoll(uint64_t now)
+{
+    _pollEvent = _cpu->GetScheduler().Schedule(now + _pollPeriod, [this](uint64_t cycle) {
+        Poll();
+        _ArmPoll(cycle);
+    });
+}
+
+void NVRamFlusher::_WriterLoop()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true)
+    {
+        if (_batches.empty())
+        {
+            if (_stop)
+            {
+                return;
+            }
+            if (!_wake.wait_for(lock, _interval, [&] { return _stop || !_batches.empty(); }))
+            {
+                _captureDue.store(true, std::memory_order_relaxed);
+            }
+            continue;
+        }
+
+        Batch batch = std::move(_batches.front());
+        _batches.pop_front();
+        lock.unlock();
+        std::exception_ptr error;
+        try
+        {
+            _Write(batch);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        lock.lock();
+        // Back to the guest's thread, dropping them here would race with its next write
+        _donePages.push_back(std::move(batch.pages));
+
+        if (error && !_error)
+        {
+            _error = error;
+        }
+        _writtenSequence = batch.sequence;
+        _written.notify_all();
+    }
+}
+
+void NVRamFlusher::_Write(const Batch& batch)
+{
+#ifdef LUINUX_HAS_MMAP
+    for (const auto& [index, page] : batch.pages)
+    {
+        const size_t offset = index * NVMemory16::PageSize;
+        const size_t size = std::min(NVMemory16::PageSize, _nvram.Size() - offset);
+        if (::pwrite(_fd, page->data(), size, static_cast<off_t>(offset)) !=
+            static_cast<ssize_t>(size))
+        {
+            throw std::runtime_error("Failed to write NVRAM page " + std::to_string(index));
+        }
+        ++_pagesWritten;
+    }
+    if (batch.sync)
+    {
+        if (::fsync(_fd) != 0)
+        {
+            throw std::runtime_error("Failed to sync NVRAM to disk");
+        }
+        ++_syncs;
+    }
+#endif
+}
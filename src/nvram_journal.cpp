@@ -0,0 +1,313 @@
+#include "nvram_journal.h"
+
+namespace
+{
+// Records never span more than this, WritePayload() sized writes are split up
+constexpr size_t MaxRecordBytes = 0x8000;
+// Address and length words, then the bytes, then a 32-bit checksum
+constexpr size_t RecordOverhead = 2 + 2 + 4;
+
+uint32_t Checksum(const uint8_t* data, size_t size)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+std::string NextJournalPath(const std::string& journalPath)
+{
+    return journalPath + ".next";
+}
+
+#ifdef LUINUX_HAS_MMAP
+void WriteAll(int fd, const uint8_t* data, size_t size)
+{
+    while (size > 0)
+    {
+        const ssize_t written = ::write(fd, data, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw std::runtime_error("Failed to write the NVRAM journal");
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+int OpenJournal(const std::string& path, int flags)
+{
+    const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | flags, 0644);
+    LuinuxAssert(fd >= 0, "Failed to open the NVRAM journal");
+    return fd;
+}
+#endif
+}  // namespace
+
+NVRamJournal::NVRamJournal(NVMemory16& nvram, size_t compactionThreshold)
+    : _nvram(nvram),
+      _imagePath(nvram.Filename()),
+      _journalPath(JournalPath(nvram.Filename())),
+      _compactionThreshold(compactionThreshold)
+{
+    if (!IsAvailable())
+    {
+        throw std::runtime_error("The NVRAM journal is not available on this host.");
+    }
+    if (_nvram.Mode() != NVMemoryMode::Journaled)
+    {
+        throw std::invalid_argument("The NVRAM journal needs Journaled mode NVRAM");
+    }
+    _buffer.reserve(BufferSize + RecordOverhead + MaxRecordBytes);
+
+#ifdef LUINUX_HAS_MMAP
+    const std::string nextPath = NextJournalPath(_journalPath);
+    const bool interruptedCompaction = std::ifstream(nextPath).good();
+    _Replay(_journalPath);
+    if (interruptedCompaction)
+    {
+        // Left over from a compaction that didn't finish. The log has to be made one again
+        // before anything gets appended, or it would replay in the wrong order next time.
+        _Replay(nextPath);
+        _WriteImage(_nvram, -1);
+        std::remove(nextPath.c_str());
+    }
+    _fd = OpenJournal(_journalPath, 0);
+    struct stat status;
+    _journalSize = (::fstat(_fd, &status) == 0) ? static_cast<size_t>(status.st_size) : 0;
+#endif
+    _nvram.AddObserver(this);
+}
+
+NVRamJournal::~NVRamJournal()
+{
+    _nvram.RemoveObserver(this);
+    try
+    {
+        Flush();
+        WaitForCompaction();
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "NVRAM journal flush failed: " << e.what() << std::endl;
+    }
+#ifdef LUINUX_HAS_MMAP
+    if (_fd >= 0)
+    {
+        ::close(_fd);
+    }
+#endif
+}
+
+bool NVRamJournal::IsAvailable()
+{
+#ifdef LUINUX_HAS_MMAP
+    return true;
+#else
+    return false;
+#endif
+}
+
+std::string NVRamJournal::JournalPath(const std::string& imagePath)
+{
+    return imagePath + ".journal";
+}
+
+void NVRamJournal::OnMemoryWrite(size_t address, size_t size)
+{
+    while (size > 0)
+    {
+        const size_t chunk = std::min(size, MaxRecordBytes);
+        const size_t start = _buffer.size();
+        _buffer.resize(start + RecordOverhead + chunk);
+        uint8_t* record = _buffer.data() + start;
+        record[0] = static_cast<uint8_t>(address >> 8);
+        record[1] = static_cast<uint8_t>(address);
+        record[2] = static_cast<uint8_t>(chunk >> 8);
+        record[3] = static_cast<uint8_t>(chunk);
+        _nvram.ReadRange(address, record + 4, chunk);
+        const uint32_t checksum = Checksum(record, 4 + chunk);
+        for (size_t i = 0; i < 4; ++i)
+        {
+            record[4 + chunk + i] = static_cast<uint8_t>(checksum >> (24 - 8 * i));
+        }
+        ++_stats.recordsAppended;
+        address += chunk;
+        size -= chunk;
+    }
+    if (_buffer.size() >= BufferSize)
+    {
+        Flush();
+    }
+}
+
+void NVRamJournal::Flush()
+{
+    if (!_buffer.empty())
+    {
+        _Append(_buffer);
+        _buffer.clear();
+    }
+    if (!_compacting)
+    {
+        // Picks up how the last compaction went
+        WaitForCompaction();
+    }
+    if (_journalSize > _compactionThreshold && !_compaction.joinable())
+    {
+        Compact();
+    }
+}
+
+void NVRamJournal::Sync()
+{
+    Flush();
+#ifdef LUINUX_HAS_MMAP
+    LuinuxAssert(::fsync(_fd) == 0, "Failed to sync the NVRAM journal");
+#endif
+}
+
+void NVRamJournal::_Append(const std::vector<uint8_t>& bytes)
+{
+#ifdef LUINUX_HAS_MMAP
+    WriteAll(_fd, bytes.data(), bytes.size());
+#endif
+    _journalSize += bytes.size();
+    _stats.bytesAppended += bytes.size();
+}
+
+void NVRamJournal::Compact()
+{
+    WaitForCompaction();
+    if (!_buffer.empty())
+    {
+        _Append(_buffer);
+        _buffer.clear();
+    }
+
+#ifdef LUINUX_HAS_MMAP
+    // Everything up to here is in the old log and in the copy, the rest goes to the next log
+    const int oldJournal = _fd;
+    _fd = OpenJournal(NextJournalPath(_journalPath), O_TRUNC);
+    _journalSize = 0;
+    _image = std::make_unique<Memory<uint16_t>>(_nvram);
+
+    _compacting = true;
+    _compaction = std::thread([this, oldJournal, image = _image.get()] {
+        try
+        {
+            // Replaying a prefix of the old log onto the new image would mix old and new state
+            LuinuxAssert(::fsync(oldJournal) == 0, "Failed to sync the NVRAM journal");
+            _WriteImage(*image, oldJournal);
+            std::rename(NextJournalPath(_journalPath).c_str(), _journalPath.c_str());
+        }
+        catch (...)
+        {
+            _compactionError = std::current_exception();
+        }
+        _compacting = false;
+    });
+    ++_stats.compactions;
+#endif
+}
+
+void NVRamJournal::WaitForCompaction()
+{
+    if (_compaction.joinable())
+    {
+        _compaction.join();
+    }
+    // Only now that the join ordered the thread's reads before this
+    _image.reset();
+    if (_compactionError)
+    {
+        std::rethrow_exception(std::exchange(_compactionError, nullptr));
+    }
+}
+
+void NVRamJournal::_WriteImage(const Memory<uint16_t>& image, int oldJournal)
+{
+#ifdef LUINUX_HAS_MMAP
+    std::vector<uint8_t> bytes(image.Size());
+    image.ReadRange(0, bytes.data(), bytes.size());
+
+    const std::string temporaryPath = _imagePath + ".compact";
+    const int fd = ::open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    LuinuxAssert(fd >= 0, "Failed to write the NVRAM image");
+    try
+    {
+        WriteAll(fd, bytes.data(), bytes.size());
+        LuinuxAssert(::fsync(fd) == 0, "Failed to sync the NVRAM image");
+    }
+    catch (...)
+    {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+    LuinuxAssert(std::rename(temporaryPath.c_str(), _imagePath.c_str()) == 0,
+                 "Failed to replace the NVRAM image");
+
+    // The image has every record of the old log now
+    if (oldJournal >= 0)
+    {
+        ::close(oldJournal);
+    }
+    std::remove(_journalPath.c_str());
+#endif
+}
+
+void NVRamJournal::_Replay(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        return;
+    }
+    const std::vector<uint8_t> log(std::istreambuf_iterator<char>(file), {});
+    file.close();
+
+    size_t offset = 0;
+    while (offset + RecordOverhead <= log.size())
+    {
+        const uint8_t* record = log.data() + offset;
+        const size_t address = (size_t{record[0]} << 8) | record[1];
+        const size_t size = (size_t{record[2]} << 8) | record[3];
+        if (size == 0 || size > MaxRecordBytes || offset + RecordOverhead + size > log.size() ||
+            address + size > _nvram.Size())
+        {
+            break;
+        }
+        uint32_t checksum = 0;
+        for (size_t i = 0; i < 4; ++i)
+        {
+            checksum = (checksum << 8) | record[4 + size + i];
+        }
+        if (checksum != Checksum(record, 4 + size))
+        {
+            break;
+        }
+
+        _nvram.WritePayload(static_cast<uint16_t>(address),
+                            reinterpret_cast<const char*>(record + 4),
+                            size);
+        ++_stats.recordsReplayed;
+        offset += RecordOverhead + size;
+    }
+
+#ifdef LUINUX_HAS_MMAP
+    if (offset < log.size())
+    {
+        // Torn or corrupt tail from a crash, new records go right after the last good one
+        LuinuxAssert(::truncate(path.c_str(), static_cast<off_t>(offset)) == 0,
+                     "Failed to trim the NVRAM journal");
+    }
+#endif
+}
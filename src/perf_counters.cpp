@@ -0,0 +1,70 @@
+#include "perf_counters.h"
+
+namespace
+{
+const char* BankName(size_t bank)
+{
+    return bank == PerfCounters::Sram ? "sram" : "nvram";
+}
+}  // namespace
+
+std::string PerfCounters::Report() const
+{
+    std::ostringstream out;
+    const auto line = [&out](const std::string& name, uint64_t count) {
+        out << std::left << std::setw(20) << name << std::right << std::setw(12) << count << '\n';
+    };
+    line("cycles", cycles);
+    line("instret", instret);
+    if (!Enabled)
+    {
+        out << "(built without LUINUX_PERF_COUNTERS, no events counted)\n";
+        return out.str();
+    }
+    for (size_t opCode = 0; opCode < OpCodeCount; ++opCode)
+    {
+        if (retired[opCode] != 0)
+        {
+            line("retired." + opCodeMnemonicTable.at(static_cast<OpCodeId>(opCode)),
+                 retired[opCode]);
+        }
+    }
+    line("branches.taken", branchesTaken);
+    line("branches.notTaken", branchesNotTaken);
+    for (size_t bank = 0; bank < BankCount; ++bank)
+    {
+        line(std::string("loads.") + BankName(bank), loads[bank]);
+        line(std::string("stores.") + BankName(bank), stores[bank]);
+    }
+    line("pushes", pushes);
+    line("pops", pops);
+    line("flagExceptions", flagExceptions);
+    return out.str();
+}
+
+std::string PerfCounters::ToJson() const
+{
+    std::ostringstream out;
+    out << "{\"enabled\": " << (Enabled ? "true" : "false") << ", \"cycles\": " << cycles
+        << ", \"instret\": " << instret << ", \"retired\": {";
+    const char* separator = "";
+    for (size_t opCode = 0; opCode < OpCodeCount; ++opCode)
+    {
+        if (retired[opCode] != 0)
+        {
+            out << separator << '"' << opCodeMnemonicTable.at(static_cast<OpCodeId>(opCode))
+                << "\": " << retired[opCode];
+            separator = ", ";
+        }
+    }
+    out << "}, \"branches\": {\"taken\": " << branchesTaken
+        << ", \"notTaken\": " << branchesNotTaken << "}";
+    for (const auto& [name, counts] : {std::pair{"loads", &loads}, std::pair{"stores", &stores}})
+    {
+        out << ", \"" << name << "\": {\"" << BankName(Sram) << "\": " << (*counts)[Sram] << ", \""
+            << BankName(NVRam) << "\": " << (*counts)[NVRam] << "}";
+    }
+    out << ", \"pushes\": " << pushes << ", \"pops\": " << pops
+        << ", \"flagExceptions\": " << flagExceptions << "}";
+    return out.str();
+}
@@ -1,15 +1,34 @@
 #include "processor.h"
 
 #include "common.h"
+#include "disassembler.h"
 
 void Processor::WriteRegister(RegisterId reg, uint16_t value)
 {
-    _registers.at(reg).Write(value);
+    _registers.at(static_cast<size_t>(reg)) = value;
+    if (reg == RegisterId::RFL)
+    {
+        _pendingFlags.operation = FlagsOperation::None;
+    }
 }
 
 uint16_t Processor::ReadRegister(RegisterId reg) const
 {
-    return _registers.at(reg).Read();
+    if (reg == RegisterId::RFL)
+    {
+        return _EvaluateFlags();
+    }
+    return _registers.at(static_cast<size_t>(reg));
+}
+
+const Memory8& Processor::GetInternalMemory() const
+{
+    for (size_t i = 0; i < _registers.size(); ++i)
+    {
+        _internalMemory.Write16(static_cast<uint8_t>(i * 2),
+                                ReadRegister(static_cast<RegisterId>(i)));
+    }
+    return _internalMemory;
 }
 
 void Processor::PerformExecutionCycle()
@@ -18,141 +37,722 @@ void Processor::PerformExecutionCycle()
     {
         return;
     }
-    _DoPerformExecutionCycle();
+    // Between instructions, the same as _Run() between blocks
+    if (_instructionCount >= _scheduler.NextEventCycle())
+    {
+        _scheduler.RunDue(_instructionCount);
+    }
+    if (_interruptPending && !_TakeInterrupt())
+    {
+        throw std::runtime_error(_faultMessage);
+    }
+    if (_DoPerformExecutionCycle())
+    {
+        ++_instructionCount;
+    }
+    if (_fault != Fault::None && !_TakeFault())
+    {
+        throw std::runtime_error(_faultMessage);
+    }
+}
+
+void Processor::ExecuteAll()
+{
+    if (_Run(std::numeric_limits<uint64_t>::max()) == StopReason::Fault)
+    {
+        throw std::runtime_error(_faultMessage);
+    }
+}
+
+StopReason Processor::Run(uint64_t maxInstructions)
+{
+    return _Run(maxInstructions);
 }
 
-void Processor::_DoPerformExecutionCycle()
+StopReason Processor::_Run(uint64_t maxInstructions)
 {
+    uint64_t remaining = maxInstructions;
+    std::optional<uint16_t> stepOver = std::exchange(_stoppedAtBreakpoint, std::nullopt);
+
+    while (true)
+    {
+        if (_fault != Fault::None && !_TakeFault())
+        {
+            return StopReason::Fault;
+        }
+        if (_instructionStatus == InstructionCycle::Halted)
+        {
+            return StopReason::Halted;
+        }
+        if (_instructionCount >= _scheduler.NextEventCycle())
+        {
+            _scheduler.RunDue(_instructionCount);
+        }
+        if (_interruptPending && !_TakeInterrupt())
+        {
+            return StopReason::Fault;
+        }
+        // Trap is never deferred, no need to fold in the pending ALU flags
+        FlagsObject f(_Reg(RegisterId::RFL));
+        if (f.flags.Trap == 1)
+        {
+            return StopReason::Trap;
+        }
+        if (remaining == 0)
+        {
+            return StopReason::BudgetExhausted;
+        }
+
+        // Breakpoints split blocks, so they can only be at a block's first instruction
+        const uint16_t rip = _Reg(RegisterId::RIP);
+        if (!_breakpoints.empty() && _breakpoints.count(rip) > 0 && stepOver != rip)
+        {
+            _stoppedAtBreakpoint = rip;
+            return StopReason::Breakpoint;
+        }
+        stepOver.reset();
+
+        BasicBlock* block = _translationCache.Lookup(rip);
+        if (block->instructions.empty())
+        {
+            // Couldn't translate, let the regular cycle raise the fault
+            if (_DoPerformExecutionCycle())
+            {
+                ++_instructionCount;
+                --remaining;
+            }
+            continue;
+        }
+        // Blocks end early at the next event, so it fires on time
+        const uint64_t untilEvent = _scheduler.NextEventCycle() - _instructionCount;
+        size_t limit = static_cast<size_t>(std::min({remaining, untilEvent, uint64_t{SIZE_MAX}}));
+        if (_traceEncoder) [[unlikely]]
+        {
+            limit = 1;
+        }
+        const size_t executed = _ExecuteBlock(*block, limit);
+        remaining -= executed;
+        if (_traceEncoder && executed > 0) [[unlikely]]
+        {
+            _TraceInstruction(rip);
+            continue;
+        }
+
+        if (block->onlyBranches && executed == block->instructions.size() &&
+            _Reg(RegisterId::RIP) == block->startAddress)
+        {
+            _FastForward(*block, remaining);
+        }
+    }
+}
+
+bool Processor::_TakeInterrupt()
+{
+    // The Interrupt flag is never deferred either
+    FlagsObject current(_Reg(RegisterId::RFL));
+    if (current.flags.Interrupt == 1)
+    {
+        return true;
+    }
+    const uint16_t handler = _VectorEntry(InterruptVector);
+    if (handler == 0)
+    {
+        return true;
+    }
+    if (!_EnterHandler(handler, "the interrupt"))
+    {
+        // Still waiting, the next run stops right away again
+        _lastFault = Fault::AddressOutOfRange;
+        return false;
+    }
+    _interruptPending = false;
+    return true;
+}
+
+bool Processor::_SettleFault(uint16_t instructionAddress)
+{
+    // Traps are raised by instructions that did run, RIP is already past them
+    if (_fault == Fault::DivideByZero)
+    {
+        return true;
+    }
+    _Reg(RegisterId::RIP) = instructionAddress;
+    return false;
+}
+
+bool Processor::_TakeFault()
+{
+    const Fault fault = std::exchange(_fault, Fault::None);
+    const uint16_t handler = _VectorEntry(static_cast<size_t>(fault));
+    if (handler == 0 && fault == Fault::DivideByZero)
+    {
+        // The Exception flag is all there is without a handler
+        return true;
+    }
+    // A handler faulting on its first instruction would be entered forever
+    if (handler == 0 || handler == _Reg(RegisterId::RIP))
+    {
+        _lastFault = fault;
+        _faultMessage = _DescribeFault(fault);
+        return false;
+    }
+    if (!_EnterHandler(handler, FaultName(fault)))
+    {
+        _lastFault = fault;
+        return false;
+    }
+    ++_handledFaults;
+    return true;
+}
+
+uint16_t Processor::_VectorEntry(size_t index) const
+{
+    uint16_t handler = 0;
+    if (_vectorTable)
+    {
+        _sram->TryRead16(static_cast<uint16_t>(*_vectorTable + 2 * index), handler);
+    }
+    return handler;
+}
+
+bool Processor::_EnterHandler(uint16_t handler, const char* reason)
+{
+    FlagsObject f(_Flags());
+    auto& RSP = _Reg(RegisterId::RSP);
+    const uint16_t rip = _Reg(RegisterId::RIP);
+    const uint16_t flagsAddress = static_cast<uint16_t>(RSP + 2);
+    // The handler returns by popping both back, so they have to land in RAM. Near the top of
+    // memory the second push would wrap around to 0, and a device would just swallow them.
+    const bool pushed = size_t{RSP} + 4 <= _mainMemory->Size() &&
+                        _bus.DeviceAt(RSP) == nullptr && _bus.DeviceAt(flagsAddress) == nullptr &&
+                        _mainMemory->TryWrite16(RSP, rip) &&
+                        _mainMemory->TryWrite16(flagsAddress, f.value);
+    if (!pushed)
+    {
+        _faultMessage = "Double fault, no room on the stack at " + std::to_string(RSP) +
+                        " to enter the handler for " + reason;
+        return false;
+    }
+    _TraceStore(RSP, rip);
+    _TraceStore(flagsAddress, f.value);
+    RSP += 4;
+
+    f.flags.Interrupt = 1;
+    _Reg(RegisterId::RFL) = f.value;
+    _Reg(RegisterId::RIP) = handler;
+    return true;
+}
+
+std::string Processor::_DescribeFault(Fault fault) const
+{
+    const uint16_t rip = _Reg(RegisterId::RIP);
+    switch (fault)
+    {
+        case Fault::InvalidInstruction:
+        {
+            uint16_t instruction = 0;
+            if (!_programMemory.TryRead16(rip, instruction))
+            {
+                return "Fetching outside of program memory at " + std::to_string(rip);
+            }
+            return "Invalid instruction found in memory. Cannot decode: " +
+                   _InstructionToString(instruction);
+        }
+        case Fault::AddressOutOfRange:
+            return "Used address is out of range, at instruction " + std::to_string(rip);
+        case Fault::NVRamUnavailable:
+            return "Trying to use NVRAM, but it was not prepared on this setup.";
+        default:
+            return std::string("Fault ") + FaultName(fault);
+    }
+}
+
+void Processor::_FastForward(const BasicBlock& block, uint64_t& remaining)
+{
+    // Every turn would stop at a breakpoint there, and an interrupt about to be taken changes
+    // where the loop goes
+    if (!_breakpoints.empty() && _breakpoints.count(block.startAddress) > 0)
+    {
+        return;
+    }
+    FlagsObject f(_Reg(RegisterId::RFL));
+    if (_interruptPending && f.flags.Interrupt == 0 && _VectorEntry(InterruptVector) != 0)
+    {
+        return;
+    }
+
+    const uint64_t size = block.instructions.size();
+    const uint64_t untilEvent = _scheduler.NextEventCycle() - _instructionCount;
+    const uint64_t skipped = std::min(remaining, untilEvent) / size * size;
+    _instructionCount += skipped;
+    _idleInstructionCount += skipped;
+    remaining -= skipped;
+}
+
+void Processor::AddBreakpoint(uint16_t address)
+{
+    _breakpoints.insert(address);
+    _translationCache.AddBlockBoundary(address);
+}
+
+void Processor::RemoveBreakpoint(uint16_t address)
+{
+    if (_breakpoints.erase(address) > 0)
+    {
+        _translationCache.RemoveBlockBoundary(address);
+    }
+}
+
+void Processor::SetExecutionEngine(ExecutionEngine engine)
+{
+    if (engine == ExecutionEngine::Jit)
+    {
+        if (!JitCompiler::IsAvailable())
+        {
+            throw std::runtime_error("The JIT engine is not available on this host.");
+        }
+        if (_jit == nullptr)
+        {
+            _jit = std::make_unique<JitCompiler>();
+        }
+    }
+    _executionEngine = engine;
+}
+
+void Processor::SetTraceWriter(std::shared_ptr<TraceWriter> writer)
+{
+    _traceEncoder.reset();
+    _traceWriter = std::move(writer);
+    if (_traceWriter)
+    {
+        TraceRegisters registers = _registers;
+        registers[static_cast<size_t>(RegisterId::RFL)] = _EvaluateFlags();
+        _traceEncoder = std::make_unique<TraceEncoder>(registers, _traceBuffer);
+        _traceWriter->Write(_traceBuffer.data(), _traceBuffer.size());
+        _traceBuffer.clear();
+    }
+}
+
+void Processor::_TraceInstruction(uint16_t rip)
+{
+    // The instruction just ran, so both words are there to read
+    uint16_t instruction = 0;
+    uint16_t literal = 0;
+    _programMemory.TryRead16(rip, instruction);
+    _programMemory.TryRead16(static_cast<uint16_t>(rip + 2), literal);
+
+    TraceRegisters registers = _registers;
+    registers[static_cast<size_t>(RegisterId::RFL)] = _EvaluateFlags();
+    _traceEncoder->AddInstruction(rip, instruction, literal, registers, _traceBuffer);
+    _traceWriter->Write(_traceBuffer.data(), _traceBuffer.size());
+    _traceBuffer.clear();
+}
+
+PerfCounters Processor::GetPerfCounters() const
+{
+    PerfCounters counters = _counters;
+    counters.cycles = _instructionCount;
+    counters.instret = _instructionCount - _idleInstructionCount;
+    return counters;
+}
+
+size_t Processor::_RunJitCode(BasicBlock& block)
+{
+    if (block.jitCode == nullptr)
+    {
+        if (block.executionCount >= JitCompiler::HotThreshold ||
+            ++block.executionCount < JitCompiler::HotThreshold)
+        {
+            return 0;
+        }
+        if (!_jit->Compile(block))
+        {
+            // Out of room for code. Start over, blocks get hot again and are recompiled.
+            _translationCache.Clear();
+            _jit->Reset();
+            return 0;
+        }
+        if (block.jitCode == nullptr)
+        {
+            return 0;
+        }
+    }
+
+    // Compiled code merges its flags straight into RFL
+    _Flags();
+    block.jitCode(_registers.data());
+    ++_jit->GetStats().executedBlocks;
+    return block.jitInstructionCount;
+}
+
+size_t Processor::_ExecuteBlock(BasicBlock& block, size_t limit)
+{
+    const size_t end = std::min(limit, block.instructions.size());
+    size_t executed = 0;
+    // Compiled code always runs to its end, only use it when the whole block fits the budget
+    if (_executionEngine == ExecutionEngine::Jit && end == block.instructions.size())
+    {
+        executed = _RunJitCode(block);
+        _instructionCount += executed;
+    }
+
+    const auto generation = _translationCache.Generation();
+    auto& rip = _Reg(RegisterId::RIP);
+
+    while (executed < end)
+    {
+        const auto& instruction = block.instructions[executed];
+        if (instruction.fused != FusedOp::None && executed + FusedLength(instruction.fused) <= end)
+        {
+            // Superinstructions never touch memory, the block can't go stale under them
+            _ExecuteFused(&instruction);
+            executed += FusedLength(instruction.fused);
+            _instructionCount += FusedLength(instruction.fused);
+            continue;
+        }
+
+        // Same architectural state the fetch stage would have left behind
+        rip = instruction.nextAddress;
+        _2wordOperand = instruction.literal;
+
+        InstructionOperands operands;
+        _BindOperands(operands, instruction.decoded.args, instruction.decoded.argCount);
+        _DispatchInstruction(instruction.decoded.opCodeId, operands);
+        if (_fault != Fault::None) [[unlikely]]
+        {
+            const uint16_t address =
+                executed == 0 ? block.startAddress : block.instructions[executed - 1].nextAddress;
+            if (_SettleFault(address))
+            {
+                ++executed;
+                ++_instructionCount;
+            }
+            break;
+        }
+        ++executed;
+        ++_instructionCount;
+
+        // The block itself was just written to, what's left of it is stale
+        if (_translationCache.Generation() != generation)
+        {
+            break;
+        }
+    }
+
+    if (_profile)
+    {
+        _profile->Record(block.instructions, executed);
+    }
+    if constexpr (PerfCounters::Enabled)
+    {
+        // Conditional jumps end blocks, the RIP left behind is the one they set
+        for (size_t i = 0; i < executed; ++i)
+        {
+            const auto& instruction = block.instructions[i];
+            _CountRetired(instruction.decoded.opCodeId, instruction.nextAddress);
+        }
+    }
+    return executed;
+}
+
+void Processor::_ExecuteFused(const TranslatedInstruction* group)
+{
+    // Group members never name RIP or RFL, so binding needs no flag folding and only the RIP the
+    // last member leaves behind is observable
+    const auto operands = [this](const TranslatedInstruction& instruction) {
+        InstructionOperands bound;
+        bound.count = instruction.decoded.argCount;
+        for (size_t i = 0; i < bound.count; ++i)
+        {
+            bound.regs[i] = &_Reg(instruction.decoded.args[i]);
+        }
+        return bound;
+    };
+    _Reg(RegisterId::RIP) = group[FusedLength(group->fused) - 1].nextAddress;
+
+    switch (group->fused)
+    {
+        case FusedOp::IncSubJnz:
+            INC(operands(group[0]));
+            SUB(operands(group[1]));
+            JNZ(operands(group[2]));
+            break;
+        case FusedOp::DecDecJnz:
+            DEC(operands(group[0]));
+            DEC(operands(group[1]));
+            JNZ(operands(group[2]));
+            break;
+        case FusedOp::SubJnz:
+            SUB(operands(group[0]));
+            JNZ(operands(group[1]));
+            break;
+        case FusedOp::IncSub:
+            INC(operands(group[0]));
+            SUB(operands(group[1]));
+            break;
+        case FusedOp::SetSet:
+            _Reg(group[0].decoded.args[0]) = group[0].literal;
+            _Reg(group[1].decoded.args[0]) = group[1].literal;
+            _2wordOperand = group[1].literal;
+            break;
+        case FusedOp::None:
+            break;
+    }
+}
+
+void Processor::EnableProfiling(bool enabled)
+{
+    if (!enabled)
+    {
+        _profile.reset();
+    }
+    else if (_profile == nullptr)
+    {
+        _profile = std::make_unique<InstructionProfile>();
+    }
+}
+
+bool Processor::_DoPerformExecutionCycle()
+{
+    const uint16_t address = _Reg(RegisterId::RIP);
     _FetchInstruction();
-    _DecodeInstruction();
-    _ExecuteInstruction();
+    if (_fault == Fault::None)
+    {
+        _DecodeInstruction();
+    }
+    const OpCodeId opCodeId = _decodedOpCodeId;
+    const uint16_t nextAddress = _Reg(RegisterId::RIP);
+    if (_fault == Fault::None)
+    {
+        _ExecuteInstruction();
+    }
+    bool ran = true;
+    if (_fault != Fault::None)
+    {
+        _CleanInstructionCycle();
+        ran = _SettleFault(address);
+    }
+    if (ran)
+    {
+        _CountRetired(opCodeId, nextAddress);
+        if (_traceEncoder) [[unlikely]]
+        {
+            _TraceInstruction(address);
+        }
+    }
 
     // Instruction cycle is done at this point, break only on halted state
     if (_instructionStatus != InstructionCycle::Halted)
     {
         _instructionStatus = InstructionCycle::Idle;
     }
+    return ran;
 }
 
 Processor::Processor(Memory16& programMemory, std::shared_ptr<NVMemory16> nvram)
-    : _programMemory(programMemory), _nvram(nvram), _internalMemory(InternalMemorySize)
+    : _programMemory(programMemory),
+      _nvram(nvram),
+      _internalMemory(InternalMemorySize),
+      _translationCache(programMemory)
 {
     // By default write to sram.
     _mainMemory = std::make_shared<Memory16>(Memory16(MainMemorySize));
     _sram = _mainMemory;
 
-    // Initialize the registers
-    static_assert(static_cast<uint8_t>(RegisterId::RAC) == 0);
-    for (auto i = RegisterId::RAC; i != RegisterId::END_OF_REGLIST;
-         i = RegisterId(static_cast<uint8_t>(i) + 1))
+    WriteRegister(RegisterId::RSP, RSP_DefaultAddress);
+    WriteRegister(RegisterId::RIP, 0);
+}
+
+std::unique_ptr<Processor> Processor::Fork() const
+{
+    auto fork = std::make_unique<Processor>(_programMemory, _nvram);
+    fork->Restore(Snapshot());
+    fork->_bus = _bus;
+    fork->_vectorTable = _vectorTable;
+    fork->SetExecutionEngine(_executionEngine);
+    fork->SetSuperinstructions(_translationCache.IsFusionEnabled());
+    for (uint16_t address : _breakpoints)
     {
-        _registers.insert({i, Register(static_cast<uint8_t>(i) * uint8_t{2}, _internalMemory, i)});
+        fork->AddBreakpoint(address);
     }
+    return fork;
+}
 
-    WriteRegister(RegisterId::RSP, RSP_DefaultAddress);
-    WriteRegister(RegisterId::RIP, 0);
+ProcessorSnapshot Processor::Snapshot() const
+{
+    ProcessorSnapshot snapshot;
+    for (size_t i = 0; i < _registers.size(); ++i)
+    {
+        snapshot.registers[i] = ReadRegister(static_cast<RegisterId>(i));
+    }
+    snapshot.sram = *_sram;
+    snapshot.nvramSelected = (_mainMemory != _sram);
+    snapshot.instructionCount = _instructionCount;
+    snapshot.stoppedAtBreakpoint = _stoppedAtBreakpoint;
+
+    snapshot.instructionStatus = _instructionStatus;
+    snapshot.decodedOpCodeId = _decodedOpCodeId;
+    snapshot.literalValue = _literalValue;
+    snapshot.fetchedInstruction = _fetchedInstruction;
+    snapshot.instructionArgs = _instructionArgs;
+    snapshot.instructionArgCount = _instructionArgCount;
+    snapshot.twoWordOperand = _2wordOperand;
+
+    snapshot.interruptPending = _interruptPending;
+    snapshot.fault = _fault;
+    snapshot.ownedEvents = _scheduler.GetOwnedEvents(_instructionCount);
+
+    snapshot.idleInstructionCount = _idleInstructionCount;
+    snapshot.counters = _counters;
+    return snapshot;
+}
+
+void Processor::Restore(const ProcessorSnapshot& snapshot)
+{
+    if (snapshot.nvramSelected && _nvram == nullptr)
+    {
+        throw std::runtime_error("Snapshot uses NVRAM, but it was not prepared on this setup.");
+    }
+
+    _registers = snapshot.registers;
+    _pendingFlags = {};
+    *_sram = snapshot.sram;
+    _mainMemory = snapshot.nvramSelected ? _nvram : _sram;
+    _scheduler.Rebase(_instructionCount, snapshot.instructionCount, snapshot.ownedEvents);
+    _instructionCount = snapshot.instructionCount;
+    _stoppedAtBreakpoint = snapshot.stoppedAtBreakpoint;
+
+    _instructionStatus = snapshot.instructionStatus;
+    _decodedOpCodeId = snapshot.decodedOpCodeId;
+    _literalValue = snapshot.literalValue;
+    _fetchedInstruction = snapshot.fetchedInstruction;
+    _instructionArgs = snapshot.instructionArgs;
+    _instructionArgCount = snapshot.instructionArgCount;
+    _2wordOperand = snapshot.twoWordOperand;
+
+    _interruptPending = snapshot.interruptPending;
+    _fault = snapshot.fault;
+
+    _idleInstructionCount = snapshot.idleInstructionCount;
+    _counters = snapshot.counters;
 }
 
 void Processor::_CleanInstructionCycle()
 {
     _decodedOpCodeId = OpCodeId::INVALID_INSTR;
-    _instructionArgs.resize(0);
+    _instructionArgCount = 0;
+}
+
+void Processor::_BindOperands(InstructionOperands& operands,
+                              const std::array<RegisterId, 3>& args,
+                              uint8_t count)
+{
+    // Point the operands at the actual registers, no copies involved
+    operands.count = count;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (args[i] == RegisterId::RFL)
+        {
+            // The handler reads or overwrites RFL directly, it has to be up to date
+            _Flags();
+        }
+        operands.regs[i] = &_Reg(args[i]);
+    }
 }
 
-uint16_t Processor::_DereferenceRegisterRead(RegisterId reg) const
+bool Processor::_DereferenceRegisterRead(RegisterId reg, uint16_t& value)
 {
-    const auto address = _registers.at(reg).Read();
-    return _mainMemory->Read16(address);
+    if (_bus.TryRead16(*_mainMemory, _Reg(reg), value))
+    {
+        return true;
+    }
+    _RaiseFault(Fault::AddressOutOfRange);
+    return false;
 }
 
-void Processor::_DereferenceRegisterWrite(RegisterId reg, uint16_t value)
+bool Processor::_DereferenceRegisterWrite(RegisterId reg, uint16_t value)
 {
-    const auto address = _registers.at(reg).Read();
-    _mainMemory->Write16(address, value);
+    if (_bus.TryWrite16(*_mainMemory, _Reg(reg), value))
+    {
+        _TraceStore(_Reg(reg), value);
+        return true;
+    }
+    _RaiseFault(Fault::AddressOutOfRange);
+    return false;
 }
 
 void Processor::_FetchInstruction()
 {
     _instructionStatus = InstructionCycle::Fetch;
-    uint16_t ripVal = ReadRegister(RegisterId::RIP);
-    _fetchedInstruction = _programMemory.Read16(ripVal);
-    WriteRegister(RegisterId::RIP, ripVal + sizeof(uint16_t));
+    uint16_t ripVal = _Reg(RegisterId::RIP);
+    if (!_programMemory.TryRead16(ripVal, _fetchedInstruction))
+    {
+        _RaiseFault(Fault::InvalidInstruction);
+        return;
+    }
+    _Reg(RegisterId::RIP) = ripVal + sizeof(uint16_t);
 }
 
 void Processor::_DecodeInstruction()
 {
-#ifndef NDEBUG
+#ifdef LUINUX_DEBUG_DECODE
+    // Handy when stepping through with a debugger, but it builds a string on every instruction.
     auto decodedInstructionString = _InstructionToString(_fetchedInstruction);
 #endif
 
     _instructionStatus = InstructionCycle::Decode;
-    if ((_decodedOpCodeId != OpCodeId::INVALID_INSTR) || (_instructionArgs.size() > 0))
+    // Only a restored snapshot taken mid cycle gets here, the fault cleans up and retries
+    if ((_decodedOpCodeId != OpCodeId::INVALID_INSTR) || (_instructionArgCount > 0)) [[unlikely]]
     {
-        throw std::runtime_error("Decoding new instruction with previous exec cycle unfinished.");
+        _RaiseFault(Fault::InvalidInstruction);
+        return;
     }
 
-    // We check this case for leading zeroes, the rest of instructions can be
-    // determined below.`
-    if ((_fetchedInstruction & 0xf000) == 0)
-    {
-        _decodedOpCodeId = OpCodeId::ADD;
-    }
-    else
-    {
-        // Need to check a map, opcode 4b, 8b, 12b, 16b
-        for (auto i = 0; i < 4; ++i)
-        {
-            uint16_t opCodeValue = _fetchedInstruction >> (4 * i);
-            if (opCodeValuesTable.count(opCodeValue) > 0)
-            {
-                _decodedOpCodeId = opCodeValuesTable.at(opCodeValue);
-                break;
-            }
-        }
-    }
+    // Every word was decoded ahead of time, see tools/generate_opcodes.py
+    const DecodedInstruction& decoded = decodeTable[_fetchedInstruction];
 
-    // If we couldn't find the opcode, then we got an invalid operation. Throw for
-    // now. We still don't know how to handle these.
-    if (_decodedOpCodeId == OpCodeId::INVALID_INSTR)
+    // If we couldn't find the opcode, then we got an invalid operation
+    if (!decoded.IsValid())
     {
-        // Create instruction string for debugging
-        std::string instrStr = _InstructionToString(_fetchedInstruction);
-        throw std::runtime_error("Invalid instruction found in memory. Cannot decode: " + instrStr);
+        _RaiseFault(Fault::InvalidInstruction);
+        return;
     }
-    _instructionArgs.resize(opCodeTable.at(_decodedOpCodeId).argCount);
 
-    if (_decodedOpCodeId == OpCodeId::SET)
+    _decodedOpCodeId = decoded.opCodeId;
+    _instructionArgCount = decoded.argCount;
+    _instructionArgs = decoded.args;
+
+    if (decoded.hasLiteral)
     {
-        _instructionArgs.resize(1);
-        _instructionArgs[0] = static_cast<RegisterId>(_fetchedInstruction & 0xf);
         // We need to read the next word for these ones
         _FetchInstruction();
-
-        _2wordOperand = _fetchedInstruction;
-    }
-    else
-    {
-        // int i because we want to know when it reaches -1 as opposed to it running
-        // amok by rollover
-        for (int i = _instructionArgs.size() - 1; i >= 0; --i)
+        if (_fault != Fault::None)
         {
-            _instructionArgs[i] = static_cast<RegisterId>(_fetchedInstruction & 0xf);
-            _fetchedInstruction >>= 4;
-        }
-        if (_fetchedInstruction != opCodeTable.at(_decodedOpCodeId).opCode)
-        {
-            throw std::runtime_error(
-                "Something went wrong. Did we decode more or "
-                "less params than expected?");
+            return;
         }
+        _2wordOperand = _fetchedInstruction;
     }
 }
 
 void Processor::_ExecuteInstruction()
+{
+    _instructionStatus = InstructionCycle::Execute;
+    LuinuxAssert(_decodedOpCodeId != OpCodeId::INVALID_INSTR,
+                 "We are about to execute a instruction that we were not able to decode");
+    InstructionOperands operands;
+    _BindOperands(operands, _instructionArgs, _instructionArgCount);
+
+    _DispatchInstruction(_decodedOpCodeId, operands);
+
+    _CleanInstructionCycle();
+}
+
+#ifdef LUINUX_DISPATCH_MAP
+void Processor::_DispatchInstruction(OpCodeId opCodeId, const InstructionOperands& operands)
 {
     // Let's create a table of function pointers to the instructions. That way we
     // only reference those by OpCodeId
-    typedef void (Processor::*OpFunction)(std::vector<std::shared_ptr<Register>>);
+    typedef void (Processor::*OpFunction)(const InstructionOperands&);
     static const std::unordered_map<OpCodeId, OpFunction> opCodeFunctionTable = {
         {OpCodeId::ADD, &Processor::ADD},   {OpCodeId::SUB, &Processor::SUB},
         {OpCodeId::MUL, &Processor::MUL},   {OpCodeId::SMUL, &Processor::SMUL},
@@ -169,366 +769,468 @@ void Processor::_ExecuteInstruction()
         {OpCodeId::SHFL, &Processor::SHFL}, {OpCodeId::INC, &Processor::INC},
         {OpCodeId::DEC, &Processor::DEC},   {OpCodeId::NOP, &Processor::NOP},
         {OpCodeId::STOP, &Processor::STOP}, {OpCodeId::TRAP, &Processor::TRAP},
-        {OpCodeId::SWM, &Processor::SWM}};
-    _instructionStatus = InstructionCycle::Execute;
-    LuinuxAssert(_decodedOpCodeId != OpCodeId::INVALID_INSTR,
-                 "We are about to execute a instruction that we were not able to decode");
-    std::vector<std::shared_ptr<Register>> argumentsAsRegisters;
+        {OpCodeId::SWM, &Processor::SWM},   {OpCodeId::JMP, &Processor::JMP}};
 
-    // Pack the arguments as pointers to the actual registers
-    for (size_t i = 0; i < _instructionArgs.size(); ++i)
+    const auto function = opCodeFunctionTable.find(opCodeId);
+    if (function == opCodeFunctionTable.end())
     {
-        argumentsAsRegisters.push_back(
-            std::make_shared<Register>(_registers.at(_instructionArgs.at(i))));
+        // The implementation of this OPCODE is missing in the Processor class
+        _RaiseFault(Fault::InvalidInstruction);
+        return;
     }
+    OpFunction fPtr = function->second;
 
-    LuinuxAssert(opCodeFunctionTable.count(_decodedOpCodeId) > 0,
-                 "The implementation of this OPCODE is missing in the Processor class");
-    OpFunction fPtr = opCodeFunctionTable.at(_decodedOpCodeId);
-
-    (*this.*fPtr)(argumentsAsRegisters);
-
-    _CleanInstructionCycle();
+    (*this.*fPtr)(operands);
+}
+#else
+void Processor::_DispatchInstruction(OpCodeId opCodeId, const InstructionOperands& operands)
+{
+    // OpCodeId is dense and starts at 0, so this compiles down to a single indexed jump.
+    switch (opCodeId)
+    {
+        case OpCodeId::ADD:
+            return ADD(operands);
+        case OpCodeId::SUB:
+            return SUB(operands);
+        case OpCodeId::MUL:
+            return MUL(operands);
+        case OpCodeId::DIV:
+            return DIV(operands);
+        case OpCodeId::SMUL:
+            return SMUL(operands);
+        case OpCodeId::SDIV:
+            return SDIV(operands);
+        case OpCodeId::AND:
+            return AND(operands);
+        case OpCodeId::OR:
+            return OR(operands);
+        case OpCodeId::XOR:
+            return XOR(operands);
+        case OpCodeId::JZ:
+            return JZ(operands);
+        case OpCodeId::JNZ:
+            return JNZ(operands);
+        case OpCodeId::MOV:
+            return MOV(operands);
+        case OpCodeId::JE:
+            return JE(operands);
+        case OpCodeId::JNE:
+            return JNE(operands);
+        case OpCodeId::LOAD:
+            return LOAD(operands);
+        case OpCodeId::STOR:
+            return STOR(operands);
+        case OpCodeId::TSTB:
+            return TSTB(operands);
+        case OpCodeId::SETZ:
+            return SETZ(operands);
+        case OpCodeId::SETO:
+            return SETO(operands);
+        case OpCodeId::SET:
+            return SET(operands);
+        case OpCodeId::PUSH:
+            return PUSH(operands);
+        case OpCodeId::POP:
+            return POP(operands);
+        case OpCodeId::NOT:
+            return NOT(operands);
+        case OpCodeId::SHFR:
+            return SHFR(operands);
+        case OpCodeId::SHFL:
+            return SHFL(operands);
+        case OpCodeId::INC:
+            return INC(operands);
+        case OpCodeId::DEC:
+            return DEC(operands);
+        case OpCodeId::NOP:
+            return NOP(operands);
+        case OpCodeId::STOP:
+            return STOP(operands);
+        case OpCodeId::TRAP:
+            return TRAP(operands);
+        case OpCodeId::SWM:
+            return SWM(operands);
+        case OpCodeId::JMP:
+            return JMP(operands);
+        default:
+            break;
+    }
+    // The implementation of this OPCODE is missing in the Processor class
+    _RaiseFault(Fault::InvalidInstruction);
 }
+#endif
 
-ConstantPair Processor::_Get_RR(std::vector<std::shared_ptr<Register>> args) const
+ConstantPair Processor::_Get_RR(const InstructionOperands& args) const
 {
-    auto opA = args.at(0)->Read();
-    auto opB = args.at(1)->Read();
+    auto opA = args[0];
+    auto opB = args[1];
     return std::make_pair(opA, opB);
 }
 
-void Processor::_Base_ADD(ConstantPair values, std::shared_ptr<Register> dest)
+void Processor::_Base_ADD(ConstantPair values, uint16_t& dest)
 {
-    auto& a = values.first;
-    auto& b = values.second;
-    uint32_t result = static_cast<uint32_t>(a) + static_cast<uint32_t>(b);
-    dest->Write(static_cast<uint16_t>(result));
-
-    // Update flags
-    FlagsObject f(ReadRegister(RegisterId::RFL));
-    f.flags.Exception = 0;
-    f.flags.Zero = (static_cast<uint16_t>(result) == 0) ? 1 : 0;
-    f.flags.Negative = (static_cast<uint16_t>(result) & 0x8000) ? 1 : 0;
-    f.flags.Carry = (result > 0xffff) ? 1 : 0;
-
-    // Overflow conditions:
-    // positive + positive = negative
-    // negative + negative = positive
-    // Compare their sign bits, if they're originally same and result in
-    // different, it overflowed
-    f.flags.Overflow = (~(a ^ b) & (a ^ result) & 0x8000) ? 1 : 0;
-
-    WriteRegister(RegisterId::RFL, f.value);
+    uint32_t result = static_cast<uint32_t>(values.first) + static_cast<uint32_t>(values.second);
+    dest = static_cast<uint16_t>(result);
+    _SetPendingFlags(FlagsOperation::Add, values, result);
 }
 
-void Processor::_Base_SUB(ConstantPair values, std::shared_ptr<Register> dest)
+void Processor::_Base_SUB(ConstantPair values, uint16_t& dest)
 {
-    auto& a = values.first;
-    auto& b = values.second;
-
     int32_t result = static_cast<int32_t>(values.first) - static_cast<int32_t>(values.second);
-    dest->Write(static_cast<uint16_t>(result));
-
-    // Update flags
-    FlagsObject f(ReadRegister(RegisterId::RFL));
-    f.flags.Exception = 0;
-    f.flags.Zero = (static_cast<uint16_t>(result) == 0) ? 1 : 0;
-    f.flags.Negative = (static_cast<uint16_t>(result) & 0x8000) ? 1 : 0;
-    f.flags.Carry = (a < b) ? 1 : 0;
-
-    // Overflow conditions:
-    // positive - negative = negative
-    // negative - positive = positive
-    // Compare their sign bits, if they're originally different and result in
-    // different, it overflowed
-    f.flags.Overflow = ((a ^ b) & (a ^ result) & 0x8000) ? 1 : 0;
-
-    WriteRegister(RegisterId::RFL, f.value);
+    dest = static_cast<uint16_t>(result);
+    _SetPendingFlags(FlagsOperation::Sub, values, static_cast<uint32_t>(result));
 }
-void Processor::_Base_MUL(ConstantPair values, std::shared_ptr<Register> dest)
+
+void Processor::_Base_MUL(ConstantPair values, uint16_t& dest)
 {
     uint32_t result = static_cast<uint32_t>(values.first) * static_cast<uint32_t>(values.second);
-    dest->Write(static_cast<uint16_t>(result));
-
-    // Update flags
-    FlagsObject f(ReadRegister(RegisterId::RFL));
-    f.flags.Exception = 0;
-    f.flags.Zero = (static_cast<uint16_t>(result) == 0) ? 1 : 0;
-    f.flags.Negative = (static_cast<uint16_t>(result) & 0x8000) ? 1 : 0;
-    f.flags.Carry = (result > 0xffff) ? 1 : 0;
-    f.flags.Overflow = 0;  // Overflow doesn't apply to unsigned multiplication
-    WriteRegister(RegisterId::RFL, f.value);
+    dest = static_cast<uint16_t>(result);
+    _SetPendingFlags(FlagsOperation::Mul, values, result);
 }
 
-void Processor::_Base_SMUL(ConstantPair values, std::shared_ptr<Register> dest)
+void Processor::_Base_SMUL(ConstantPair values, uint16_t& dest)
 {
     int32_t a = static_cast<int16_t>(values.first);
     int32_t b = static_cast<int16_t>(values.second);
     int32_t result = a * b;
-    dest->Write(static_cast<uint16_t>(result));
-
-    // Update flags
-    FlagsObject f(ReadRegister(RegisterId::RFL));
-    f.flags.Exception = 0;
-    f.flags.Zero = (static_cast<uint16_t>(result) == 0) ? 1 : 0;
-    f.flags.Negative = (static_cast<uint16_t>(result) & 0x8000) ? 1 : 0;
-    // For signed multiply, set carry if result doesn't fit in 16-bit unsigned
-    f.flags.Overflow = ((result > 0x7fff) || (result < -0x8000)) ? 1 : 0;
-    // For signed, the carry doesn't mean anything different
-    f.flags.Carry = f.flags.Overflow;
-    WriteRegister(RegisterId::RFL, f.value);
+    dest = static_cast<uint16_t>(result);
+    _SetPendingFlags(FlagsOperation::SMul, values, static_cast<uint32_t>(result));
 }
 
-void Processor::_Base_DIV(ConstantPair values, std::shared_ptr<Register> dest)
+void Processor::_Base_DIV(ConstantPair values, uint16_t& dest)
 {
     if (values.second == 0)
     {
-        FlagsObject f(ReadRegister(RegisterId::RFL));
+        FlagsObject f(_Flags());
         f.flags.Exception = 1;
-        WriteRegister(RegisterId::RFL, f.value);
+        _Reg(RegisterId::RFL) = f.value;
+        _CountEvent(_counters.flagExceptions);
+        _RaiseFault(Fault::DivideByZero);
         return;
     }
     uint16_t result = values.first / values.second;
-    dest->Write(result);
-
-    // Update flags
-    FlagsObject f(ReadRegister(RegisterId::RFL));
-    f.flags.Exception = 0;
-    f.flags.Zero = (static_cast<uint16_t>(result) == 0) ? 1 : 0;
-    f.flags.Negative = (result & 0x8000) ? 1 : 0;
-    f.flags.Carry = 0;     // Division doesn't have carry
-    f.flags.Overflow = 0;  // Overflow doesn't apply to unsigned division
-    WriteRegister(RegisterId::RFL, f.value);
+    dest = result;
+    _SetPendingFlags(FlagsOperation::Div, values, result);
 }
 
-void Processor::_Base_SDIV(ConstantPair values, std::shared_ptr<Register> dest)
+void Processor::_Base_SDIV(ConstantPair values, uint16_t& dest)
 {
     int16_t a = static_cast<int16_t>(values.first);
     int16_t b = static_cast<int16_t>(values.second);
     if (b == 0)
     {
-        FlagsObject f(ReadRegister(RegisterId::RFL));
+        FlagsObject f(_Flags());
         f.flags.Exception = 1;
-        WriteRegister(RegisterId::RFL, f.value);
+        _Reg(RegisterId::RFL) = f.value;
+        _CountEvent(_counters.flagExceptions);
+        _RaiseFault(Fault::DivideByZero);
         return;
     }
-    // Check overflow: INT16_MIN / -1 overflows
     int32_t result = static_cast<int32_t>(a) / static_cast<int32_t>(b);
-    dest->Write(static_cast<uint16_t>(result));
+    dest = static_cast<uint16_t>(result);
+    _SetPendingFlags(FlagsOperation::SDiv, values, static_cast<uint32_t>(result));
+}
 
-    FlagsObject f(ReadRegister(RegisterId::RFL));
+uint16_t Processor::_EvaluateFlags() const
+{
+    FlagsObject f(_Reg(RegisterId::RFL));
+    if (_pendingFlags.operation == FlagsOperation::None)
+    {
+        return f.value;
+    }
+
+    const uint16_t a = _pendingFlags.a;
+    const uint16_t b = _pendingFlags.b;
+    const uint32_t result = _pendingFlags.result;
     f.flags.Exception = 0;
     f.flags.Zero = (static_cast<uint16_t>(result) == 0) ? 1 : 0;
     f.flags.Negative = (static_cast<uint16_t>(result) & 0x8000) ? 1 : 0;
-    f.flags.Carry = 0;
-    // -32768 / -1 = 32768 which doesn't fit in int16, so it overflows
-    f.flags.Overflow = (a == INT16_MIN && b == -1) ? 1 : 0;
-    WriteRegister(RegisterId::RFL, f.value);
+
+    switch (_pendingFlags.operation)
+    {
+        case FlagsOperation::Add:
+            f.flags.Carry = (result > 0xffff) ? 1 : 0;
+            // Overflow conditions:
+            // positive + positive = negative
+            // negative + negative = positive
+            // Compare their sign bits, if they're originally same and result in
+            // different, it overflowed
+            f.flags.Overflow = (~(a ^ b) & (a ^ result) & 0x8000) ? 1 : 0;
+            break;
+        case FlagsOperation::Sub:
+            f.flags.Carry = (a < b) ? 1 : 0;
+            // Overflow conditions:
+            // positive - negative = negative
+            // negative - positive = positive
+            // Compare their sign bits, if they're originally different and result in
+            // different, it overflowed
+            f.flags.Overflow = ((a ^ b) & (a ^ result) & 0x8000) ? 1 : 0;
+            break;
+        case FlagsOperation::Mul:
+            f.flags.Carry = (result > 0xffff) ? 1 : 0;
+            f.flags.Overflow = 0;  // Overflow doesn't apply to unsigned multiplication
+            break;
+        case FlagsOperation::SMul:
+        {
+            // For signed multiply, set carry if result doesn't fit in 16-bit unsigned
+            const int32_t signedResult = static_cast<int32_t>(result);
+            f.flags.Overflow = ((signedResult > 0x7fff) || (signedResult < -0x8000)) ? 1 : 0;
+            // For signed, the carry doesn't mean anything different
+            f.flags.Carry = f.flags.Overflow;
+            break;
+        }
+        case FlagsOperation::Div:
+            f.flags.Carry = 0;     // Division doesn't have carry
+            f.flags.Overflow = 0;  // Overflow doesn't apply to unsigned division
+            break;
+        case FlagsOperation::SDiv:
+            f.flags.Carry = 0;
+            // -32768 / -1 = 32768 which doesn't fit in int16, so it overflows
+            f.flags.Overflow = (a == 0x8000 && b == 0xffff) ? 1 : 0;
+            break;
+        case FlagsOperation::None:
+            break;
+    }
+    return f.value;
+}
+
+uint16_t& Processor::_Flags()
+{
+    auto& rfl = _Reg(RegisterId::RFL);
+    rfl = _EvaluateFlags();
+    _pendingFlags.operation = FlagsOperation::None;
+    return rfl;
 }
-void Processor::_Base_AND(ConstantPair values, std::shared_ptr<Register> dest)
+
+void Processor::_Base_AND(ConstantPair values, uint16_t& dest)
 {
-    dest->Write(values.first & values.second);
+    dest = values.first & values.second;
 }
-void Processor::_Base_OR(ConstantPair values, std::shared_ptr<Register> dest)
+void Processor::_Base_OR(ConstantPair values, uint16_t& dest)
 {
-    dest->Write(values.first | values.second);
+    dest = values.first | values.second;
 }
-void Processor::_Base_XOR(ConstantPair values, std::shared_ptr<Register> dest)
+void Processor::_Base_XOR(ConstantPair values, uint16_t& dest)
 {
-    dest->Write(values.first ^ values.second);
+    dest = values.first ^ values.second;
 }
 void Processor::_Base_JZ(ConstantPair values)
 {
     if (0 == values.first)
     {
-        WriteRegister(RegisterId::RIP, values.second);
+        _Reg(RegisterId::RIP) = values.second;
     }
 }
 void Processor::_Base_JNZ(ConstantPair values)
 {
     if (0x0 != values.first)
     {
-        WriteRegister(RegisterId::RIP, values.second);
+        _Reg(RegisterId::RIP) = values.second;
     }
 }
 
-void Processor::ADD(std::vector<std::shared_ptr<Register>> args)
+void Processor::ADD(const InstructionOperands& args)
 {
     auto vals = _Get_RR(args);
-    _Base_ADD(vals, args.at(2));
+    _Base_ADD(vals, args[2]);
 }
-void Processor::SUB(std::vector<std::shared_ptr<Register>> args)
+void Processor::SUB(const InstructionOperands& args)
 {
     auto vals = _Get_RR(args);
-    _Base_SUB(vals, args.at(2));
+    _Base_SUB(vals, args[2]);
 }
-void Processor::MUL(std::vector<std::shared_ptr<Register>> args)
+void Processor::MUL(const InstructionOperands& args)
 {
     auto vals = _Get_RR(args);
-    _Base_MUL(vals, args.at(2));
+    _Base_MUL(vals, args[2]);
 }
-void Processor::SMUL(std::vector<std::shared_ptr<Register>> args)
+void Processor::SMUL(const InstructionOperands& args)
 {
     auto vals = _Get_RR(args);
-    _Base_SMUL(vals, args.at(2));
+    _Base_SMUL(vals, args[2]);
 }
-void Processor::DIV(std::vector<std::shared_ptr<Register>> args)
+void Processor::DIV(const InstructionOperands& args)
 {
     auto vals = _Get_RR(args);
-    _Base_DIV(vals, args.at(2));
+    _Base_DIV(vals, args[2]);
 }
-void Processor::SDIV(std::vector<std::shared_ptr<Register>> args)
+void Processor::SDIV(const InstructionOperands& args)
 {
     auto vals = _Get_RR(args);
-    _Base_SDIV(vals, args.at(2));
+    _Base_SDIV(vals, args[2]);
 }
-void Processor::AND(std::vector<std::shared_ptr<Register>> args)
+void Processor::AND(const InstructionOperands& args)
 {
     auto vals = _Get_RR(args);
-    _Base_AND(vals, args.at(2));
+    _Base_AND(vals, args[2]);
 }
-void Processor::OR(std::vector<std::shared_ptr<Register>> args)
+void Processor::OR(const InstructionOperands& args)
 {
     auto vals = _Get_RR(args);
-    _Base_OR(vals, args.at(2));
+    _Base_OR(vals, args[2]);
 }
-void Processor::XOR(std::vector<std::shared_ptr<Register>> args)
+void Processor::XOR(const InstructionOperands& args)
 {
     auto vals = _Get_RR(args);
-    _Base_XOR(vals, args.at(2));
+    _Base_XOR(vals, args[2]);
 }
-void Processor::JZ(std::vector<std::shared_ptr<Register>> args)
+void Processor::JZ(const InstructionOperands& args)
 {
     auto vals = _Get_RR(args);
     _Base_JZ(vals);
 }
-void Processor::JNZ(std::vector<std::shared_ptr<Register>> args)
+void Processor::JNZ(const InstructionOperands& args)
 {
     auto vals = _Get_RR(args);
     _Base_JNZ(vals);
 }
-void Processor::JE(std::vector<std::shared_ptr<Register>> args)
+void Processor::JE(const InstructionOperands& args)
 {
     auto vals = _Get_RR(args);
-    if (vals.first == _registers.at(RegisterId::RAC).Read())
+    if (vals.first == _Reg(RegisterId::RAC))
     {
-        WriteRegister(RegisterId::RIP, vals.second);
+        _Reg(RegisterId::RIP) = vals.second;
     }
 }
-void Processor::JNE(std::vector<std::shared_ptr<Register>> args)
+void Processor::JNE(const InstructionOperands& args)
 {
     auto vals = _Get_RR(args);
-    if (vals.first != _registers.at(RegisterId::RAC).Read())
+    if (vals.first != _Reg(RegisterId::RAC))
     {
-        WriteRegister(RegisterId::RIP, vals.second);
+        _Reg(RegisterId::RIP) = vals.second;
     }
 }
-void Processor::MOV(std::vector<std::shared_ptr<Register>> args)
+void Processor::MOV(const InstructionOperands& args)
 {
-    auto opA = args.at(0)->Read();
-    auto opB = args.at(1);
-    opB->Write(opA);
+    auto opA = args[0];
+    auto& opB = args[1];
+    opB = opA;
 }
-void Processor::LOAD(std::vector<std::shared_ptr<Register>> args)
+void Processor::LOAD(const InstructionOperands& args)
 {
-    auto addressReg = args.at(0);
-    auto destReg = args.at(1);
-    uint16_t address = addressReg->Read();
-    uint16_t value = _mainMemory->Read16(address);
-    destReg->Write(value);
+    auto& addressReg = args[0];
+    auto& destReg = args[1];
+    uint16_t address = addressReg;
+    uint16_t value;
+    if (!_bus.TryRead16(*_mainMemory, address, value))
+    {
+        _RaiseFault(Fault::AddressOutOfRange);
+        return;
+    }
+    _CountEvent(_counters.loads[_SelectedBank()]);
+    destReg = value;
 }
-void Processor::STOR(std::vector<std::shared_ptr<Register>> args)
+void Processor::STOR(const InstructionOperands& args)
 {
-    auto srcReg = args.at(0);
-    auto addressReg = args.at(1);
-    uint16_t value = srcReg->Read();
-    uint16_t address = addressReg->Read();
-    _mainMemory->Write16(address, value);
+    auto& srcReg = args[0];
+    auto& addressReg = args[1];
+    uint16_t value = srcReg;
+    uint16_t address = addressReg;
+    if (!_bus.TryWrite16(*_mainMemory, address, value))
+    {
+        _RaiseFault(Fault::AddressOutOfRange);
+        return;
+    }
+    _TraceStore(address, value);
+    _CountEvent(_counters.stores[_SelectedBank()]);
 }
-void Processor::TSTB(std::vector<std::shared_ptr<Register>> args)
+void Processor::TSTB(const InstructionOperands& args)
 {
-    auto opA = args.at(0)->Read();
-    auto opB = args.at(1)->Read();
+    auto opA = args[0];
+    auto opB = args[1];
     bool isBitOn = opB & (1 << opA);
-    FlagsObject f(ReadRegister(RegisterId::RFL));
+    FlagsObject f(_Flags());
     f.flags.Zero = (isBitOn) ? 1 : 0;
-    WriteRegister(RegisterId::RFL, f.value);
+    _Reg(RegisterId::RFL) = f.value;
 }
-void Processor::SETZ(std::vector<std::shared_ptr<Register>> args)
+void Processor::SETZ(const InstructionOperands& args)
 {
-    auto opA = args.at(0);
-    opA->Write(0x0);
+    auto& opA = args[0];
+    opA = 0x0;
 }
-void Processor::SETO(std::vector<std::shared_ptr<Register>> args)
+void Processor::SETO(const InstructionOperands& args)
 {
-    auto opA = args.at(0);
-    opA->Write(0xffff);
+    auto& opA = args[0];
+    opA = 0xffff;
 }
-void Processor::SET(std::vector<std::shared_ptr<Register>> args)
+void Processor::SET(const InstructionOperands& args)
 {
-    auto opA = args.at(0);
-    opA->Write(_2wordOperand);
+    auto& opA = args[0];
+    opA = _2wordOperand;
 }
-void Processor::PUSH(std::vector<std::shared_ptr<Register>> args)
+void Processor::PUSH(const InstructionOperands& args)
 {
-    auto opA = args.at(0);
-    auto& RSP = _registers.at(RegisterId::RSP);
-    _DereferenceRegisterWrite(RSP.registerId, opA->Read());
-
-    RSP.Write(RSP.Read() + 2);
+    auto& opA = args[0];
+    auto& RSP = _Reg(RegisterId::RSP);
+    if (_DereferenceRegisterWrite(RegisterId::RSP, opA))
+    {
+        RSP += 2;
+        _CountEvent(_counters.pushes);
+    }
 }
-void Processor::POP(std::vector<std::shared_ptr<Register>> args)
+void Processor::POP(const InstructionOperands& args)
 {
-    auto opA = args.at(0);
-    auto& RSP = _registers.at(RegisterId::RSP);
-    RSP.Write(RSP.Read() - 2);
+    auto& opA = args[0];
+    auto& RSP = _Reg(RegisterId::RSP);
+    RSP -= 2;
 
-    opA->Write(_DereferenceRegisterRead(RSP.registerId));
+    uint16_t value;
+    if (!_DereferenceRegisterRead(RegisterId::RSP, value))
+    {
+        RSP += 2;
+        return;
+    }
+    _CountEvent(_counters.pops);
+    opA = value;
 }
-void Processor::NOT(std::vector<std::shared_ptr<Register>> args)
+void Processor::NOT(const InstructionOperands& args)
 {
-    auto opA = args.at(0);
-    opA->Write(~(opA->Read()));
+    auto& opA = args[0];
+    opA = ~opA;
 }
-void Processor::SHFR(std::vector<std::shared_ptr<Register>> args)
+void Processor::SHFR(const InstructionOperands& args)
 {
-    auto opA = args.at(0);
-    opA->Write(opA->Read() >> 1);
+    auto& opA = args[0];
+    opA >>= 1;
 }
-void Processor::SHFL(std::vector<std::shared_ptr<Register>> args)
+void Processor::SHFL(const InstructionOperands& args)
 {
-    auto opA = args.at(0);
-    opA->Write(opA->Read() << 1);
+    auto& opA = args[0];
+    opA <<= 1;
 }
-void Processor::INC(std::vector<std::shared_ptr<Register>> args)
+void Processor::INC(const InstructionOperands& args)
 {
-    auto opA = args.at(0);
-    opA->Write(opA->Read() + 1);
+    auto& opA = args[0];
+    ++opA;
 }
-void Processor::DEC(std::vector<std::shared_ptr<Register>> args)
+void Processor::DEC(const InstructionOperands& args)
 {
-    auto opA = args.at(0);
-    opA->Write(opA->Read() - 1);
+    auto& opA = args[0];
+    --opA;
 }
-void Processor::NOP(std::vector<std::shared_ptr<Register>> args) {}
-void Processor::STOP(std::vector<std::shared_ptr<Register>> args)
+void Processor::NOP(const InstructionOperands& args) {}
+void Processor::STOP(const InstructionOperands& args)
 {
     // args is not really used, but works for our table of ptrs to funcs.
     _instructionStatus = InstructionCycle::Halted;
 }
-void Processor::TRAP(std::vector<std::shared_ptr<Register>> args)
+void Processor::TRAP(const InstructionOperands& args)
 {
-    FlagsObject f(ReadRegister(RegisterId::RFL));
+    FlagsObject f(_Flags());
     f.flags.Trap = 1;
-    WriteRegister(RegisterId::RFL, f.value);
+    _Reg(RegisterId::RFL) = f.value;
 }
 
-void Processor::SWM(std::vector<std::shared_ptr<Register>> args)
+void Processor::SWM(const InstructionOperands& args)
 {
-    FlagsObject f(ReadRegister(RegisterId::RFL));
+    FlagsObject f(_Flags());
+    if (f.flags.Memory == 0 && _nvram == nullptr)
+    {
+        _RaiseFault(Fault::NVRamUnavailable);
+        return;
+    }
     f.flags.Memory ^= 1;  // Flip the bit
-    WriteRegister(RegisterId::RFL, f.value);
+    _Reg(RegisterId::RFL) = f.value;
 
     if (0 == f.flags.Memory)
     {
@@ -536,74 +1238,17 @@ void Processor::SWM(std::vector<std::shared_ptr<Register>> args)
     }
     else
     {
-        if (_nvram == nullptr)
-        {
-            throw std::runtime_error("Trying to use NVRAM, but it was not prepared on this setup.");
-        }
         _mainMemory = _nvram;
     }
 }
 
-void Processor::JMP(std::vector<std::shared_ptr<Register>> args)
+void Processor::JMP(const InstructionOperands& args)
 {
-    WriteRegister(RegisterId::RIP, _2wordOperand);
+    _Reg(RegisterId::RIP) = _2wordOperand;
 }
 
 // Helper function to convert binary instruction to assembly string
 std::string Processor::_InstructionToString(uint16_t instruction) const
 {
-    // First, we need to determine the opcode
-    OpCodeId opcodeId = OpCodeId::INVALID_INSTR;
-
-    // Check for the longest match
-    // Try to find the opcode by checking different bit positions
-    for (uint16_t mask = 0xffff; mask > 0; mask <<= 1)
-    {
-        uint16_t opCodeValue = instruction & mask;
-        auto shiftCount = std::countr_zero(mask);
-        opCodeValue >>= shiftCount;
-        if (opCodeValuesTable.count(opCodeValue) > 0)
-        {
-            opcodeId = opCodeValuesTable.at(opCodeValue);
-            break;
-        }
-    }
-
-    if (opcodeId == OpCodeId::INVALID_INSTR)
-    {
-        return "UNKNOWN_INSTR";
-    }
-
-    // Get the opcode information
-    const OpCode& opCodeInfo = opCodeTable.at(opcodeId);
-    std::string result = opCodeMnemonicTable.at(opcodeId);
-
-    // Add arguments
-    if (opCodeInfo.argCount > 0)
-    {
-        result += " ";
-
-        // Special handling for SET and SET_M instructions which have a literal
-        if (opcodeId == OpCodeId::SET)
-        {
-            // For SET instructions, we get the literal value from the next word
-            // We're going to put a VALUE placeholder for now
-            result += "VALUE";
-        }
-        else
-        {
-            for (int i = 0; i < opCodeInfo.argCount; ++i)
-            {
-                if (i > 0)
-                {
-                    result += ", ";
-                }
-
-                uint16_t regValue = (instruction >> (4 * (opCodeInfo.argCount - 1 - i))) & 0xf;
-                result += registerNameTable.at(regValue);
-            }
-        }
-    }
-
-    return result;
-}
\ No newline at end of file
+    return Disassembler::InstructionToString(instruction);
+}
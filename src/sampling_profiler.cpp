@@ -0,0 +1,103 @@
+#include "sampling_profiler.h"
+
+namespace
+{
+std::string LineName(const DebugLineTable& lines, uint16_t address)
+{
+    const unsigned line = lines.LineAt(address);
+    if (line == 0)
+    {
+        std::ostringstream name;
+        name << "h'" << std::hex << std::setw(4) << std::setfill('0') << address;
+        return name.str();
+    }
+    return "line " + std::to_string(line);
+}
+
+std::string TagName(const DebugLineTable& lines, uint16_t address)
+{
+    const std::string tag = lines.TagAt(address);
+    return tag.empty() ? "_start" : tag;
+}
+
+// Most samples first, by name after that so reports are stable
+std::vector<std::pair<std::string, uint64_t>> Sorted(const std::map<std::string, uint64_t>& counts)
+{
+    std::vector<std::pair<std::string, uint64_t>> sorted(counts.begin(), counts.end());
+    std::stable_sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+        return a.second > b.second;
+    });
+    return sorted;
+}
+}  // namespace
+
+SamplingProfiler::SamplingProfiler(Processor& cpu, uint64_t period) : _cpu(cpu), _period(period)
+{
+    if (_period == 0)
+    {
+        throw std::invalid_argument("The sampling period has to be at least one instruction");
+    }
+    _Arm(_cpu.GetInstructionCount());
+}
+
+SamplingProfiler::~SamplingProfiler()
+{
+    if (_event)
+    {
+        _cpu.GetScheduler().Cancel(*_event);
+    }
+}
+
+void SamplingProfiler::_Arm(uint64_t now)
+{
+    _event =
+        _cpu.GetScheduler().Schedule(now + _period, [this](uint64_t cycle) { _Sample(cycle); });
+}
+
+void SamplingProfiler::_Sample(uint64_t cycle)
+{
+    ++_samples[_cpu.ReadRegister(RegisterId::RIP)];
+    ++_sampleCount;
+    _Arm(cycle);
+}
+
+std::string SamplingProfiler::Report(const DebugLineTable& lines, size_t limit) const
+{
+    std::map<std::string, uint64_t> byLine;
+    std::map<std::string, uint64_t> byTag;
+    for (const auto& [address, count] : _samples)
+    {
+        byLine[LineName(lines, address) + " in " + TagName(lines, address)] += count;
+        byTag[TagName(lines, address)] += count;
+    }
+
+    std::ostringstream out;
+    out << _sampleCount << " samples, one every " << _period << " instructions\n";
+    for (const auto& [title, counts] :
+         {std::pair{"Lines:\n", &byLine}, std::pair{"Tags:\n", &byTag}})
+    {
+        out << title;
+        const auto sorted = Sorted(*counts);
+        for (size_t i = 0; i < std::min(limit, sorted.size()); ++i)
+        {
+            const double share = 100.0 * static_cast<double>(sorted[i].second) /
+                                 static_cast<double>(std::max<uint64_t>(_sampleCount, 1));
+            out << std::setw(12) << sorted[i].second << std::setw(7) << std::fixed
+                << std::setprecision(1) << share << "% " << sorted[i].first << '\n';
+        }
+    }
+    return out.str();
+}
+
+void SamplingProfiler::WriteFoldedStacks(std::ostream& out, const DebugLineTable& lines) const
+{
+    std::map<std::string, uint64_t> stacks;
+    for (const auto& [address, count] : _samples)
+    {
+        stacks[TagName(lines, address) + ";" + LineName(lines, address)] += count;
+    }
+    for (const auto& [stack, count] : stacks)
+    {
+        out << stack << ' ' << count << '\n';
+    }
+}
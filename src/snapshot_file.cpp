@@ -0,0 +1,266 @@
+#include "snapshot_file.h"
+
+namespace
+{
+constexpr std::array<char, 4> Magic = {'L', 'X', 'S', 'N'};
+constexpr size_t PageSize = Memory16::PageSize;
+
+// Bytes of SRAM in page, the last one may be short
+size_t PageBytes(size_t sramSize, size_t page)
+{
+    return std::min(PageSize, sramSize - page * PageSize);
+}
+
+template <typename T>
+void Put(std::ostream& out, T value)
+{
+    for (size_t i = sizeof(T); i-- > 0;)
+    {
+        out.put(static_cast<char>((static_cast<uint64_t>(value) >> (i * 8)) & 0xff));
+    }
+}
+
+template <typename T>
+T Get(std::istream& in)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < sizeof(T); ++i)
+    {
+        const int byte = in.get();
+        if (byte == std::char_traits<char>::eof())
+        {
+            throw std::runtime_error("Snapshot is truncated");
+        }
+        value = (value << 8) | static_cast<uint8_t>(byte);
+    }
+    return static_cast<T>(value);
+}
+// Every event count of PerfCounters, in the order they are stored
+template <typename TCounters, typename TFunction>
+void ForEachCounter(TCounters& counters, TFunction function)
+{
+    for (auto& count : counters.retired)
+    {
+        function(count);
+    }
+    function(counters.branchesTaken);
+    function(counters.branchesNotTaken);
+    for (size_t bank = 0; bank < PerfCounters::BankCount; ++bank)
+    {
+        function(counters.loads[bank]);
+        function(counters.stores[bank]);
+    }
+    function(counters.pushes);
+    function(counters.pops);
+    function(counters.flagExceptions);
+}
+}  // namespace
+
+void SnapshotFile::Write(std::ostream& out, const ProcessorSnapshot& snapshot)
+{
+    out.write(Magic.data(), Magic.size());
+    Put<uint16_t>(out, Version);
+
+    for (uint16_t value : snapshot.registers)
+    {
+        Put<uint16_t>(out, value);
+    }
+    Put<uint8_t>(out, snapshot.nvramSelected ? 1 : 0);
+    Put<uint64_t>(out, snapshot.instructionCount);
+    Put<uint8_t>(out, snapshot.stoppedAtBreakpoint ? 1 : 0);
+    Put<uint16_t>(out, snapshot.stoppedAtBreakpoint.value_or(0));
+
+    Put<uint8_t>(out, static_cast<uint8_t>(snapshot.instructionStatus));
+    Put<uint8_t>(out, static_cast<uint8_t>(snapshot.decodedOpCodeId));
+    Put<uint16_t>(out, snapshot.literalValue);
+    Put<uint16_t>(out, snapshot.fetchedInstruction);
+    for (RegisterId arg : snapshot.instructionArgs)
+    {
+        Put<uint8_t>(out, static_cast<uint8_t>(arg));
+    }
+    Put<uint8_t>(out, snapshot.instructionArgCount);
+    Put<uint16_t>(out, snapshot.twoWordOperand);
+    Put<uint8_t>(out, snapshot.interruptPending ? 1 : 0);
+    Put<uint8_t>(out, static_cast<uint8_t>(snapshot.fault));
+    Put<uint32_t>(out, static_cast<uint32_t>(snapshot.ownedEvents.size()));
+    for (const auto& [owner, distance] : snapshot.ownedEvents)
+    {
+        Put<uint32_t>(out, owner);
+        Put<uint64_t>(out, distance);
+    }
+
+    Put<uint64_t>(out, snapshot.idleInstructionCount);
+    // Only the ones that counted anything, by their index in ForEachCounter() order
+    std::vector<std::pair<uint16_t, uint64_t>> counts;
+    ForEachCounter(snapshot.counters, [&counts, index = uint16_t{0}](uint64_t count) mutable {
+        if (count != 0)
+        {
+            counts.emplace_back(index, count);
+        }
+        ++index;
+    });
+    Put<uint16_t>(out, static_cast<uint16_t>(counts.size()));
+    for (const auto& [index, count] : counts)
+    {
+        Put<uint16_t>(out, index);
+        Put<uint64_t>(out, count);
+    }
+
+    std::vector<uint8_t> sram(snapshot.sram.Size());
+    snapshot.sram.ReadRange(0, sram.data(), sram.size());
+    std::vector<uint16_t> pages;
+    for (size_t page = 0; page * PageSize < sram.size(); ++page)
+    {
+        const auto first = sram.begin() + static_cast<std::ptrdiff_t>(page * PageSize);
+        const auto last = first + static_cast<std::ptrdiff_t>(PageBytes(sram.size(), page));
+        if (std::any_of(first, last, [](uint8_t b) { return b != 0; }))
+        {
+            pages.push_back(static_cast<uint16_t>(page));
+        }
+    }
+    Put<uint32_t>(out, static_cast<uint32_t>(sram.size()));
+    Put<uint32_t>(out, static_cast<uint32_t>(pages.size()));
+    for (uint16_t page : pages)
+    {
+        Put<uint16_t>(out, page);
+        out.write(reinterpret_cast<const char*>(sram.data() + page * PageSize),
+                  static_cast<std::streamsize>(PageBytes(sram.size(), page)));
+    }
+}
+
+ProcessorSnapshot SnapshotFile::Read(std::istream& in)
+{
+    std::array<char, 4> magic{};
+    in.read(magic.data(), magic.size());
+    if (!in || magic != Magic)
+    {
+        throw std::runtime_error("Not a processor snapshot");
+    }
+    const auto version = Get<uint16_t>(in);
+    if (version != Version)
+    {
+        throw std::runtime_error("Unsupported snapshot version " + std::to_string(version));
+    }
+
+    ProcessorSnapshot snapshot;
+    for (uint16_t& value : snapshot.registers)
+    {
+        value = Get<uint16_t>(in);
+    }
+    snapshot.nvramSelected = Get<uint8_t>(in) != 0;
+    snapshot.instructionCount = Get<uint64_t>(in);
+    const bool stoppedAtBreakpoint = Get<uint8_t>(in) != 0;
+    const auto breakpoint = Get<uint16_t>(in);
+    if (stoppedAtBreakpoint)
+    {
+        snapshot.stoppedAtBreakpoint = breakpoint;
+    }
+
+    const auto instructionStatus = Get<uint8_t>(in);
+    if (instructionStatus > static_cast<uint8_t>(InstructionCycle::Halted))
+    {
+        throw std::runtime_error("Snapshot has an invalid instruction cycle");
+    }
+    snapshot.instructionStatus = static_cast<InstructionCycle>(instructionStatus);
+    const auto decodedOpCodeId = Get<uint8_t>(in);
+    if (decodedOpCodeId > static_cast<uint8_t>(OpCodeId::INVALID_INSTR))
+    {
+        throw std::runtime_error("Snapshot has an invalid opcode");
+    }
+    snapshot.decodedOpCodeId = static_cast<OpCodeId>(decodedOpCodeId);
+    snapshot.literalValue = Get<uint16_t>(in);
+    snapshot.fetchedInstruction = Get<uint16_t>(in);
+    for (RegisterId& arg : snapshot.instructionArgs)
+    {
+        const auto id = Get<uint8_t>(in);
+        if (id >= static_cast<uint8_t>(RegisterId::END_OF_REGLIST))
+        {
+            throw std::runtime_error("Snapshot has an invalid register id");
+        }
+        arg = static_cast<RegisterId>(id);
+    }
+    snapshot.instructionArgCount = Get<uint8_t>(in);
+    if (snapshot.instructionArgCount > snapshot.instructionArgs.size())
+    {
+        throw std::runtime_error("Snapshot has an invalid operand count");
+    }
+    snapshot.twoWordOperand = Get<uint16_t>(in);
+    snapshot.interruptPending = Get<uint8_t>(in) != 0;
+    const auto fault = Get<uint8_t>(in);
+    if (fault >= static_cast<uint8_t>(Fault::END_OF_FAULTS))
+    {
+        throw std::runtime_error("Snapshot has an invalid fault");
+    }
+    snapshot.fault = static_cast<Fault>(fault);
+    const auto eventCount = Get<uint32_t>(in);
+    for (uint32_t i = 0; i < eventCount; ++i)
+    {
+        const auto owner = Get<uint32_t>(in);
+        snapshot.ownedEvents.emplace_back(owner, Get<uint64_t>(in));
+    }
+
+    snapshot.idleInstructionCount = Get<uint64_t>(in);
+    if (snapshot.idleInstructionCount > snapshot.instructionCount)
+    {
+        throw std::runtime_error("Snapshot has more idle instructions than instructions");
+    }
+    std::vector<uint64_t*> counters;
+    ForEachCounter(snapshot.counters, [&counters](uint64_t& count) { counters.push_back(&count); });
+    const auto counterCount = Get<uint16_t>(in);
+    for (uint16_t i = 0; i < counterCount; ++i)
+    {
+        const auto index = Get<uint16_t>(in);
+        if (index >= counters.size())
+        {
+            throw std::runtime_error("Snapshot has an invalid performance counter");
+        }
+        *counters[index] = Get<uint64_t>(in);
+    }
+
+    const auto sramSize = Get<uint32_t>(in);
+    const auto pageCount = Get<uint32_t>(in);
+    if (sramSize > MainMemorySize)
+    {
+        throw std::runtime_error("Snapshot SRAM is too big");
+    }
+    snapshot.sram = Memory16(sramSize);
+    std::vector<char> bytes(PageSize);
+    std::optional<uint16_t> lastPage;
+    for (uint32_t i = 0; i < pageCount; ++i)
+    {
+        const auto page = Get<uint16_t>(in);
+        if (size_t{page} * PageSize >= sramSize || (lastPage && page <= *lastPage))
+        {
+            throw std::runtime_error("Snapshot has an invalid SRAM page");
+        }
+        lastPage = page;
+        const size_t size = PageBytes(sramSize, page);
+        in.read(bytes.data(), static_cast<std::streamsize>(size));
+        if (static_cast<size_t>(in.gcount()) != size)
+        {
+            throw std::runtime_error("Snapshot is truncated");
+        }
+        snapshot.sram.WritePayload(static_cast<uint16_t>(page * PageSize), bytes.data(), size);
+    }
+    return snapshot;
+}
+
+void SnapshotFile::Save(const std::string& path, const ProcessorSnapshot& snapshot)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("Could not open " + path);
+    }
+    Write(file, snapshot);
+}
+
+ProcessorSnapshot SnapshotFile::Load(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("Could not open " + path);
+    }
+    return Read(file);
+}
@@ -0,0 +1,95 @@
+#include "timer_device.h"
+
+TimerDevice::TimerDevice(Processor& cpu) : _cpu(cpu)
+{
+    _owner = _cpu.GetScheduler().AddOwner([this](std::optional<uint64_t> cycle) {
+        // Counting down or not, like when the snapshot was taken
+        _Disarm();
+        if (cycle)
+        {
+            _control |= ControlEnable;
+            _Arm(*cycle);
+        }
+        else
+        {
+            _control &= ~ControlEnable;
+        }
+    });
+}
+
+TimerDevice::~TimerDevice()
+{
+    _Disarm();
+    _cpu.GetScheduler().RemoveOwner(_owner);
+}
+
+uint16_t TimerDevice::Read16(uint16_t offset)
+{
+    switch (offset)
+    {
+        case PeriodRegister:
+            return _period;
+        case ControlRegister:
+            return _control;
+        case StatusRegister:
+            return std::exchange(_expiries, 0);
+        default:
+            return 0;
+    }
+}
+
+void TimerDevice::Write16(uint16_t offset, uint16_t value)
+{
+    switch (offset)
+    {
+        case PeriodRegister:
+            _period = value;
+            break;
+        case ControlRegister:
+            _control = value;
+            _Disarm();
+            if ((_control & ControlEnable) != 0 && _period > 0)
+            {
+                _Arm(_cpu.GetInstructionCount() + _period);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void TimerDevice::_Arm(uint64_t due)
+{
+    _event = _cpu.GetScheduler().Schedule(due, [this](uint64_t cycle) { _Expire(cycle); }, _owner);
+}
+
+void TimerDevice::_Disarm()
+{
+    if (_event)
+    {
+        _cpu.GetScheduler().Cancel(*_event);
+        _event.reset();
+    }
+}
+
+void TimerDevice::_Expire(uint64_t cycle)
+{
+    _event.reset();
+    if (_expiries < 0xffff)
+    {
+        ++_expiries;
+    }
+    if ((_control & ControlInterrupt) != 0)
+    {
+        _cpu.RaiseInterrupt();
+    }
+    if ((_control & ControlPeriodic) != 0)
+    {
+        // From when it was due, so a late check doesn't make the timer drift
+        _Arm(cycle + _period);
+    }
+    else
+    {
+        _control &= ~ControlEnable;
+    }
+}
@@ -0,0 +1,211 @@
+#include "trace_format.h"
+
+namespace
+{
+enum RecordFlags : uint8_t
+{
+    RipJumped = 0x01,
+    RegistersChanged = 0x02,
+    MemoryWritten = 0x04,
+};
+constexpr size_t RIP = static_cast<size_t>(RegisterId::RIP);
+
+bool HasLiteral(uint16_t instruction)
+{
+    return decodeTable[instruction].hasLiteral;
+}
+
+uint16_t NextRip(uint16_t rip, uint16_t instruction)
+{
+    return static_cast<uint16_t>(rip + (HasLiteral(instruction) ? 4 : 2));
+}
+
+void PutWord(std::vector<uint8_t>& out, uint16_t word)
+{
+    out.push_back(static_cast<uint8_t>(word >> 8));
+    out.push_back(static_cast<uint8_t>(word & 0xff));
+}
+
+void PutVarint(std::vector<uint8_t>& out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+// Differences wrap around like the guest's registers, the shortest way round is the one stored
+uint64_t ZigZag(uint16_t from, uint16_t to)
+{
+    const auto delta = static_cast<int16_t>(static_cast<uint16_t>(to - from));
+    return (static_cast<uint64_t>(static_cast<int64_t>(delta)) << 1) ^
+           static_cast<uint64_t>(static_cast<int64_t>(delta) >> 63);
+}
+
+uint16_t UnZigZag(uint16_t from, uint64_t encoded)
+{
+    const auto delta = static_cast<int64_t>(encoded >> 1) ^ -static_cast<int64_t>(encoded & 1);
+    return static_cast<uint16_t>(from + static_cast<uint16_t>(delta));
+}
+}  // namespace
+
+TraceEncoder::TraceEncoder(const TraceRegisters& registers, std::vector<uint8_t>& out)
+    : _registers(registers), _expectedRip(registers[RIP])
+{
+    out.insert(out.end(), Magic.begin(), Magic.end());
+    out.push_back(Version);
+    for (uint16_t value : registers)
+    {
+        PutWord(out, value);
+    }
+}
+
+void TraceEncoder::AddInstruction(uint16_t rip,
+                                  uint16_t instruction,
+                                  uint16_t literal,
+                                  const TraceRegisters& registers,
+                                  std::vector<uint8_t>& out)
+{
+    const size_t flagsAt = out.size();
+    uint8_t flags = 0;
+    out.push_back(0);
+    if (rip != _expectedRip)
+    {
+        flags |= RipJumped;
+        PutVarint(out, ZigZag(_expectedRip, rip));
+    }
+    PutWord(out, instruction);
+    if (HasLiteral(instruction))
+    {
+        PutWord(out, literal);
+    }
+
+    size_t changed = 0;
+    for (size_t reg = 0; reg < registers.size(); ++reg)
+    {
+        changed += (reg != RIP && registers[reg] != _registers[reg]);
+    }
+    if (changed > 0)
+    {
+        flags |= RegistersChanged;
+        PutVarint(out, changed);
+        for (size_t reg = 0; reg < registers.size(); ++reg)
+        {
+            if (reg != RIP && registers[reg] != _registers[reg])
+            {
+                out.push_back(static_cast<uint8_t>(reg));
+                PutVarint(out, ZigZag(_registers[reg], registers[reg]));
+            }
+        }
+    }
+    if (!_stores.empty())
+    {
+        flags |= MemoryWritten;
+        PutVarint(out, _stores.size());
+        for (const auto& [address, value] : _stores)
+        {
+            PutVarint(out, ZigZag(_lastStore, address));
+            PutWord(out, value);
+            _lastStore = address;
+        }
+        _stores.clear();
+    }
+    out[flagsAt] = flags;
+
+    _registers = registers;
+    _expectedRip = NextRip(rip, instruction);
+}
+
+TraceDecoder::TraceDecoder(std::istream& in) : _in(in)
+{
+    std::array<char, 4> magic{};
+    _in.read(magic.data(), magic.size());
+    if (!_in || magic != TraceEncoder::Magic || _Byte() != TraceEncoder::Version)
+    {
+        throw std::runtime_error("Not a trace, or one of an unknown version");
+    }
+    for (uint16_t& value : _registers)
+    {
+        value = _Word();
+    }
+    _expectedRip = _registers[RIP];
+}
+
+bool TraceDecoder::Next(TraceRecord& record)
+{
+    const int flags = _in.get();
+    if (flags == std::char_traits<char>::eof())
+    {
+        return false;
+    }
+
+    record.rip = (flags & RipJumped) ? UnZigZag(_expectedRip, _Varint()) : _expectedRip;
+    record.instruction = _Word();
+    record.literal.reset();
+    if (HasLiteral(record.instruction))
+    {
+        record.literal = _Word();
+    }
+
+    record.registers.clear();
+    if (flags & RegistersChanged)
+    {
+        for (uint64_t count = _Varint(); count > 0; --count)
+        {
+            const uint8_t reg = _Byte();
+            if (reg >= _registers.size())
+            {
+                throw std::runtime_error("Trace names a register that doesn't exist");
+            }
+            _registers[reg] = UnZigZag(_registers[reg], _Varint());
+            record.registers.push_back({static_cast<RegisterId>(reg), _registers[reg]});
+        }
+    }
+    record.memory.clear();
+    if (flags & MemoryWritten)
+    {
+        for (uint64_t count = _Varint(); count > 0; --count)
+        {
+            _lastStore = UnZigZag(_lastStore, _Varint());
+            record.memory.push_back({_lastStore, _Word()});
+        }
+    }
+
+    _registers[RIP] = record.rip;
+    _expectedRip = NextRip(record.rip, record.instruction);
+    ++_records;
+    return true;
+}
+
+uint8_t TraceDecoder::_Byte()
+{
+    const int byte = _in.get();
+    if (byte == std::char_traits<char>::eof())
+    {
+        throw std::runtime_error("Trace is truncated");
+    }
+    return static_cast<uint8_t>(byte);
+}
+
+uint16_t TraceDecoder::_Word()
+{
+    const uint16_t high = _Byte();
+    return static_cast<uint16_t>((high << 8) | _Byte());
+}
+
+uint64_t TraceDecoder::_Varint()
+{
+    uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7)
+    {
+        const uint8_t byte = _Byte();
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return value;
+        }
+    }
+    throw std::runtime_error("Malformed varint in trace");
+}
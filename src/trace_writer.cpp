@@ -0,0 +1,114 @@
+#include "trace_writer.h"
+
+#include <chrono>
+
+TraceWriter::TraceWriter(const std::string& filename, size_t ringBytes)
+    : _ring(ringBytes), _file(filename, std::ios::binary | std::ios::trunc)
+{
+    if (!_file)
+    {
+        throw std::runtime_error("Cannot create or write to trace file " + filename);
+    }
+    _writer = std::thread([this] { _WriterLoop(); });
+}
+
+TraceWriter::~TraceWriter()
+{
+    try
+    {
+        Close();
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Writing the trace failed: " << e.what() << std::endl;
+    }
+}
+
+void TraceWriter::Write(const uint8_t* data, size_t size)
+{
+    // Big writes go through in pieces the ring can hold
+    while (size > 0)
+    {
+        const size_t piece = std::min(size, _ring.Capacity());
+        if (_ring.TryPush(data, piece))
+        {
+            data += piece;
+            size -= piece;
+            continue;
+        }
+        ++_stalls;
+        while (!_ring.TryPush(data, piece))
+        {
+            if (_stop.load(std::memory_order_relaxed))
+            {
+                throw std::logic_error("Writing to a closed trace");
+            }
+            std::this_thread::yield();
+        }
+        data += piece;
+        size -= piece;
+    }
+}
+
+void TraceWriter::Close()
+{
+    if (!_writer.joinable())
+    {
+        return;
+    }
+    _stop.store(true, std::memory_order_release);
+    _writer.join();
+    _file.close();
+    if (_error)
+    {
+        std::rethrow_exception(_error);
+    }
+}
+
+TraceWriterStats TraceWriter::GetStats() const
+{
+    return {_bytesWritten.load(), _stalls};
+}
+
+void TraceWriter::_WriterLoop()
+{
+    std::vector<uint8_t> chunk(std::min<size_t>(_ring.Capacity(), 64 * 1024));
+    try
+    {
+        while (true)
+        {
+            // Whatever was pushed before the stop has to be seen by the last pass
+            const bool stopping = _stop.load(std::memory_order_acquire);
+            const size_t count = _ring.Pop(chunk.data(), chunk.size());
+            if (count > 0)
+            {
+                _file.write(reinterpret_cast<const char*>(chunk.data()),
+                            static_cast<std::streamsize>(count));
+                if (!_file)
+                {
+                    throw std::runtime_error("Failed to write to the trace file");
+                }
+                _bytesWritten.fetch_add(count, std::memory_order_relaxed);
+                continue;
+            }
+            if (stopping)
+            {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        _file.flush();
+    }
+    catch (...)
+    {
+        _error = std::current_exception();
+        // Keep draining so the producer never waits on a ring nobody empties
+        while (!_stop.load(std::memory_order_acquire))
+        {
+            if (_ring.Pop(chunk.data(), chunk.size()) == 0)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        }
+    }
+}
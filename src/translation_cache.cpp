@@ -0,0 +1,278 @@
+#include "translation_cache.h"
+
+namespace
+{
+bool EndsBasicBlock(const DecodedInstruction& decoded)
+{
+    switch (decoded.opCodeId)
+    {
+        case OpCodeId::JZ:
+        case OpCodeId::JNZ:
+        case OpCodeId::JE:
+        case OpCodeId::JNE:
+        case OpCodeId::JMP:
+        case OpCodeId::STOP:
+        case OpCodeId::TRAP:
+            return true;
+        default:
+            break;
+    }
+    auto dest = DestinationRegister(decoded);
+    return dest && (*dest == RegisterId::RIP || *dest == RegisterId::RFL);
+}
+
+bool OnlyBranches(const std::vector<TranslatedInstruction>& instructions)
+{
+    return !instructions.empty() &&
+           std::all_of(instructions.begin(), instructions.end(), [](const auto& instruction) {
+               switch (instruction.decoded.opCodeId)
+               {
+                   case OpCodeId::JZ:
+                   case OpCodeId::JNZ:
+                   case OpCodeId::JE:
+                   case OpCodeId::JNE:
+                   case OpCodeId::JMP:
+                   case OpCodeId::NOP:
+                       return true;
+                   default:
+                       return false;
+               }
+           });
+}
+
+struct FusionPattern
+{
+    FusedOp op;
+    std::array<OpCodeId, 3> opCodes;
+};
+
+// Longest patterns first, so a triple wins over the pair it starts with
+constexpr std::array<FusionPattern, 5> fusionPatterns = {{
+    {FusedOp::IncSubJnz, {OpCodeId::INC, OpCodeId::SUB, OpCodeId::JNZ}},
+    {FusedOp::DecDecJnz, {OpCodeId::DEC, OpCodeId::DEC, OpCodeId::JNZ}},
+    {FusedOp::SubJnz, {OpCodeId::SUB, OpCodeId::JNZ}},
+    {FusedOp::IncSub, {OpCodeId::INC, OpCodeId::SUB}},
+    {FusedOp::SetSet, {OpCodeId::SET, OpCodeId::SET}},
+}};
+
+bool CanFuse(const DecodedInstruction& decoded)
+{
+    for (size_t i = 0; i < decoded.argCount; ++i)
+    {
+        if (decoded.args[i] == RegisterId::RIP || decoded.args[i] == RegisterId::RFL)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Matches(const FusionPattern& pattern, const std::vector<TranslatedInstruction>& instructions,
+             size_t first)
+{
+    const size_t length = FusedLength(pattern.op);
+    if (first + length > instructions.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < length; ++i)
+    {
+        const DecodedInstruction& decoded = instructions[first + i].decoded;
+        if (decoded.opCodeId != pattern.opCodes[i] || !CanFuse(decoded))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+}  // namespace
+
+TranslationCache::TranslationCache(Memory16& programMemory) : _programMemory(programMemory)
+{
+    _programMemory.AddObserver(this);
+}
+
+TranslationCache::~TranslationCache()
+{
+    _programMemory.RemoveObserver(this);
+}
+
+BasicBlock* TranslationCache::Lookup(uint16_t address)
+{
+    _retiredBlocks.clear();
+
+    auto found = _blocks.find(address);
+    if (found != _blocks.end())
+    {
+        ++_stats.hits;
+        return found->second.get();
+    }
+
+    ++_stats.misses;
+    auto block = _Translate(address);
+    for (size_t page = block->startAddress / PageSize; page * PageSize < block->endAddress; ++page)
+    {
+        ++_pageBlockCount[page];
+    }
+    return _blocks.emplace(address, std::move(block)).first->second.get();
+}
+
+std::unique_ptr<BasicBlock> TranslationCache::_Translate(uint16_t address)
+{
+    auto block = std::make_unique<BasicBlock>();
+    block->startAddress = address;
+
+    size_t current = address;
+    while (block->instructions.size() < MaxBlockInstructions)
+    {
+        if (current + sizeof(uint16_t) > _programMemory.Size())
+        {
+            break;
+        }
+        if (current != address && !_blockBoundaries.empty() && _blockBoundaries.count(current) > 0)
+        {
+            break;
+        }
+        const DecodedInstruction& decoded = decodeTable[_programMemory.Read16(current)];
+        if (!decoded.IsValid())
+        {
+            break;
+        }
+
+        size_t next = current + sizeof(uint16_t);
+        uint16_t literal = 0;
+        if (decoded.hasLiteral)
+        {
+            if (next + sizeof(uint16_t) > _programMemory.Size())
+            {
+                break;
+            }
+            literal = _programMemory.Read16(next);
+            next += sizeof(uint16_t);
+        }
+
+        block->instructions.push_back({decoded, literal, static_cast<uint16_t>(next)});
+        current = next;
+        if (EndsBasicBlock(decoded) || current > 0xffff)
+        {
+            break;
+        }
+    }
+
+    // Empty blocks still cover their first word, so that writing it gives the block a new chance
+    block->endAddress = std::max(current, size_t{address} + sizeof(uint16_t));
+    block->onlyBranches = OnlyBranches(block->instructions);
+    if (_fusion)
+    {
+        _Fuse(*block);
+    }
+    return block;
+}
+
+void TranslationCache::_Fuse(BasicBlock& block)
+{
+    auto& instructions = block.instructions;
+    for (size_t i = 0; i < instructions.size();)
+    {
+        const auto pattern =
+            std::find_if(fusionPatterns.begin(), fusionPatterns.end(), [&](const auto& candidate) {
+                return Matches(candidate, instructions, i);
+            });
+        if (pattern == fusionPatterns.end())
+        {
+            ++i;
+            continue;
+        }
+        instructions[i].fused = pattern->op;
+        i += FusedLength(pattern->op);
+        ++_stats.fusedGroups;
+    }
+}
+
+void TranslationCache::OnMemoryWrite(size_t address, size_t size)
+{
+    _InvalidateRange(address, size);
+}
+
+void TranslationCache::AddBlockBoundary(uint16_t address)
+{
+    if (_blockBoundaries.insert(address).second)
+    {
+        _InvalidateRange(address, 1);
+    }
+}
+
+void TranslationCache::RemoveBlockBoundary(uint16_t address)
+{
+    if (_blockBoundaries.erase(address) > 0)
+    {
+        // Whatever was split here can be merged back on the next translation
+        _InvalidateRange(address - (address > 0 ? 1 : 0), 2);
+    }
+}
+
+void TranslationCache::_InvalidateRange(size_t address, size_t size)
+{
+    if (size == 0 || _blocks.empty())
+    {
+        return;
+    }
+    const size_t end = address + size;
+
+    bool touchesBlocks = false;
+    for (size_t page = address / PageSize; page * PageSize < end && page < _pageBlockCount.size();
+         ++page)
+    {
+        touchesBlocks |= (_pageBlockCount[page] > 0);
+    }
+    if (!touchesBlocks)
+    {
+        return;
+    }
+
+    for (auto it = _blocks.begin(); it != _blocks.end();)
+    {
+        const BasicBlock& block = *it->second;
+        if (block.startAddress < end && address < block.endAddress)
+        {
+            auto retired = it++;
+            _Retire(retired);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void TranslationCache::Clear()
+{
+    while (!_blocks.empty())
+    {
+        _Retire(_blocks.begin());
+    }
+}
+
+void TranslationCache::SetFusion(bool enabled)
+{
+    if (enabled != _fusion)
+    {
+        _fusion = enabled;
+        Clear();
+    }
+}
+
+void TranslationCache::_Retire(
+    std::unordered_map<uint16_t, std::unique_ptr<BasicBlock>>::iterator block)
+{
+    for (size_t page = block->second->startAddress / PageSize;
+         page * PageSize < block->second->endAddress;
+         ++page)
+    {
+        --_pageBlockCount[page];
+    }
+    _retiredBlocks.push_back(std::move(block->second));
+    _blocks.erase(block);
+    ++_stats.invalidations;
+    ++_generation;
+}
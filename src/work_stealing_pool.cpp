@@ -0,0 +1,163 @@
+#include "work_stealing_pool.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+WorkStealingPool::WorkStealingPool(size_t threads, std::vector<int> cpus)
+{
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < threads; ++i)
+    {
+        _workers.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < threads; ++i)
+    {
+        _workers[i]->thread = std::thread(&WorkStealingPool::_WorkerLoop, this, i);
+    }
+
+    if (cpus.empty())
+    {
+        return;
+    }
+#ifdef __linux__
+    for (size_t i = 0; i < threads; ++i)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus[i % cpus.size()], &set);
+        if (pthread_setaffinity_np(_workers[i]->thread.native_handle(), sizeof(set), &set) != 0)
+        {
+            _Stop();
+            throw std::runtime_error("Could not pin a worker to CPU " +
+                                     std::to_string(cpus[i % cpus.size()]));
+        }
+    }
+#else
+    _Stop();
+    throw std::runtime_error("Pinning workers to CPUs is only supported on Linux");
+#endif
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    _Stop();
+}
+
+void WorkStealingPool::_Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _wake.notify_all();
+    for (auto& worker : _workers)
+    {
+        if (worker->thread.joinable())
+        {
+            worker->thread.join();
+        }
+    }
+}
+
+void WorkStealingPool::Submit(std::function<void()> task)
+{
+    size_t index;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        index = _nextWorker++ % _workers.size();
+        ++_pending;
+        // Counted before it lands in the deque, a worker that looks too early just tries again
+        ++_queued;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_workers[index]->mutex);
+        _workers[index]->tasks.push_back(std::move(task));
+    }
+    _wake.notify_one();
+}
+
+void WorkStealingPool::Wait()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _idle.wait(lock, [this] { return _pending == 0; });
+    if (_error)
+    {
+        std::rethrow_exception(std::exchange(_error, nullptr));
+    }
+}
+
+bool WorkStealingPool::_TryTake(size_t index, std::function<void()>& task)
+{
+    // Own deque first, newest task, it's the most likely to still be warm in cache
+    {
+        Worker& own = *_workers[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    // Then the oldest task of whoever has one
+    for (size_t offset = 1; offset < _workers.size(); ++offset)
+    {
+        Worker& victim = *_workers[(index + offset) % _workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            ++_stolen;
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::_WorkerLoop(size_t index)
+{
+    while (true)
+    {
+        std::function<void()> task;
+        if (_TryTake(index, task))
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                --_queued;
+            }
+            std::exception_ptr error;
+            try
+            {
+                task();
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (error && !_error)
+            {
+                _error = error;
+            }
+            if (--_pending == 0)
+            {
+                _idle.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        _wake.wait(lock, [this] { return _stopping || _queued > 0; });
+        if (_stopping && _queued == 0)
+        {
+            return;
+        }
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <filesystem>
+#include <random>
+
+#include "common.h"
+
+// A file name of its own in the temp directory, so parallel runs don't collide. Every file
+// starting with it, like an NVRAM journal next to its image, is removed at the end of the test.
+struct ScratchFile
+{
+    // Creates the file with size zeroes in it, or leaves creating it to the test when size is 0
+    explicit ScratchFile(const std::string& stem, size_t size = 0)
+    {
+        std::random_device random;
+        std::ostringstream unique;
+        unique << "luinux_" << stem << '_' << std::hex << random() << random();
+        name = (std::filesystem::temp_directory_path() / unique.str()).string();
+        if (size > 0)
+        {
+            std::vector<char> zeroes(size);
+            std::ofstream(name, std::ios::binary | std::ios::trunc)
+                .write(zeroes.data(), static_cast<std::streamsize>(zeroes.size()));
+        }
+    }
+    ~ScratchFile()
+    {
+        const std::filesystem::path path(name);
+        const std::string prefix = path.filename().string();
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator(path.parent_path(), error))
+        {
+            if (entry.path().filename().string().rfind(prefix, 0) == 0)
+            {
+                std::filesystem::remove(entry.path(), error);
+            }
+        }
+    }
+    ScratchFile(const ScratchFile&) = delete;
+    ScratchFile& operator=(const ScratchFile&) = delete;
+
+    std::string name;
+};
+
+// The whole file, empty when there is none
+inline std::vector<uint8_t> ReadFile(const std::string& filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), {});
+}
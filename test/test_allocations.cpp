@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "assembler.h"
+#include "memory.h"
+#include "processor.h"
+
+using Memory16 = Memory<uint16_t>;
+
+// Replace the global allocator for this test binary so we can count heap allocations while the
+// processor runs. Counting is off unless a test turns it on.
+namespace
+{
+std::atomic<bool> countAllocations{false};
+std::atomic<size_t> allocationCount{0};
+}  // namespace
+
+void* operator new(std::size_t size)
+{
+    if (countAllocations)
+    {
+        ++allocationCount;
+    }
+    if (void* ptr = std::malloc(size ? size : 1))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+namespace
+{
+Processor MakeLoopProcessor(Memory16& programMemory, unsigned loopCount)
+{
+    Assembler asmObj;
+    std::string program =
+        "SET R0, " + std::to_string(loopCount) +
+        " ; Loop count\n"
+        "SET R10, 0 ; Counter\n"
+        "SET R3, h'1000 ; Scratch address for memory ops\n"
+        "goto:R2 ; loop on R2\n"
+        "INC R10\n"
+        "ADD R10, R10, R4\n"
+        "MOV R4, R5\n"
+        "STOR R4, R3\n"
+        "LOAD R3, R6\n"
+        "PUSH R6\n"
+        "POP R7\n"
+        "SUB R0, R10, R1\n"
+        "JNZ R1, R2\n"
+        "STOP";
+
+    programMemory.WritePayload(0, asmObj.AssembleString(program));
+    return Processor(programMemory);
+}
+}  // namespace
+
+TEST(TestAllocationsSuite, TestExecutionCycleDoesNotAllocate)
+{
+    Memory16 programMemory(0x10000);
+    Processor cpu = MakeLoopProcessor(programMemory, 1000);
+
+    // Warm up, so one-time initialization of static tables is not counted
+    for (int i = 0; i < 16; ++i)
+    {
+        cpu.PerformExecutionCycle();
+    }
+
+    allocationCount = 0;
+    countAllocations = true;
+    for (int i = 0; i < 9000; ++i)
+    {
+        cpu.PerformExecutionCycle();
+    }
+    countAllocations = false;
+
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::R10), 1000);
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::R7), 2000);
+    ASSERT_EQ(allocationCount, 0);
+}
+
+TEST(TestAllocationsSuite, TestExecuteAllOnlyAllocatesToTranslate)
+{
+    // ExecuteAll allocates when it translates a new block, that must not depend on how many times
+    // the blocks run
+    size_t allocationsPerLoopCount[2];
+    const unsigned loopCounts[2] = {10, 1000};
+    for (int i = 0; i < 2; ++i)
+    {
+        Memory16 programMemory(0x10000);
+        Processor cpu = MakeLoopProcessor(programMemory, loopCounts[i]);
+
+        allocationCount = 0;
+        countAllocations = true;
+        cpu.ExecuteAll();
+        countAllocations = false;
+        allocationsPerLoopCount[i] = allocationCount;
+
+        ASSERT_EQ(cpu.ReadRegister(RegisterId::R10), loopCounts[i]);
+    }
+    ASSERT_EQ(allocationsPerLoopCount[0], allocationsPerLoopCount[1]);
+}
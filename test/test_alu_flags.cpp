@@ -150,3 +150,35 @@ TEST(TestAluFlags, TestAluFlags_SUB)
     ASSERT_EQ(f4.flags.Carry, 0);
     ASSERT_EQ(f4.flags.Overflow, 1);
 }
+
+TEST(TestAluFlags, TestPendingFlagsSurviveOtherRflWrites)
+{
+    Assembler asmObj;
+
+    // The ADD leaves its flags pending. DIV by zero and TRAP then change RFL in place and have
+    // to keep them.
+    std::string program =
+        "SET R5, h'ffff\n"
+        "SET R6, h'0001\n"
+        "SET R7, h'0000\n"
+        "ADD R5, R6, R10 ; Carry and Zero\n"
+        "DIV R5, R7, R8 ; Exception, the rest stays\n"
+        "TRAP\n";
+
+    auto binProgram = asmObj.AssembleString(program);
+    Memory16 programMemory(0x10000);
+    programMemory.WritePayload(0, binProgram);
+    Processor cpu(programMemory);
+    cpu.ExecuteAll();
+
+    FlagsObject f(cpu.ReadRegister(RegisterId::RFL));
+    ASSERT_EQ(f.flags.Carry, 1);
+    ASSERT_EQ(f.flags.Zero, 1);
+    ASSERT_EQ(f.flags.Exception, 1);
+    ASSERT_EQ(f.flags.Trap, 1);
+    ASSERT_EQ(cpu.GetInternalMemory().Read16(static_cast<uint8_t>(RegisterId::RFL) * 2), f.value);
+
+    // Writing RFL from outside drops whatever was still pending
+    cpu.WriteRegister(RegisterId::RFL, 0);
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::RFL), 0);
+}
@@ -161,4 +161,37 @@ TEST(TestAssemblerSuite, TestAddressTags)
                  "\\x76\\x25\\x00\\x0a\\x76\\x2f\\x00\\x00\\x76\\x27\\x00\\x0c\\x"
                  "76\\x8f\\x15\\xf6\\x71\\x67\\x76\\x91\\x76\\x25\\x00\\x10");
     ASSERT_EQ(expectedBinary, binProgram);
-}
\ No newline at end of file
+}
+
+TEST(TestAssemblerSuite, TestLineTable)
+{
+    Assembler asmObj;
+    asmObj.AssembleString(
+        "SET R0, 10\n"
+        "\n"
+        ":Loop ; comment\n"
+        "DEC R0\n"
+        "JNZ R0, R2\n"
+        ":Done\n"
+        "STOP\n");
+    const DebugLineTable table = asmObj.GetLineTable();
+    ASSERT_EQ(table.LineAt(0), 1);
+    // The literal belongs to the SET
+    ASSERT_EQ(table.LineAt(2), 1);
+    ASSERT_EQ(table.LineAt(4), 4);
+    ASSERT_EQ(table.LineAt(6), 5);
+    ASSERT_EQ(table.LineAt(8), 7);
+    ASSERT_EQ(table.LineAt(0x100), 0);
+    ASSERT_EQ(table.TagAt(2), "");
+    ASSERT_EQ(table.TagAt(6), "Loop");
+    ASSERT_EQ(table.TagAt(8), "Done");
+
+    std::stringstream file;
+    table.Write(file);
+    const DebugLineTable read = DebugLineTable::Read(file);
+    ASSERT_EQ(read.LineAt(6), 5);
+    ASSERT_EQ(read.TagAt(6), "Loop");
+
+    std::stringstream bad("luinux-lines 1\nL 4\n");
+    EXPECT_THROW(DebugLineTable::Read(bad), std::runtime_error);
+}
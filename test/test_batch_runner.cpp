@@ -0,0 +1,177 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+
+#include "assembler.h"
+#include "batch_runner.h"
+#include "work_stealing_pool.h"
+
+namespace
+{
+// A scratch directory with assembled programs in it, removed at the end of the test
+class BatchDirectory
+{
+   public:
+    BatchDirectory()
+        : path(std::filesystem::temp_directory_path() /
+               ("luinux_batch_" + std::to_string(reinterpret_cast<uintptr_t>(this))))
+    {
+        std::filesystem::create_directories(path);
+    }
+    ~BatchDirectory()
+    {
+        std::filesystem::remove_all(path);
+    }
+
+    std::string AddProgram(const std::string& name, const std::string& program)
+    {
+        Assembler asmObj;
+        auto binProgram = asmObj.AssembleString(program);
+        std::ofstream(path / name, std::ios::binary)
+            .write(reinterpret_cast<const char*>(binProgram.data()), binProgram.size());
+        return name;
+    }
+
+    std::filesystem::path path;
+};
+}  // namespace
+
+TEST(TestWorkStealingPoolSuite, TestRunsEveryTask)
+{
+    WorkStealingPool pool(4);
+    ASSERT_EQ(pool.Size(), 4);
+
+    std::atomic<uint64_t> sum{0};
+    for (uint64_t i = 1; i <= 1000; ++i)
+    {
+        pool.Submit([&sum, i] { sum += i; });
+    }
+    pool.Wait();
+    ASSERT_EQ(sum.load(), 1000 * 1001 / 2);
+
+    // The pool can be reused, and task exceptions come back out of Wait()
+    pool.Submit([] { throw std::runtime_error("boom"); });
+    pool.Submit([&sum] { ++sum; });
+    ASSERT_THROW(pool.Wait(), std::runtime_error);
+    ASSERT_EQ(sum.load(), 1000 * 1001 / 2 + 1);
+}
+
+TEST(TestWorkStealingPoolSuite, TestIdleWorkersSteal)
+{
+    WorkStealingPool pool(2);
+    std::atomic<bool> started{false};
+    std::atomic<bool> release{false};
+    std::atomic<int> done{0};
+
+    // The first task blocks its worker. Every other task after it lands on that same worker, and
+    // has to be stolen to run before the first one finishes.
+    pool.Submit([&] {
+        started = true;
+        while (!release)
+        {
+            std::this_thread::yield();
+        }
+    });
+    while (!started)
+    {
+        std::this_thread::yield();
+    }
+    for (int i = 0; i < 9; ++i)
+    {
+        pool.Submit([&] { ++done; });
+    }
+    while (done < 9)
+    {
+        std::this_thread::yield();
+    }
+    release = true;
+    pool.Wait();
+    ASSERT_GT(pool.StolenCount(), 0);
+}
+
+TEST(TestBatchRunnerSuite, TestParseManifest)
+{
+    std::istringstream manifest(
+        "# program nvram budget\n"
+        "loop.bin\n"
+        "\n"
+        "/abs/trap.bin - 100 # a comment\n"
+        "swm.bin nvram.bin\n");
+    auto jobs = BatchRunner::ParseManifest(manifest, "base");
+    ASSERT_EQ(jobs.size(), 3);
+    ASSERT_EQ(jobs[0].program, (std::filesystem::path("base") / "loop.bin").string());
+    ASSERT_TRUE(jobs[0].nvram.empty());
+    ASSERT_EQ(jobs[0].budget, std::numeric_limits<uint64_t>::max());
+    ASSERT_EQ(jobs[1].program, "/abs/trap.bin");
+    ASSERT_EQ(jobs[1].budget, 100);
+    ASSERT_EQ(jobs[2].nvram, (std::filesystem::path("base") / "nvram.bin").string());
+
+    std::istringstream badManifest("loop.bin - lots\n");
+    ASSERT_THROW(BatchRunner::ParseManifest(badManifest, ""), std::runtime_error);
+    std::istringstream negativeBudget("loop.bin - -1\n");
+    ASSERT_THROW(BatchRunner::ParseManifest(negativeBudget, ""), std::runtime_error);
+}
+
+TEST(TestBatchRunnerSuite, TestRunsJobsAndReports)
+{
+    BatchDirectory directory;
+    directory.AddProgram("loop.bin",
+                         "SET R0, 50\n"
+                         "SET R10, 0\n"
+                         "goto:R2\n"
+                         "INC R10\n"
+                         "SUB R0, R10, R1\n"
+                         "JNZ R1, R2\n"
+                         "STOP\n");
+    directory.AddProgram("trap.bin", "SET R5, 7\nTRAP\n");
+    directory.AddProgram("forever.bin", "goto:R2\nINC R3\nJMP 4\n");
+    directory.AddProgram("swm.bin", "SWM\nSTOP\n");
+    std::filesystem::copy_file("test_nvmemory.bin", directory.path / "nvram.bin");
+
+    std::ofstream(directory.path / "jobs.txt") << "loop.bin\n"
+                                                  "trap.bin\n"
+                                                  "forever.bin - 1000\n"
+                                                  "swm.bin\n"
+                                                  "swm.bin nvram.bin\n"
+                                                  "missing.bin\n";
+    auto jobs = BatchRunner::LoadManifest((directory.path / "jobs.txt").string());
+    // Enough copies that every worker gets some
+    for (int i = 0; i < 5; ++i)
+    {
+        jobs.push_back(jobs[0]);
+    }
+
+    BatchRunner runner(BatchOptions{3, {}, ExecutionEngine::Interpreter});
+    const BatchReport report = runner.Run(jobs);
+    ASSERT_EQ(report.threads, 3);
+    ASSERT_EQ(report.results.size(), jobs.size());
+
+    ASSERT_EQ(report.results[0].reason, StopReason::Halted);
+    ASSERT_EQ(report.results[0].instructions, 3 + 3 * 50 + 1);
+    ASSERT_EQ(report.results[0].registers[static_cast<size_t>(RegisterId::R10)], 50);
+    ASSERT_EQ(report.results[1].reason, StopReason::Trap);
+    ASSERT_EQ(report.results[1].registers[static_cast<size_t>(RegisterId::R5)], 7);
+    ASSERT_EQ(report.results[2].reason, StopReason::BudgetExhausted);
+    ASSERT_EQ(report.results[2].instructions, 1000);
+    ASSERT_EQ(report.results[3].reason, StopReason::Fault);
+    ASSERT_EQ(report.results[4].reason, StopReason::Halted);
+    ASSERT_EQ(report.results[5].reason, StopReason::Fault);
+    ASSERT_NE(report.results[5].fault.find("missing.bin"), std::string::npos);
+    for (size_t i = 6; i < jobs.size(); ++i)
+    {
+        ASSERT_EQ(report.results[i].registers, report.results[0].registers);
+    }
+
+    const std::string json = report.ToJson();
+    ASSERT_NE(json.find("\"jobs\": 11"), std::string::npos);
+    ASSERT_NE(json.find("\"BudgetExhausted\": 1"), std::string::npos);
+    ASSERT_NE(json.find("\"reason\": \"Trap\""), std::string::npos);
+    ASSERT_NE(json.find("\"R10\": 50"), std::string::npos);
+
+    // Two guests writing the same NVRAM file can't both win
+    jobs.push_back(jobs[4]);
+    ASSERT_THROW(runner.Run(jobs), std::runtime_error);
+    // Even when the paths are spelled differently
+    jobs.back().nvram = (directory.path / "." / "nvram.bin").string();
+    ASSERT_THROW(runner.Run(jobs), std::runtime_error);
+}
@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+
+#include "assembler.h"
+#include "processor.h"
+
+namespace
+{
+// Keeps every access it gets, reads return the offset plus one
+struct RecordingDevice : public Device
+{
+    uint16_t Read16(uint16_t offset) override
+    {
+        reads.push_back(offset);
+        return offset + 1;
+    }
+    void Write16(uint16_t offset, uint16_t value) override
+    {
+        writes.emplace_back(offset, value);
+    }
+
+    std::vector<uint16_t> reads;
+    std::vector<std::pair<uint16_t, uint16_t>> writes;
+};
+}  // namespace
+
+TEST(TestDeviceBusSuite, TestMappingRules)
+{
+    DeviceBus bus;
+    auto device = std::make_shared<RecordingDevice>();
+    ASSERT_THROW(bus.Map(0x1080, DeviceBus::PageSize, device), std::invalid_argument);
+    ASSERT_THROW(bus.Map(0x1000, 0x80, device), std::invalid_argument);
+    ASSERT_THROW(bus.Map(0xff00, 2 * DeviceBus::PageSize, device), std::invalid_argument);
+
+    bus.Map(0x1000, 2 * DeviceBus::PageSize, device);
+    ASSERT_THROW(bus.Map(0x1100, DeviceBus::PageSize, std::make_shared<RecordingDevice>()),
+                 std::invalid_argument);
+    ASSERT_EQ(bus.DeviceAt(0x0fff), nullptr);
+    ASSERT_EQ(bus.DeviceAt(0x1000), device.get());
+    ASSERT_EQ(bus.DeviceAt(0x11ff), device.get());
+    ASSERT_EQ(bus.DeviceAt(0x1200), nullptr);
+
+    bus.Unmap(device.get());
+    ASSERT_EQ(bus.DeviceAt(0x1000), nullptr);
+    ASSERT_EQ(device.use_count(), 1);
+}
+
+TEST(TestDeviceBusSuite, TestProcessorAccessesGoThroughBus)
+{
+    Assembler asmObj;
+    Memory16 programMemory(0x10000);
+    programMemory.WritePayload(0,
+                               asmObj.AssembleString("SET R0, h'3000\n"
+                                                     "SET R1, h'3104\n"
+                                                     "SET R2, h'2000\n"
+                                                     "SET R3, 42\n"
+                                                     "STOR R3, R1\n"
+                                                     "LOAD R1, R4\n"
+                                                     "STOR R3, R2\n"
+                                                     "LOAD R2, R5\n"
+                                                     "MOV R0, RSP\n"
+                                                     "PUSH R3\n"
+                                                     "POP R6\n"
+                                                     "STOP"));
+    Processor cpu(programMemory);
+    auto device = std::make_shared<RecordingDevice>();
+    cpu.GetBus().Map(0x3000, 2 * DeviceBus::PageSize, device);
+    cpu.ExecuteAll();
+
+    // Offsets are relative to where the device is mapped
+    const std::vector<std::pair<uint16_t, uint16_t>> writes{{0x0104, 42}, {0x0000, 42}};
+    ASSERT_EQ(device->writes, writes);
+    ASSERT_EQ(device->reads, (std::vector<uint16_t>{0x0104, 0x0000}));
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::R4), 0x0105);
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::R6), 0x0001);
+    // Plain RAM is untouched by the device and the other way around
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::R5), 42);
+    ASSERT_EQ(cpu.Snapshot().sram.Read16(0x3104), 0);
+
+    // Forks talk to the same devices
+    auto fork = cpu.Fork();
+    ASSERT_EQ(fork->GetBus().DeviceAt(0x3000), device.get());
+}
+
+TEST(TestDeviceBusSuite, TestConsole)
+{
+    Assembler asmObj;
+    Memory16 programMemory(0x10000);
+    programMemory.WritePayload(0,
+                               asmObj.AssembleString("SET R0, h'fc00\n"
+                                                     "SET R1, h'fc02\n"
+                                                     "LOAD R1, R5\n"
+                                                     "LOAD R0, R2\n"
+                                                     "LOAD R0, R6\n"
+                                                     "SET R3, 72\n"
+                                                     "STOR R3, R0\n"
+                                                     "SET R3, 105\n"
+                                                     "STOR R3, R0\n"
+                                                     "STOR R2, R0\n"
+                                                     "STOP"));
+    Processor cpu(programMemory);
+    std::ostringstream out;
+    auto console = std::make_shared<ConsoleDevice>(out);
+    console->PushInput("!");
+    cpu.GetBus().Map(ConsoleDevice::DefaultBase, DeviceBus::PageSize, console);
+    cpu.ExecuteAll();
+
+    ASSERT_EQ(out.str(), "Hi!");
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::R5), 1);
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::R6), 0xffff);
+}
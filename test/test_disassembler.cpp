@@ -0,0 +1,46 @@
+#include <gtest/gtest.h>
+
+#include "assembler.h"
+#include "disassembler.h"
+
+TEST(TestDisassemblerSuite, TestInstructionToString)
+{
+    ASSERT_EQ(Disassembler::InstructionToString(0x4567), "AND R0, R1, R2");
+    ASSERT_EQ(Disassembler::InstructionToString(0x725a), "MOV R0, R5");
+    ASSERT_EQ(Disassembler::InstructionToString(0x767f), "SHFL R10");
+    ASSERT_EQ(Disassembler::InstructionToString(0x7690), "NOP");
+    ASSERT_EQ(Disassembler::InstructionToString(0x7625), "SET R0, VALUE");
+    ASSERT_EQ(Disassembler::InstructionToString(0x7625, 0x1010), "SET R0, h'1010");
+    ASSERT_EQ(Disassembler::InstructionToString(0x7694, 0x000c), "JMP h'000c");
+    // Leading zeroes are an ADD, not a SET
+    ASSERT_EQ(Disassembler::InstructionToString(0x0762), "ADD R2, R1, RIP");
+    ASSERT_EQ(Disassembler::InstructionToString(0x8000), "UNKNOWN_INSTR");
+}
+
+TEST(TestDisassemblerSuite, TestRoundTrip)
+{
+    std::string program =
+        "SET R0, 10\n"
+        "SET R10, 0\n"
+        "goto:R2\n"
+        "INC R10\n"
+        "SUB R0, R10, R1\n"
+        "JNZ R1, R2\n"
+        "JMP h'0020\n"
+        "PUSH R3\n"
+        "POP RFL\n"
+        "LOAD R0, R2\n"
+        "STOR R2, R0\n"
+        "SWM\n"
+        "STOP\n";
+
+    Assembler asmObj;
+    auto binProgram = asmObj.AssembleString(program);
+
+    Disassembler disasm;
+    auto listing = disasm.Disassemble(binProgram);
+
+    Assembler reAsmObj;
+    auto reassembled = reAsmObj.AssembleString(listing);
+    ASSERT_EQ(binProgram, reassembled);
+}
@@ -0,0 +1,217 @@
+#include <gtest/gtest.h>
+
+#include "assembler.h"
+#include "processor.h"
+#include "snapshot_file.h"
+#include "timer_device.h"
+
+namespace
+{
+// Installs its handler in the vector table at h'0100, programs a periodic timer interrupt every
+// 100 cycles and idles until the handler has seen five of them.
+const std::string timerProgram =
+    "JMP Main\n"
+    ":Handler\n"
+    "INC R10\n"
+    "SUB R9, R10, R4\n"
+    "SET R5, Return\n"
+    "JNZ R4, R5\n"
+    "STOP\n"
+    ":Return\n"
+    "POP RFL\n"
+    "POP RIP\n"
+    ":Main\n"
+    "SET R7, h'0100\n"
+    "SET R8, Handler\n"
+    "STOR R8, R7\n"
+    "SET R0, h'fb00\n"
+    "SET R1, h'fb02\n"
+    "SET R3, 100\n"
+    "STOR R3, R0\n"
+    "SET R3, 7 ; enabled, periodic, interrupting\n"
+    "STOR R3, R1\n"
+    "SET R9, 5\n"
+    ":Idle\n"
+    "JMP Idle\n";
+constexpr uint16_t VectorTableAddress = 0x0100;
+
+struct TimerMachine
+{
+    TimerMachine() : cpu(programMemory)
+    {
+        Assembler asmObj;
+        programMemory.WritePayload(0, asmObj.AssembleString(timerProgram));
+        cpu.GetBus().Map(
+            TimerDevice::DefaultBase, DeviceBus::PageSize, std::make_shared<TimerDevice>(cpu));
+        cpu.SetVectorTable(VectorTableAddress);
+    }
+
+    Memory16 programMemory{0x10000};
+    Processor cpu;
+};
+}  // namespace
+
+TEST(TestEventSchedulerSuite, TestOrdering)
+{
+    EventScheduler scheduler;
+    std::vector<std::string> fired;
+    scheduler.Schedule(20, [&](uint64_t) { fired.push_back("b"); });
+    scheduler.Schedule(10, [&](uint64_t cycle) {
+        fired.push_back("a");
+        // Already due, runs within the same RunDue()
+        scheduler.Schedule(cycle, [&](uint64_t) { fired.push_back("a2"); });
+    });
+    scheduler.Schedule(20, [&](uint64_t) { fired.push_back("c"); });
+    const auto cancelled = scheduler.Schedule(15, [&](uint64_t) { fired.push_back("x"); });
+    ASSERT_EQ(scheduler.NextEventCycle(), 10);
+
+    scheduler.Cancel(cancelled);
+    scheduler.RunDue(9);
+    ASSERT_TRUE(fired.empty());
+    scheduler.RunDue(20);
+    ASSERT_EQ(fired, (std::vector<std::string>{"a", "a2", "b", "c"}));
+    ASSERT_EQ(scheduler.NextEventCycle(), EventScheduler::Never);
+    ASSERT_EQ(scheduler.Pending(), 0);
+}
+
+TEST(TestEventSchedulerSuite, TestTimerInterruptsIdleGuest)
+{
+    TimerMachine machine;
+    Processor& cpu = machine.cpu;
+    cpu.ExecuteAll();
+
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::R10), 5);
+    // Stopped inside the handler
+    ASSERT_NE(cpu.ReadRegister(RegisterId::RFL) & static_cast<uint16_t>(FlagsRegister::Interrupt),
+              0);
+    // Five periods of waiting, nearly all of it skipped
+    ASSERT_GE(cpu.GetInstructionCount(), 500);
+    ASSERT_LT(cpu.GetInstructionCount(), 600);
+    ASSERT_GT(cpu.GetIdleInstructionCount(), 400);
+    // Returning from the first four popped what the interrupts pushed
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::RSP), RSP_DefaultAddress + 4);
+    // The last one interrupted the idle loop, with interrupts enabled
+    const ProcessorSnapshot snapshot = cpu.Snapshot();
+    const uint16_t idleAddress = 54;
+    ASSERT_EQ(snapshot.sram.Read16(RSP_DefaultAddress), idleAddress);
+    ASSERT_EQ(snapshot.sram.Read16(RSP_DefaultAddress + 2) &
+                  static_cast<uint16_t>(FlagsRegister::Interrupt),
+              0);
+}
+
+TEST(TestEventSchedulerSuite, TestFastForwardDoesNotChangeResults)
+{
+    // Stopping after every instruction leaves the idle loop nothing to skip
+    TimerMachine sliced;
+    while (sliced.cpu.Run(1) == StopReason::BudgetExhausted)
+    {
+    }
+    TimerMachine whole;
+    ASSERT_EQ(whole.cpu.Run(1000000), StopReason::Halted);
+
+    ASSERT_EQ(sliced.cpu.GetIdleInstructionCount(), 0);
+    ASSERT_GT(whole.cpu.GetIdleInstructionCount(), 0);
+    ASSERT_EQ(sliced.cpu.GetInstructionCount(), whole.cpu.GetInstructionCount());
+    for (size_t reg = 0; reg < static_cast<size_t>(RegisterId::END_OF_REGLIST); ++reg)
+    {
+        ASSERT_EQ(sliced.cpu.ReadRegister(static_cast<RegisterId>(reg)),
+                  whole.cpu.ReadRegister(static_cast<RegisterId>(reg)));
+    }
+}
+
+TEST(TestEventSchedulerSuite, TestSingleCyclesTakeInterrupts)
+{
+    TimerMachine stepped;
+    // Halting leaves the rest of the cycles doing nothing
+    for (int cycle = 0; cycle < 2000; ++cycle)
+    {
+        stepped.cpu.PerformExecutionCycle();
+    }
+    TimerMachine whole;
+    ASSERT_EQ(whole.cpu.Run(1000000), StopReason::Halted);
+
+    ASSERT_EQ(stepped.cpu.ReadRegister(RegisterId::R10), 5);
+    ASSERT_EQ(stepped.cpu.GetInstructionCount(), whole.cpu.GetInstructionCount());
+    for (size_t reg = 0; reg < static_cast<size_t>(RegisterId::END_OF_REGLIST); ++reg)
+    {
+        ASSERT_EQ(stepped.cpu.ReadRegister(static_cast<RegisterId>(reg)),
+                  whole.cpu.ReadRegister(static_cast<RegisterId>(reg)));
+    }
+}
+
+TEST(TestEventSchedulerSuite, TestInterruptWaitsForHandler)
+{
+    Assembler asmObj;
+    Memory16 programMemory(0x10000);
+    programMemory.WritePayload(0, asmObj.AssembleString("INC R0\nINC R0\nSTOP"));
+    Processor cpu(programMemory);
+    cpu.RaiseInterrupt();
+    ASSERT_EQ(cpu.Run(100), StopReason::Halted);
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::R0), 2);
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::RSP), RSP_DefaultAddress);
+}
+
+TEST(TestEventSchedulerSuite, TestRestoreMovesTimer)
+{
+    // A periodic timer without interrupts, every 1000 cycles, and an idle loop
+    const std::string program =
+        "SET R0, h'fb00\n"
+        "SET R1, h'fb02\n"
+        "SET R3, 1000\n"
+        "STOR R3, R0\n"
+        "SET R3, 3 ; enabled, periodic\n"
+        "STOR R3, R1\n"
+        ":Idle\n"
+        "JMP Idle\n";
+    struct Machine
+    {
+        Machine(const std::string& program) : cpu(programMemory)
+        {
+            Assembler asmObj;
+            programMemory.WritePayload(0, asmObj.AssembleString(program));
+            cpu.GetBus().Map(TimerDevice::DefaultBase, DeviceBus::PageSize, timer);
+        }
+        uint64_t UntilExpiry()
+        {
+            return cpu.GetScheduler().NextEventCycle() - cpu.GetInstructionCount();
+        }
+
+        Memory16 programMemory{0x10000};
+        Processor cpu;
+        std::shared_ptr<TimerDevice> timer = std::make_shared<TimerDevice>(cpu);
+    };
+
+    Machine machine(program);
+    Processor& cpu = machine.cpu;
+    ASSERT_EQ(cpu.Run(10), StopReason::BudgetExhausted);
+    const ProcessorSnapshot early = cpu.Snapshot();
+    const uint64_t earlyUntilExpiry = machine.UntilExpiry();
+    ASSERT_EQ(cpu.Run(50500), StopReason::BudgetExhausted);
+    const ProcessorSnapshot late = cpu.Snapshot();
+    const uint64_t lateUntilExpiry = machine.UntilExpiry();
+    ASSERT_NE(earlyUntilExpiry, lateUntilExpiry);
+    machine.timer->Read16(TimerDevice::StatusRegister);
+
+    // Back in time the next expiry is where it was, not 50000 cycles away
+    cpu.Restore(early);
+    ASSERT_EQ(machine.UntilExpiry(), earlyUntilExpiry);
+    ASSERT_EQ(cpu.Run(5000), StopReason::BudgetExhausted);
+    ASSERT_EQ(machine.timer->Read16(TimerDevice::StatusRegister), 5);
+
+    // Forward in time on a processor of its own, nothing falls due right away
+    Machine other(program);
+    ASSERT_EQ(other.cpu.Run(10), StopReason::BudgetExhausted);
+    other.cpu.Restore(late);
+    ASSERT_EQ(other.UntilExpiry(), lateUntilExpiry);
+    ASSERT_EQ(other.cpu.Run(lateUntilExpiry - 1), StopReason::BudgetExhausted);
+    ASSERT_EQ(other.timer->Read16(TimerDevice::StatusRegister), 0);
+
+    // The same through the snapshot file, into a timer that wasn't counting down yet
+    Machine fresh(program);
+    std::stringstream file;
+    SnapshotFile::Write(file, late);
+    fresh.timer->Write16(TimerDevice::PeriodRegister, 1000);
+    fresh.cpu.Restore(SnapshotFile::Read(file));
+    ASSERT_EQ(fresh.UntilExpiry(), lateUntilExpiry);
+    ASSERT_NE(fresh.timer->Read16(TimerDevice::ControlRegister) & TimerDevice::ControlEnable, 0);
+}
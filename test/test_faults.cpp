@@ -0,0 +1,244 @@
+#include <gtest/gtest.h>
+
+#include "assembler.h"
+#include "device_bus.h"
+#include "processor.h"
+
+namespace
+{
+constexpr uint16_t VectorTable = 0x0100;
+
+// Handler moving the return address past the faulting instruction, a single word one
+const std::string skipHandler =
+    "POP R6\n"
+    "POP R7\n"
+    "INC R7\n"
+    "INC R7\n"
+    "PUSH R7\n"
+    "PUSH R6\n"
+    "POP RFL\n"
+    "POP RIP\n";
+
+// Starts with the handler for fault, installs it in the vector table and goes on with main
+std::string WithHandler(Fault fault, const std::string& handler, const std::string& main)
+{
+    return "JMP Main\n"
+           ":Handler\n" +
+           handler +
+           ":Main\n"
+           "SET R0, " +
+           std::to_string(VectorTable + 2 * static_cast<size_t>(fault)) +
+           "\n"
+           "SET R1, Handler\n"
+           "STOR R1, R0\n" +
+           main;
+}
+
+struct FaultMachine
+{
+    // An undecodable word goes between head and tail
+    FaultMachine(const std::string& head, const std::string& tail = "") : cpu(programMemory)
+    {
+        Assembler asmObj;
+        std::vector<uint8_t> program = asmObj.AssembleString(head);
+        if (!tail.empty())
+        {
+            program.push_back(0xff);
+            program.push_back(0xff);
+            const auto rest = asmObj.AssembleString(tail);
+            program.insert(program.end(), rest.begin(), rest.end());
+        }
+        programMemory.WritePayload(0, program);
+        cpu.SetVectorTable(VectorTable);
+    }
+
+    Memory16 programMemory{0x10000};
+    Processor cpu;
+};
+}  // namespace
+
+TEST(TestFaultsSuite, TestHandlerSkipsInvalidInstruction)
+{
+    FaultMachine machine(WithHandler(Fault::InvalidInstruction, skipHandler, "INC R10\n"),
+                         "INC R10\nSTOP");
+    Processor& cpu = machine.cpu;
+    ASSERT_EQ(cpu.Run(1000), StopReason::Halted);
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::R10), 2);
+    ASSERT_EQ(cpu.GetHandledFaultCount(), 1);
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::RSP), RSP_DefaultAddress);
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::RFL) & static_cast<uint16_t>(FlagsRegister::Interrupt),
+              0);
+
+    // Same thing a cycle at a time
+    FaultMachine stepped(WithHandler(Fault::InvalidInstruction, skipHandler, "INC R10\n"),
+                         "INC R10\nSTOP");
+    for (int cycle = 0; cycle < 100; ++cycle)
+    {
+        stepped.cpu.PerformExecutionCycle();
+    }
+    ASSERT_EQ(stepped.cpu.ReadRegister(RegisterId::R10), 2);
+    ASSERT_EQ(stepped.cpu.GetInstructionCount(), cpu.GetInstructionCount());
+}
+
+TEST(TestFaultsSuite, TestFaultingInstructionIsRetried)
+{
+    // The handler points R0 somewhere valid and LOAD runs again
+    FaultMachine machine(WithHandler(Fault::AddressOutOfRange,
+                                     "SET R0, h'2000\n"
+                                     "POP RFL\n"
+                                     "POP RIP\n",
+                                     "SET R3, 42\n"
+                                     "SET R5, h'2000\n"
+                                     "STOR R3, R5\n"
+                                     "SET R0, h'ffff\n"
+                                     "SET R4, 7\n"
+                                     "LOAD R0, R4\n"
+                                     "STOP"));
+    Processor& cpu = machine.cpu;
+    ASSERT_EQ(cpu.Run(1000), StopReason::Halted);
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::R4), 42);
+    ASSERT_EQ(cpu.GetHandledFaultCount(), 1);
+}
+
+TEST(TestFaultsSuite, TestMissingNVRamIsHandled)
+{
+    FaultMachine machine(
+        WithHandler(Fault::NVRamUnavailable, skipHandler, "SWM\nINC R10\nSTOP"));
+    Processor& cpu = machine.cpu;
+    ASSERT_EQ(cpu.Run(1000), StopReason::Halted);
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::R10), 1);
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::RFL) & static_cast<uint16_t>(FlagsRegister::Memory), 0);
+}
+
+TEST(TestFaultsSuite, TestDivideByZeroIsATrap)
+{
+    FaultMachine machine(WithHandler(Fault::DivideByZero,
+                                     "INC R9\n"
+                                     "POP RFL\n"
+                                     "POP RIP\n",
+                                     "SET R2, 5\n"
+                                     "SET R3, 0\n"
+                                     "DIV R2, R3, R4\n"
+                                     "INC R10\n"
+                                     "STOP"));
+    Processor& cpu = machine.cpu;
+    ASSERT_EQ(cpu.Run(1000), StopReason::Halted);
+    // Entered once, and returned past the division
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::R9), 1);
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::R10), 1);
+    ASSERT_NE(cpu.ReadRegister(RegisterId::RFL) & static_cast<uint16_t>(FlagsRegister::Exception),
+              0);
+}
+
+TEST(TestFaultsSuite, TestUnhandledFaultStops)
+{
+    // There is a table, but nothing for AddressOutOfRange in it
+    const std::string program = WithHandler(Fault::DivideByZero,
+                                            "POP RFL\n"
+                                            "POP RIP\n",
+                                            "SET R0, h'ffff\n"
+                                            "LOAD R0, R4\n"
+                                            "STOP");
+    FaultMachine machine(program);
+    Processor& cpu = machine.cpu;
+    ASSERT_EQ(cpu.Run(1000), StopReason::Fault);
+    ASSERT_EQ(cpu.GetLastFault(), Fault::AddressOutOfRange);
+    ASSERT_NE(cpu.GetFaultMessage().find("out of range"), std::string::npos);
+    // Left on the LOAD, right before the STOP
+    const auto size = Assembler().AssembleString(program).size();
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::RIP), size - 4);
+    ASSERT_EQ(cpu.GetHandledFaultCount(), 0);
+
+    FaultMachine again(program);
+    EXPECT_THROW(again.cpu.ExecuteAll(), std::runtime_error);
+}
+
+TEST(TestFaultsSuite, TestDoubleFaultStops)
+{
+    // The handler faults on its first instruction, the same way the program did
+    FaultMachine machine(WithHandler(Fault::AddressOutOfRange,
+                                     "LOAD R0, R4\n"
+                                     "POP RFL\n"
+                                     "POP RIP\n",
+                                     "SET R0, h'ffff\n"
+                                     "LOAD R0, R4\n"
+                                     "STOP"));
+    Processor& cpu = machine.cpu;
+    ASSERT_EQ(cpu.Run(1000), StopReason::Fault);
+    ASSERT_EQ(cpu.GetLastFault(), Fault::AddressOutOfRange);
+    ASSERT_EQ(cpu.GetHandledFaultCount(), 1);
+    // Stuck at the start of the handler
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::RIP), 4);
+}
+
+TEST(TestFaultsSuite, TestHandlerWithoutStackStops)
+{
+    // RIP would fit at h'fffe but RFL would wrap around to h'0000
+    for (const uint16_t rsp : {0xffff, 0xfffe})
+    {
+        FaultMachine machine(WithHandler(Fault::AddressOutOfRange,
+                                         "POP RFL\n"
+                                         "POP RIP\n",
+                                         "SET RSP, " + std::to_string(rsp) +
+                                             "\n"
+                                             "SET R0, h'ffff\n"
+                                             "LOAD R0, R4\n"
+                                             "STOP"));
+        Processor& cpu = machine.cpu;
+        ASSERT_EQ(cpu.Run(1000), StopReason::Fault);
+        ASSERT_EQ(cpu.GetLastFault(), Fault::AddressOutOfRange);
+        ASSERT_NE(cpu.GetFaultMessage().find("Double fault"), std::string::npos);
+        ASSERT_EQ(cpu.GetHandledFaultCount(), 0);
+        // Nothing was pushed, still on the LOAD
+        ASSERT_EQ(cpu.ReadRegister(RegisterId::RSP), rsp);
+        ASSERT_EQ(cpu.Snapshot().sram.Read16(0), 0);
+        ASSERT_EQ(cpu.ReadRegister(RegisterId::RFL) &
+                      static_cast<uint16_t>(FlagsRegister::Interrupt),
+                  0);
+    }
+}
+
+TEST(TestFaultsSuite, TestInterruptIntoDeviceStackStops)
+{
+    FaultMachine machine(WithHandler(Fault::None,
+                                     "POP RFL\n"
+                                     "POP RIP\n",
+                                     "SET RSP, h'fc00\n"
+                                     "TRAP\n"
+                                     "STOP"));
+    Processor& cpu = machine.cpu;
+    std::ostringstream console;
+    cpu.GetBus().Map(
+        ConsoleDevice::DefaultBase, DeviceBus::PageSize, std::make_shared<ConsoleDevice>(console));
+    ASSERT_EQ(cpu.Run(1000), StopReason::Trap);
+
+    cpu.WriteRegister(RegisterId::RFL, 0);
+    cpu.RaiseInterrupt();
+    ASSERT_EQ(cpu.Run(1000), StopReason::Fault);
+    ASSERT_NE(cpu.GetFaultMessage().find("interrupt"), std::string::npos);
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::RSP), 0xfc00);
+    ASSERT_TRUE(console.str().empty());
+    // Still waiting for a stack to be taken on
+    ASSERT_EQ(cpu.Run(1000), StopReason::Fault);
+    cpu.WriteRegister(RegisterId::RSP, RSP_DefaultAddress);
+    ASSERT_EQ(cpu.Run(1000), StopReason::Halted);
+}
+
+TEST(TestFaultsSuite, TestUnfinishedCycleFaults)
+{
+    FaultMachine machine("SET R0, 1\nINC R0\nSTOP");
+    Processor& cpu = machine.cpu;
+    cpu.PerformExecutionCycle();
+    // A cycle cut off after decoding, which only a made up snapshot has
+    ProcessorSnapshot snapshot = cpu.Snapshot();
+    snapshot.decodedOpCodeId = OpCodeId::INC;
+    snapshot.instructionArgCount = 1;
+    cpu.Restore(snapshot);
+
+    EXPECT_THROW(cpu.PerformExecutionCycle(), std::runtime_error);
+    ASSERT_EQ(cpu.GetLastFault(), Fault::InvalidInstruction);
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::RIP), 4);
+    // The fault threw the unfinished cycle away, the INC runs as usual
+    cpu.PerformExecutionCycle();
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::R0), 2);
+}
@@ -0,0 +1,50 @@
+#include <gtest/gtest.h>
+
+#include "assembler.h"
+#include "memory.h"
+#include "processor.h"
+
+using Memory16 = Memory<uint16_t>;
+
+TEST(TestInstructionProfileSuite, TestCountsSequencesInBlocks)
+{
+    Assembler asmObj;
+    std::string program =
+        "SET R0, 10\n"
+        "SET R10, 0\n"
+        "goto:R2\n"
+        "INC R10\n"
+        "SUB R0, R10, R1\n"
+        "JNZ R1, R2\n"
+        "STOP";
+
+    Memory16 programMemory(0x10000);
+    programMemory.WritePayload(0, asmObj.AssembleString(program));
+    Processor cpu(programMemory);
+    ASSERT_EQ(cpu.GetProfile(), nullptr);
+    cpu.EnableProfiling(true);
+    cpu.ExecuteAll();
+
+    const InstructionProfile* profile = cpu.GetProfile();
+    ASSERT_NE(profile, nullptr);
+
+    // One loop pass starts in the first block, the other nine jump back to the loop block
+    auto triples = profile->Top(3, 1);
+    ASSERT_EQ(triples.size(), 1);
+    ASSERT_EQ(triples[0].opCodes,
+              std::vector<OpCodeId>({OpCodeId::INC, OpCodeId::SUB, OpCodeId::JNZ}));
+    ASSERT_EQ(triples[0].count, 10);
+
+    // JNZ -> INC crosses a block boundary and is not a fusion candidate
+    auto pairs = profile->Top(2, 10);
+    ASSERT_EQ(pairs.size(), 4);
+    for (const auto& pair : pairs)
+    {
+        ASSERT_NE(pair.opCodes, std::vector<OpCodeId>({OpCodeId::JNZ, OpCodeId::INC}));
+    }
+    ASSERT_EQ(pairs.back().opCodes, std::vector<OpCodeId>({OpCodeId::SET, OpCodeId::INC}));
+    ASSERT_EQ(pairs.back().count, 1);
+
+    ASSERT_NE(profile->Report().find("INC SUB JNZ"), std::string::npos);
+    ASSERT_THROW(profile->Top(4, 1), std::invalid_argument);
+}
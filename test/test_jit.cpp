@@ -0,0 +1,227 @@
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include "assembler.h"
+#include "memory.h"
+#include "processor.h"
+
+using Memory16 = Memory<uint16_t>;
+
+namespace
+{
+std::array<uint16_t, 16> RunProgram(const std::vector<uint8_t>& binProgram,
+                                    ExecutionEngine engine,
+                                    JitStats* jitStats = nullptr)
+{
+    Memory16 programMemory(0x10000);
+    programMemory.WritePayload(0, binProgram);
+    Processor cpu(programMemory);
+    cpu.SetExecutionEngine(engine);
+    cpu.ExecuteAll();
+
+    std::array<uint16_t, 16> registers;
+    for (uint8_t i = 0; i < registers.size(); ++i)
+    {
+        registers[i] = cpu.ReadRegister(static_cast<RegisterId>(i));
+    }
+    if (jitStats != nullptr)
+    {
+        *jitStats = cpu.GetJitStats();
+    }
+    return registers;
+}
+
+// A loop running a random body of register only instructions, hot enough to get compiled
+std::string RandomLoopProgram(std::mt19937& rng)
+{
+    static const std::array<std::string, 9> threeArgs = {
+        "ADD", "SUB", "MUL", "SMUL", "AND", "OR", "XOR", "ADD", "SUB"};
+    static const std::array<std::string, 7> oneArg = {
+        "NOT", "SHFR", "SHFL", "INC", "DEC", "SETZ", "SETO"};
+    // Sources may read RFL, that's how the flags computed by the JIT get checked
+    static const std::array<std::string, 12> sources = {
+        "RAC", "RFL", "R0", "R1", "R2", "R3", "R4", "R5", "R6", "R7", "R8", "R9"};
+    static const std::array<std::string, 11> destinations = {
+        "RAC", "R0", "R1", "R2", "R3", "R4", "R5", "R6", "R7", "R8", "R9"};
+
+    auto pick = [&rng](const auto& list) { return list[rng() % list.size()]; };
+
+    std::string program;
+    for (const auto& reg : destinations)
+    {
+        program += "SET " + reg + ", " + std::to_string(rng() & 0xffff) + "\n";
+    }
+    program +=
+        "SET R10, 40\n"
+        "SET RBP, Loop\n"
+        ":Loop\n";
+    for (int i = 0; i < 48; ++i)
+    {
+        switch (rng() % 6)
+        {
+            case 0:
+            case 1:
+                program += pick(threeArgs) + " " + pick(sources) + ", " + pick(sources) + ", " +
+                           pick(destinations) + "\n";
+                break;
+            case 2:
+                program += pick(oneArg) + " " + pick(destinations) + "\n";
+                break;
+            case 3:
+                program += "NOP\n";
+                break;
+            case 4:
+                program += "MOV " + pick(sources) + ", " + pick(destinations) + "\n";
+                break;
+            default:
+                program +=
+                    "SET " + pick(destinations) + ", " + std::to_string(rng() & 0xffff) + "\n";
+                break;
+        }
+    }
+    program +=
+        "DEC R10\n"
+        "JNZ R10, RBP\n"
+        "STOP\n";
+    return program;
+}
+}  // namespace
+
+TEST(TestJitSuite, TestLoopMatchesInterpreter)
+{
+    if (!JitCompiler::IsAvailable())
+    {
+        GTEST_SKIP() << "No JIT on this host";
+    }
+
+    Assembler asmObj;
+    std::string program =
+        "SET R0, 1000\n"
+        "SET R10, 0\n"
+        "SET RAC, 500\n"
+        "SET R3, Equal\n"
+        "goto:R2\n"
+        "INC R10\n"
+        "JE R10, R3\n"
+        ":Back\n"
+        "SUB R0, R10, R1\n"
+        "JNZ R1, R2\n"
+        "STOP\n"
+        ":Equal\n"
+        "SET R5, h'cafe\n"
+        "JMP Back\n";
+    auto binProgram = asmObj.AssembleString(program);
+
+    JitStats stats;
+    auto interpreted = RunProgram(binProgram, ExecutionEngine::Interpreter);
+    auto jitted = RunProgram(binProgram, ExecutionEngine::Jit, &stats);
+
+    ASSERT_EQ(interpreted, jitted);
+    ASSERT_EQ(jitted[static_cast<uint8_t>(RegisterId::R10)], 1000);
+    ASSERT_EQ(jitted[static_cast<uint8_t>(RegisterId::R5)], 0xcafe);
+    ASSERT_GT(stats.compiledBlocks, 0);
+    ASSERT_GT(stats.executedBlocks, 900);
+}
+
+TEST(TestJitSuite, TestAluFlagsMatchInterpreter)
+{
+    if (!JitCompiler::IsAvailable())
+    {
+        GTEST_SKIP() << "No JIT on this host";
+    }
+
+    std::mt19937 rng(0x1badb002);
+    for (int i = 0; i < 24; ++i)
+    {
+        Assembler asmObj;
+        auto program = RandomLoopProgram(rng);
+        auto binProgram = asmObj.AssembleString(program);
+
+        JitStats stats;
+        auto interpreted = RunProgram(binProgram, ExecutionEngine::Interpreter);
+        auto jitted = RunProgram(binProgram, ExecutionEngine::Jit, &stats);
+
+        ASSERT_EQ(interpreted, jitted) << program;
+        ASSERT_GT(stats.executedBlocks, 0);
+    }
+}
+
+TEST(TestJitSuite, TestFallsBackForMemoryAndTrap)
+{
+    if (!JitCompiler::IsAvailable())
+    {
+        GTEST_SKIP() << "No JIT on this host";
+    }
+
+    Assembler asmObj;
+    std::string program =
+        "SET R0, 100\n"
+        "SET R3, h'1000\n"
+        "goto:R2\n"
+        "INC R10\n"
+        "ADD R10, R10, R4 ; compiled\n"
+        "STOR R4, R3 ; from here on the interpreter takes over\n"
+        "PUSH R4\n"
+        "POP R5\n"
+        "LOAD R3, R6\n"
+        "DEC R0\n"
+        "JNZ R0, R2\n"
+        "TRAP\n"
+        "STOP\n";
+    auto binProgram = asmObj.AssembleString(program);
+
+    Memory16 programMemory(0x10000);
+    programMemory.WritePayload(0, binProgram);
+    Processor cpu(programMemory);
+    cpu.SetExecutionEngine(ExecutionEngine::Jit);
+    cpu.ExecuteAll();
+
+    // Stopped on the TRAP
+    FlagsObject f(cpu.ReadRegister(RegisterId::RFL));
+    ASSERT_EQ(f.flags.Trap, 1);
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::R10), 100);
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::R6), 200);
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::R5), 200);
+    ASSERT_GT(cpu.GetJitStats().executedBlocks, 0);
+
+    // Switching engines at runtime
+    cpu.SetExecutionEngine(ExecutionEngine::Interpreter);
+    f.flags.Trap = 0;
+    cpu.WriteRegister(RegisterId::RFL, f.value);
+    cpu.ExecuteAll();
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::RIP), binProgram.size());
+}
+
+TEST(TestJitSuite, TestCodeIsNeverWritableAndExecutable)
+{
+    if (!JitCompiler::IsAvailable())
+    {
+        GTEST_SKIP() << "No JIT on this host";
+    }
+
+    Assembler asmObj;
+    Memory16 programMemory(0x10000);
+    programMemory.WritePayload(0,
+                               asmObj.AssembleString("SET R0, 100\n"
+                                                     "goto:R2\n"
+                                                     "INC R10\n"
+                                                     "DEC R0\n"
+                                                     "JNZ R0, R2\n"
+                                                     "STOP\n"));
+    Processor cpu(programMemory);
+    cpu.SetExecutionEngine(ExecutionEngine::Jit);
+    cpu.ExecuteAll();
+    ASSERT_GT(cpu.GetJitStats().compiledBlocks, 0);
+
+    // The arena is still mapped, none of the process mappings may be rwx
+    std::ifstream maps("/proc/self/maps");
+    std::string line;
+    while (std::getline(maps, line))
+    {
+        std::istringstream fields(line);
+        std::string range, permissions;
+        fields >> range >> permissions;
+        ASSERT_NE(permissions.substr(0, 3), "rwx") << line;
+    }
+}
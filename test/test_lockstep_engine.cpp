@@ -0,0 +1,162 @@
+#include <gtest/gtest.h>
+
+#include "assembler.h"
+#include "lockstep_engine.h"
+
+namespace
+{
+// Lane i starts with R0 = seeds[i] and R1 = i, the same goes for its scalar twin
+struct ScalarResult
+{
+    StopReason reason;
+    uint64_t instructions;
+    RegisterFile registers;
+};
+
+ScalarResult RunScalar(const std::vector<uint8_t>& binProgram, uint16_t seed, uint16_t index,
+                       uint64_t budget)
+{
+    Memory16 programMemory(MainMemorySize);
+    programMemory.WritePayload(0, binProgram);
+    Processor cpu(programMemory);
+    cpu.WriteRegister(RegisterId::R0, seed);
+    cpu.WriteRegister(RegisterId::R1, index);
+
+    ScalarResult result{cpu.Run(budget), 0, {}};
+    result.instructions = cpu.GetInstructionCount();
+    for (size_t i = 0; i < result.registers.size(); ++i)
+    {
+        result.registers[i] = cpu.ReadRegister(static_cast<RegisterId>(i));
+    }
+    return result;
+}
+
+void ExpectMatchesScalar(const std::string& program, const std::vector<uint16_t>& seeds,
+                         uint64_t budget = std::numeric_limits<uint64_t>::max())
+{
+    Assembler asmObj;
+    auto binProgram = asmObj.AssembleString(program);
+
+    LockstepEngine engine(binProgram, seeds.size());
+    for (size_t lane = 0; lane < seeds.size(); ++lane)
+    {
+        engine.WriteRegister(lane, RegisterId::R0, seeds[lane]);
+        engine.WriteRegister(lane, RegisterId::R1, static_cast<uint16_t>(lane));
+    }
+    engine.Run(budget);
+
+    for (size_t lane = 0; lane < seeds.size(); ++lane)
+    {
+        auto expected = RunScalar(binProgram, seeds[lane], static_cast<uint16_t>(lane), budget);
+        ASSERT_EQ(engine.GetStopReason(lane), expected.reason) << "lane " << lane;
+        ASSERT_EQ(engine.GetInstructionCount(lane), expected.instructions) << "lane " << lane;
+        for (size_t i = 0; i < expected.registers.size(); ++i)
+        {
+            ASSERT_EQ(engine.ReadRegister(lane, static_cast<RegisterId>(i)),
+                      expected.registers[i])
+                << "lane " << lane << " register " << i;
+        }
+    }
+}
+
+// Every vectorized instruction, looping a number of times that depends on the seed
+const std::string sweepProgram =
+    "SET R2, h'1234\n"
+    "SETZ R3\n"
+    "SETO R4\n"
+    "SET R9, Done\n"
+    "goto:R10\n"
+    "ADD R2, R0, R2\n"
+    "XOR R2, R4, R5\n"
+    "AND R5, R0, R6\n"
+    "OR R6, R1, R6\n"
+    "SHFL R6\n"
+    "SHFR R5\n"
+    "NOT R5\n"
+    "SUB R2, R5, R7\n"
+    "MOV R7, R8\n"
+    "INC R3\n"
+    "DEC R4\n"
+    "MOV R0, RAC\n"
+    "JE R3, R9\n"
+    "JMP Loop\n"
+    ":Loop\n"
+    "JNZ R4, R10\n"
+    "STOP\n"
+    ":Done ; past the loop, so lanes that got here wait for the rest\n"
+    "NOP\n"
+    "STOP\n";
+}  // namespace
+
+TEST(TestLockstepEngineSuite, TestMatchesScalarProcessor)
+{
+    // Not a multiple of any vector width, and with every lane leaving the loop at its own time
+    std::vector<uint16_t> seeds;
+    for (uint16_t lane = 0; lane < 37; ++lane)
+    {
+        seeds.push_back(static_cast<uint16_t>(lane % 5 + 1));
+    }
+    ExpectMatchesScalar(sweepProgram, seeds);
+}
+
+TEST(TestLockstepEngineSuite, TestDivergedLanesFallBack)
+{
+    // Lane 0 loops for much longer than the rest, which stop early. Those would be waiting on it
+    // for thousands of blocks.
+    std::vector<uint16_t> seeds(20, 3);
+    seeds[0] = 5000;
+
+    Assembler asmObj;
+    LockstepEngine engine(asmObj.AssembleString(sweepProgram), seeds.size());
+    for (size_t lane = 0; lane < seeds.size(); ++lane)
+    {
+        engine.WriteRegister(lane, RegisterId::R0, seeds[lane]);
+    }
+    engine.Run();
+    ASSERT_GT(engine.GetStats().scalarLanes, 0);
+    ASSERT_GT(engine.GetStats().laneInstructions, 0);
+
+    ExpectMatchesScalar(sweepProgram, seeds);
+}
+
+TEST(TestLockstepEngineSuite, TestUnsupportedInstructionsRunScalar)
+{
+    std::string program =
+        "SET R2, 7\n"
+        "ADD R0, R2, R3\n"
+        "MUL R3, R1, R4 ; no kernel for MUL\n"
+        "PUSH R4\n"
+        "POP R5\n"
+        "TRAP\n"
+        "STOP\n";
+    std::vector<uint16_t> seeds = {1, 2, 3, 0xfffe};
+    ExpectMatchesScalar(program, seeds);
+
+    Assembler asmObj;
+    LockstepEngine engine(asmObj.AssembleString(program), seeds.size());
+    engine.Run();
+    for (size_t lane = 0; lane < seeds.size(); ++lane)
+    {
+        ASSERT_TRUE(engine.IsScalar(lane));
+        ASSERT_EQ(engine.GetStopReason(lane), StopReason::Trap);
+    }
+
+    // Running off the end of the program is a fault, same as on a Processor
+    ExpectMatchesScalar("SET R2, 7\nADD R0, R2, R3\n", seeds);
+}
+
+TEST(TestLockstepEngineSuite, TestInstructionBudget)
+{
+    std::vector<uint16_t> seeds = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+    for (uint64_t budget : {0, 1, 10, 33, 100, 1000})
+    {
+        ExpectMatchesScalar(sweepProgram, seeds, budget);
+    }
+}
+
+TEST(TestLockstepEngineSuite, TestKernelName)
+{
+    const std::string name = LockstepEngine::KernelName();
+    ASSERT_TRUE(name == "avx2" || name == "sse2" || name == "scalar") << name;
+    ASSERT_THROW(LockstepEngine({}, 0), std::invalid_argument);
+}
@@ -2,6 +2,7 @@
 
 #include "common.h"
 #include "memory.h"
+#include "scratch_file.h"
 
 class TestNVMemory : public NVMemory<uint16_t>
 {
@@ -30,6 +31,32 @@ TEST(TestMemorySuite, TestBasicReadWrite)
     EXPECT_ANY_THROW(mem.Write8(0xffaa, 0xad));
 }
 
+TEST(TestMemorySuite, TestFullAddressSpaceWords)
+{
+    Memory16 mem(Memory16::AddressSpaceSize);
+    mem.Write16(0x1234, 0xbeef);
+    EXPECT_EQ(mem.Read8(0x1234), 0xbe);
+    EXPECT_EQ(mem.Read8(0x1235), 0xef);
+    EXPECT_EQ(mem.Read16(0x1234), 0xbeef);
+
+    // Words straddling two pages
+    mem.Write16(0x12ff, 0xcafe);
+    EXPECT_EQ(mem.Read8(0x12ff), 0xca);
+    EXPECT_EQ(mem.Read8(0x1300), 0xfe);
+    EXPECT_EQ(mem.Read16(0x12ff), 0xcafe);
+
+    // Writes wrap around at the top, reads don't
+    mem.Write16(0xffff, 0xf00d);
+    EXPECT_EQ(mem.Read8(0xffff), 0xf0);
+    EXPECT_EQ(mem.Read8(0x0000), 0x0d);
+    EXPECT_THROW(mem.Read16(0xffff), std::out_of_range);
+
+    // Anything smaller still gets checked
+    Memory16 small(0x1000);
+    EXPECT_THROW(small.Read16(0x1000), std::out_of_range);
+    EXPECT_THROW(small.Write16(0x2000, 0), std::out_of_range);
+}
+
 // TODO Test write
 TEST(TestMemorySuite, TestNonVolatileMemoryReadWrite)
 {
@@ -132,4 +159,74 @@ TEST(TestMemorySuite, TestWriteShellcode)
     ASSERT_EQ(mem.Read16(0), 0x00de);
     ASSERT_EQ(mem.Read16(2), 0xadbe);
     ASSERT_EQ(mem.Read16(4), 0xef00);
-}
\ No newline at end of file
+}
+TEST(TestMemorySuite, TestCopyOnWritePages)
+{
+    Memory16 mem(0x10000);
+    mem.Write16(0x00ff, 0xcafe);  // Straddles the first two pages
+    ASSERT_EQ(mem.Read16(0x00ff), 0xcafe);
+    ASSERT_EQ(mem.CopiedPages(), 2);  // Both came from the shared zero page
+
+    Memory16 copy(mem);
+    ASSERT_EQ(copy.Read16(0x00ff), 0xcafe);
+    ASSERT_EQ(copy.CopiedPages(), 0);
+
+    copy.Write8(0x0100, 0x00);
+    ASSERT_EQ(copy.CopiedPages(), 1);
+    ASSERT_EQ(copy.Read16(0x00ff), 0xca00);
+    ASSERT_EQ(mem.Read16(0x00ff), 0xcafe);
+
+    // Nobody else holds these pages anymore, writing them again copies nothing
+    copy.Write8(0x0101, 0x01);
+    mem.Write8(0x0100, 0x02);
+    ASSERT_EQ(copy.CopiedPages(), 1);
+    ASSERT_EQ(mem.CopiedPages(), 2);
+    ASSERT_EQ(mem.Read8(0x0101), 0x00);
+
+    EXPECT_ANY_THROW(Memory16(0x100).Read16(0xff));
+    EXPECT_ANY_THROW(Memory16(0x100).WritePayload(0xfe, "\x01\x02\x03", 3));
+}
+
+TEST(TestMemorySuite, TestMappedNonVolatileMemory)
+{
+    if (!NVMemory<uint16_t>::IsMappingAvailable())
+    {
+        GTEST_SKIP() << "No mapped NVRAM on this host";
+    }
+    const ScratchFile scratch("mapped_nvmemory");
+    const std::string& filename = scratch.name;
+    // Shorter than the memory, the rest reads as zeroes
+    std::ofstream(filename, std::ios::binary | std::ios::trunc).write("\xde\xad", 2);
+
+    {
+        NVMemory<uint16_t> mem(0x10000, filename, NVMemoryMode::Mapped);
+        ASSERT_EQ(mem.Read16(0), 0xdead);
+        ASSERT_EQ(mem.Read16(0x8000), 0);
+
+        mem.Write16(0x1234, 0xcafe);
+        mem.Write8(0x12ff, 0x01);
+        ASSERT_EQ(mem.DirtyPages(), 1);
+
+        // A copy shares the mapped pages, writing one moves it off the mapping
+        Memory<uint16_t> copy(mem);
+        mem.Write16(0x8000, 0xf00d);
+        ASSERT_EQ(copy.Read16(0x8000), 0);
+        ASSERT_EQ(mem.DirtyPages(), 2);
+
+        mem.Flush();
+        ASSERT_EQ(mem.DirtyPages(), 0);
+        ASSERT_EQ(mem.Read16(0x1234), 0xcafe);
+
+        // Written after the last flush, still makes it to the file on destruction
+        mem.Write8(0xffff, 0x42);
+    }
+
+    const std::vector<uint8_t> contents = ReadFile(filename);
+    ASSERT_EQ(contents.size(), 0x10000);
+    ASSERT_EQ(contents[0x1234], 0xca);
+    ASSERT_EQ(contents[0x1235], 0xfe);
+    ASSERT_EQ(contents[0x12ff], 0x01);
+    ASSERT_EQ(contents[0x8000], 0xf0);
+    ASSERT_EQ(contents[0x8001], 0x0d);
+    ASSERT_EQ(contents[0xffff], 0x42);
+}
@@ -0,0 +1,145 @@
+#include <gtest/gtest.h>
+
+#include "assembler.h"
+#include "nvram_flusher.h"
+#include "processor.h"
+#include "scratch_file.h"
+
+TEST(TestNVRamFlusherSuite, TestBarrierWritesDirtyPages)
+{
+    if (!NVRamFlusher::IsAvailable())
+    {
+        GTEST_SKIP() << "No background NVRAM flushing on this host";
+    }
+    const ScratchFile file("nvram_flusher", 0x10000);
+    NVMemory16 nvram(0x10000, file.name);
+    // Never due on its own, only the barriers write anything
+    NVRamFlusher flusher(nvram, std::chrono::hours(1));
+
+    nvram.Write16(0x0100, 0xcafe);
+    nvram.Write16(0x01fe, 0xf00d);
+    nvram.Write8(0xffff, 0x42);
+    ASSERT_EQ(ReadFile(file.name)[0x0100], 0);
+
+    flusher.Barrier();
+    auto contents = ReadFile(file.name);
+    ASSERT_EQ(contents[0x0100], 0xca);
+    ASSERT_EQ(contents[0x01ff], 0x0d);
+    ASSERT_EQ(contents[0xffff], 0x42);
+    ASSERT_EQ(flusher.GetStats().pagesWritten, 2);
+    ASSERT_EQ(nvram.DirtyPages(), 0);
+
+    // Nothing new to write, but a sync still goes to disk
+    flusher.Barrier();
+    flusher.Sync();
+    ASSERT_EQ(flusher.GetStats().pagesWritten, 2);
+    ASSERT_EQ(flusher.GetStats().syncs, 1);
+}
+
+TEST(TestNVRamFlusherSuite, TestGuestKeepsWritingWhileFlushing)
+{
+    if (!NVRamFlusher::IsAvailable())
+    {
+        GTEST_SKIP() << "No background NVRAM flushing on this host";
+    }
+    const ScratchFile file("nvram_flusher", 0x10000);
+    NVMemory16 nvram(0x10000, file.name);
+    NVRamFlusher flusher(nvram, std::chrono::milliseconds(1));
+
+    const auto start = std::chrono::steady_clock::now();
+    uint16_t value = 0;
+    while (flusher.GetStats().captures < 5 &&
+           std::chrono::steady_clock::now() - start < std::chrono::seconds(10))
+    {
+        ++value;
+        for (uint16_t address = 0; address < 0x1000; address += 0x100)
+        {
+            nvram.Write16(address, value);
+        }
+    }
+    ASSERT_GE(flusher.GetStats().captures, 5);
+
+    // Captured pages were copied away from under the writer, the guest sees its own writes only
+    for (uint16_t address = 0; address < 0x1000; address += 0x100)
+    {
+        ASSERT_EQ(nvram.Read16(address), value);
+    }
+    flusher.Sync();
+    auto contents = ReadFile(file.name);
+    for (uint16_t address = 0; address < 0x1000; address += 0x100)
+    {
+        ASSERT_EQ(contents[address], value >> 8);
+        ASSERT_EQ(contents[address + 1], value & 0xff);
+    }
+}
+
+TEST(TestNVRamFlusherSuite, TestPollCatchesUpWithQuietGuest)
+{
+    if (!NVRamFlusher::IsAvailable())
+    {
+        GTEST_SKIP() << "No background NVRAM flushing on this host";
+    }
+    const ScratchFile file("nvram_flusher", 0x10000);
+    NVMemory16 nvram(0x10000, file.name);
+    NVRamFlusher flusher(nvram, std::chrono::milliseconds(1));
+
+    // One write and then nothing, only polling gets it to the file
+    nvram.Write16(0x0100, 0xcafe);
+    const auto start = std::chrono::steady_clock::now();
+    while (ReadFile(file.name)[0x0100] != 0xca &&
+           std::chrono::steady_clock::now() - start < std::chrono::seconds(10))
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        flusher.Poll();
+    }
+    auto contents = ReadFile(file.name);
+    ASSERT_EQ(contents[0x0100], 0xca);
+    ASSERT_EQ(contents[0x0101], 0xfe);
+}
+
+TEST(TestNVRamFlusherSuite, TestAttachedFlusherCatchesUpWithQuietGuest)
+{
+    if (!NVRamFlusher::IsAvailable())
+    {
+        GTEST_SKIP() << "No background NVRAM flushing on this host";
+    }
+    const ScratchFile file("nvram_flusher", 0x10000);
+    auto nvram = std::make_shared<NVMemory16>(0x10000, file.name);
+    // One write to NVRAM, then nothing but spinning
+    Assembler asmObj;
+    auto binProgram = asmObj.AssembleString(
+        "SWM\n"
+        "SET R0, h'0100\n"
+        "SET R1, h'cafe\n"
+        "STOR R1, R0\n"
+        "SWM\n"
+        ":Idle\n"
+        "JMP Idle\n");
+    Memory16 programMemory(0x10000);
+    programMemory.WritePayload(0, binProgram);
+    Processor cpu(programMemory, nvram);
+    NVRamFlusher flusher(*nvram, std::chrono::milliseconds(1));
+    flusher.Attach(cpu, 1000);
+
+    const auto start = std::chrono::steady_clock::now();
+    while (ReadFile(file.name)[0x0100] != 0xca &&
+           std::chrono::steady_clock::now() - start < std::chrono::seconds(10))
+    {
+        cpu.Run(100000);
+    }
+    auto contents = ReadFile(file.name);
+    ASSERT_EQ(contents[0x0100], 0xca);
+    ASSERT_EQ(contents[0x0101], 0xfe);
+    ASSERT_THROW(flusher.Attach(cpu, 0), std::invalid_argument);
+}
+
+TEST(TestNVRamFlusherSuite, TestMappedNVRamIsRejected)
+{
+    if (!NVRamFlusher::IsAvailable() || !NVMemory16::IsMappingAvailable())
+    {
+        GTEST_SKIP() << "No background NVRAM flushing on this host";
+    }
+    const ScratchFile file("nvram_flusher", 0x10000);
+    NVMemory16 nvram(0x10000, file.name, NVMemoryMode::Mapped);
+    ASSERT_THROW(NVRamFlusher flusher(nvram), std::invalid_argument);
+}
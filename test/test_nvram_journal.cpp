@@ -0,0 +1,156 @@
+#include <gtest/gtest.h>
+
+#include "nvram_journal.h"
+#include "scratch_file.h"
+
+namespace
+{
+// A zeroed NVRAM image, its journal goes next to it and is removed along with it
+struct NVRamFile : ScratchFile
+{
+    NVRamFile() : ScratchFile("nvram_journal", 0x10000), journal(NVRamJournal::JournalPath(name))
+    {
+    }
+
+    std::string journal;
+};
+}  // namespace
+
+TEST(TestNVRamJournalSuite, TestReplayAfterReopen)
+{
+    if (!NVRamJournal::IsAvailable())
+    {
+        GTEST_SKIP() << "No NVRAM journal on this host";
+    }
+    NVRamFile file;
+    {
+        NVMemory16 nvram(0x10000, file.name, NVMemoryMode::Journaled);
+        NVRamJournal journal(nvram);
+        nvram.Write16(0x0100, 0xcafe);
+        nvram.Write16(0x0100, 0xbeef);
+        nvram.Write8(0xffff, 0x42);
+        journal.Flush();
+        ASSERT_EQ(journal.GetStats().recordsAppended, 3);
+        // Only the journal gets written
+        ASSERT_EQ(ReadFile(file.name)[0x0100], 0);
+    }
+
+    NVMemory16 nvram(0x10000, file.name, NVMemoryMode::Journaled);
+    ASSERT_EQ(nvram.Read16(0x0100), 0);
+    NVRamJournal journal(nvram);
+    ASSERT_EQ(journal.GetStats().recordsReplayed, 3);
+    ASSERT_EQ(nvram.Read16(0x0100), 0xbeef);
+    ASSERT_EQ(nvram.Read8(0xffff), 0x42);
+}
+
+TEST(TestNVRamJournalSuite, TestTornTailIsDropped)
+{
+    if (!NVRamJournal::IsAvailable())
+    {
+        GTEST_SKIP() << "No NVRAM journal on this host";
+    }
+    NVRamFile file;
+    size_t goodSize = 0;
+    {
+        NVMemory16 nvram(0x10000, file.name, NVMemoryMode::Journaled);
+        NVRamJournal journal(nvram);
+        nvram.Write16(0x0200, 0x1234);
+        journal.Flush();
+        goodSize = ReadFile(file.journal).size();
+        nvram.Write16(0x0300, 0x5678);
+    }
+    // The second record only made it halfway to disk
+    auto log = ReadFile(file.journal);
+    log.resize(log.size() - 3);
+    std::ofstream(file.journal, std::ios::binary | std::ios::trunc)
+        .write(reinterpret_cast<const char*>(log.data()), static_cast<std::streamsize>(log.size()));
+
+    {
+        NVMemory16 nvram(0x10000, file.name, NVMemoryMode::Journaled);
+        NVRamJournal journal(nvram);
+        ASSERT_EQ(journal.GetStats().recordsReplayed, 1);
+        ASSERT_EQ(nvram.Read16(0x0200), 0x1234);
+        ASSERT_EQ(nvram.Read16(0x0300), 0);
+        // New records go after the last good one
+        ASSERT_EQ(ReadFile(file.journal).size(), goodSize);
+        nvram.Write8(0x0400, 0x99);
+    }
+    NVMemory16 nvram(0x10000, file.name, NVMemoryMode::Journaled);
+    NVRamJournal journal(nvram);
+    ASSERT_EQ(journal.GetStats().recordsReplayed, 2);
+    ASSERT_EQ(nvram.Read8(0x0400), 0x99);
+}
+
+TEST(TestNVRamJournalSuite, TestCompactionRewritesImage)
+{
+    if (!NVRamJournal::IsAvailable())
+    {
+        GTEST_SKIP() << "No NVRAM journal on this host";
+    }
+    NVRamFile file;
+    {
+        NVMemory16 nvram(0x10000, file.name, NVMemoryMode::Journaled);
+        NVRamJournal journal(nvram, 256);
+        for (uint16_t i = 0; i < 200; ++i)
+        {
+            nvram.Write16(static_cast<uint16_t>(i * 2), i);
+            journal.Flush();
+        }
+        journal.WaitForCompaction();
+        ASSERT_GE(journal.GetStats().compactions, 1);
+        ASSERT_LT(ReadFile(file.journal).size(), 200 * 10);
+    }
+
+    NVMemory16 nvram(0x10000, file.name, NVMemoryMode::Journaled);
+    ASSERT_EQ(nvram.Read16(0), 0);
+    ASSERT_EQ(nvram.Read16(2), 1);
+    NVRamJournal journal(nvram);
+    for (uint16_t i = 0; i < 200; ++i)
+    {
+        ASSERT_EQ(nvram.Read16(static_cast<uint16_t>(i * 2)), i);
+    }
+}
+
+TEST(TestNVRamJournalSuite, TestInterruptedCompactionIsFinished)
+{
+    if (!NVRamJournal::IsAvailable())
+    {
+        GTEST_SKIP() << "No NVRAM journal on this host";
+    }
+    NVRamFile file;
+    {
+        NVMemory16 nvram(0x10000, file.name, NVMemoryMode::Journaled);
+        NVRamJournal journal(nvram);
+        nvram.Write16(0x0010, 0x1111);
+        nvram.Write16(0x0020, 0x2222);
+        journal.Flush();
+    }
+    // Crashed after compaction dropped the old log, before the new one took its place
+    {
+        NVMemory16 nvram(0x10000, file.name, NVMemoryMode::Journaled);
+        NVRamJournal journal(nvram);
+        nvram.Write16(0x0010, 0x3333);
+    }
+    std::rename(file.journal.c_str(), (file.journal + ".next").c_str());
+    {
+        NVMemory16 nvram(0x10000, file.name, NVMemoryMode::Journaled);
+        NVRamJournal journal(nvram);
+        ASSERT_EQ(nvram.Read16(0x0010), 0x3333);
+        ASSERT_EQ(nvram.Read16(0x0020), 0x2222);
+    }
+    ASSERT_FALSE(std::ifstream(file.journal + ".next").good());
+    auto image = ReadFile(file.name);
+    ASSERT_EQ(image[0x0010], 0x33);
+    ASSERT_EQ(image[0x0021], 0x22);
+}
+
+TEST(TestNVRamJournalSuite, TestStreamNVRamIsRejected)
+{
+    if (!NVRamJournal::IsAvailable())
+    {
+        GTEST_SKIP() << "No NVRAM journal on this host";
+    }
+    NVRamFile file;
+    NVMemory16 nvram(0x10000, file.name);
+    ASSERT_THROW(NVRamJournal journal(nvram), std::invalid_argument);
+}
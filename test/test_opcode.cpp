@@ -58,3 +58,37 @@ TEST(TestOpCodesSuite, TestOverlappingOpcodes)
         std::cout << " to 0xffff" << std::endl;
     }
 }
+
+TEST(TestOpCodesSuite, TestDecodeTableMatchesOpCodeTable)
+{
+    for (uint32_t word = 0; word < 0x10000; ++word)
+    {
+        const DecodedInstruction& decoded = decodeTable[word];
+
+        // Find the opcode the slow way, by trying every opcode's position in the word
+        OpCodeId expectedId = OpCodeId::INVALID_INSTR;
+        for (const auto& [opCodeId, opCode] : opCodeTable)
+        {
+            if ((word >> (opCode.argCount * 4)) == opCode.opCode)
+            {
+                ASSERT_EQ(expectedId, OpCodeId::INVALID_INSTR) << "Overlap at " << word;
+                expectedId = opCodeId;
+            }
+        }
+        ASSERT_EQ(decoded.opCodeId, expectedId) << "Mismatch at " << word;
+        if (!decoded.IsValid())
+        {
+            continue;
+        }
+
+        const OpCode& opCode = opCodeTable.at(decoded.opCodeId);
+        ASSERT_EQ(decoded.argCount, opCode.argCount);
+        ASSERT_EQ(decoded.hasLiteral,
+                  decoded.opCodeId == OpCodeId::SET || decoded.opCodeId == OpCodeId::JMP);
+        for (int i = 0; i < decoded.argCount; ++i)
+        {
+            const auto nibble = (word >> (4 * (decoded.argCount - 1 - i))) & 0xf;
+            ASSERT_EQ(static_cast<uint8_t>(decoded.args[i]), nibble);
+        }
+    }
+}
@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+
+#include "assembler.h"
+#include "counter_device.h"
+#include "processor.h"
+#include "snapshot_file.h"
+
+namespace
+{
+// Four turns of a loop storing, loading and pushing, then a division by zero
+const std::string countedProgram =
+    "SET R0, 4\n"
+    "SET R10, 0\n"
+    "SET R3, h'2000\n"
+    "goto:R2\n"
+    "STOR R10, R3\n"
+    "LOAD R3, R4\n"
+    "PUSH R4\n"
+    "POP R5\n"
+    "INC R10\n"
+    "SUB R0, R10, R1\n"
+    "JNZ R1, R2\n"
+    "SET R6, 0\n"
+    "DIV R0, R6, R7\n"
+    "STOP\n";
+
+size_t Retired(const PerfCounters& counters, OpCodeId opCodeId)
+{
+    return counters.retired[static_cast<size_t>(opCodeId)];
+}
+}  // namespace
+
+TEST(TestPerfCountersSuite, TestEventsAreCounted)
+{
+    // The same counts whichever way the instructions get to run
+    for (bool stepped : {false, true})
+    {
+        Assembler asmObj;
+        Memory16 programMemory(0x10000);
+        programMemory.WritePayload(0, asmObj.AssembleString(countedProgram));
+        Processor cpu(programMemory);
+        if (stepped)
+        {
+            while (cpu.Run(1) == StopReason::BudgetExhausted)
+            {
+            }
+        }
+        else
+        {
+            cpu.ExecuteAll();
+        }
+
+        const PerfCounters counters = cpu.GetPerfCounters();
+        // 4 SETs, 4 turns of 7, the SET, DIV and STOP
+        ASSERT_EQ(counters.cycles, 4 + 4 * 7 + 3);
+        ASSERT_EQ(counters.instret, counters.cycles);
+        if (!PerfCounters::Enabled)
+        {
+            ASSERT_EQ(Retired(counters, OpCodeId::SET), 0);
+            ASSERT_EQ(counters.pushes, 0);
+            continue;
+        }
+        ASSERT_EQ(Retired(counters, OpCodeId::SET), 5);
+        ASSERT_EQ(Retired(counters, OpCodeId::INC), 4);
+        ASSERT_EQ(Retired(counters, OpCodeId::STOP), 1);
+        ASSERT_EQ(counters.branchesTaken, 3);
+        ASSERT_EQ(counters.branchesNotTaken, 1);
+        ASSERT_EQ(counters.loads[PerfCounters::Sram], 4);
+        ASSERT_EQ(counters.stores[PerfCounters::Sram], 4);
+        ASSERT_EQ(counters.loads[PerfCounters::NVRam], 0);
+        ASSERT_EQ(counters.pushes, 4);
+        ASSERT_EQ(counters.pops, 4);
+        ASSERT_EQ(counters.flagExceptions, 1);
+
+        const std::string json = counters.ToJson();
+        ASSERT_NE(json.find("\"INC\": 4"), std::string::npos);
+        ASSERT_NE(json.find("\"branches\": {\"taken\": 3, \"notTaken\": 1}"), std::string::npos);
+    }
+}
+
+TEST(TestPerfCountersSuite, TestGuestReadsCounters)
+{
+    Assembler asmObj;
+    Memory16 programMemory(0x10000);
+    programMemory.WritePayload(0,
+                               asmObj.AssembleString("SET R0, h'fa00\n"
+                                                     "SET R1, h'fa02\n"
+                                                     "SET R2, h'fa08\n"
+                                                     "LOAD R0, R3 ; cycles so far, low word\n"
+                                                     "LOAD R1, R4\n"
+                                                     "LOAD R2, R5 ; instret\n"
+                                                     "STOP\n"));
+    Processor cpu(programMemory);
+    cpu.GetBus().Map(
+        CounterDevice::DefaultBase, DeviceBus::PageSize, std::make_shared<CounterDevice>(cpu));
+    cpu.ExecuteAll();
+
+    // Sampled before the LOADs reading them ran
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::R3), 3);
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::R4), 0);
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::R5), 5);
+}
+
+TEST(TestPerfCountersSuite, TestRestoreRewindsCounters)
+{
+    Assembler asmObj;
+    Memory16 programMemory(0x10000);
+    programMemory.WritePayload(0,
+                               asmObj.AssembleString("SET R0, 1\n"
+                                                     "INC R0\n"
+                                                     ":Idle\n"
+                                                     "JMP Idle\n"));
+    Processor cpu(programMemory);
+    auto counterDevice = std::make_shared<CounterDevice>(cpu);
+    cpu.GetBus().Map(CounterDevice::DefaultBase, DeviceBus::PageSize, counterDevice);
+    const ProcessorSnapshot start = cpu.Snapshot();
+    ASSERT_EQ(cpu.Run(5000), StopReason::BudgetExhausted);
+    ASSERT_GT(cpu.GetIdleInstructionCount(), 4000);
+
+    std::stringstream file;
+    SnapshotFile::Write(file, cpu.Snapshot());
+    Processor restored(programMemory);
+    restored.Restore(SnapshotFile::Read(file));
+    ASSERT_EQ(restored.GetIdleInstructionCount(), cpu.GetIdleInstructionCount());
+    ASSERT_EQ(restored.GetPerfCounters().instret, cpu.GetPerfCounters().instret);
+    ASSERT_EQ(Retired(restored.GetPerfCounters(), OpCodeId::INC),
+              Retired(cpu.GetPerfCounters(), OpCodeId::INC));
+
+    // Back before the idle loop was skipped over, nothing has run
+    cpu.Restore(start);
+    const PerfCounters counters = cpu.GetPerfCounters();
+    ASSERT_EQ(counters.cycles, 0);
+    ASSERT_LE(counters.instret, counters.cycles);
+    ASSERT_EQ(Retired(counters, OpCodeId::SET), 0);
+    ASSERT_EQ(Retired(counters, OpCodeId::JMP), 0);
+    ASSERT_EQ(counterDevice->Read16(CounterDevice::InstretRegister), 0);
+}
@@ -47,7 +47,7 @@ class TestProcessor : public Processor
         return _instructionArgs[argN];
     }
 
-    std::unordered_map<RegisterId, Register>& GetRegisters()
+    RegisterFile& GetRegisters()
     {
         return _registers;
     }
@@ -59,7 +59,9 @@ class TestProcessor : public Processor
 
     uint16_t DereferenceRegisterRead(RegisterId reg)
     {
-        return _DereferenceRegisterRead(reg);
+        uint16_t value = 0;
+        _DereferenceRegisterRead(reg, value);
+        return value;
     }
 };
 
@@ -102,8 +104,8 @@ TEST(TestProcessorSuite, TestRegisterDereference)
 {
     Memory16 programMemory(0x10000);
     TestProcessor cpu(programMemory);
-    auto& rac = cpu.GetRegisters().at(RegisterId::RAC);
-    rac.Write(0xdead);
+    auto& rac = cpu.GetRegisters().at(static_cast<size_t>(RegisterId::RAC));
+    rac = 0xdead;
 
     // write 0xbeef at the address 0xdead
     cpu.GetMainMemory().Write8(0xdead, 0xbe);
@@ -113,6 +115,24 @@ TEST(TestProcessorSuite, TestRegisterDereference)
     ASSERT_EQ(derefVal, 0xbeef);
 }
 
+TEST(TestProcessorSuite, TestInternalMemoryView)
+{
+    Memory16 programMemory(0x10000);
+    Processor cpu(programMemory);
+    cpu.WriteRegister(RegisterId::R0, 0xbeef);
+
+    // Registers show up big-endian, 2 bytes each, in RegisterId order
+    const Memory8& internalMemory = cpu.GetInternalMemory();
+    ASSERT_EQ(internalMemory.Size(), InternalMemorySize);
+    ASSERT_EQ(internalMemory.Read16(static_cast<uint8_t>(RegisterId::R0) * 2), 0xbeef);
+    ASSERT_EQ(internalMemory.Read16(static_cast<uint8_t>(RegisterId::RSP) * 2),
+              RSP_DefaultAddress);
+
+    // And follow the register file on the next look
+    cpu.WriteRegister(RegisterId::R0, 0xcafe);
+    ASSERT_EQ(cpu.GetInternalMemory().Read16(static_cast<uint8_t>(RegisterId::R0) * 2), 0xcafe);
+}
+
 TEST(TestProcessorPrograms, Test10xLoop)
 {
     Assembler asmObj;
@@ -416,3 +436,160 @@ TEST(TestProcessorPrograms, TestLOAD_STOR)
 }
 
 using Memory16 = Memory<uint16_t>;
+
+TEST(TestProcessorPrograms, TestJMP)
+{
+    Assembler asmObj;
+    std::string program =
+        "SET RAC, h'cafe\n"
+        "JMP SaveFood\n"
+        "STOP\n"
+        ":SaveFood\n"
+        "SET RAC, h'f00d\n"
+        "STOP\n";
+
+    auto binProgram = asmObj.AssembleString(program);
+
+    Memory16 programMemory(0x10000);
+    programMemory.WritePayload(0, binProgram);
+    TestProcessor cpu(programMemory);
+    cpu.ExecuteAll();
+
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::RAC), 0xf00d);
+}
+
+TEST(TestProcessorRun, TestBudgetSlicesMatchExecuteAll)
+{
+    Assembler asmObj;
+    std::string program =
+        "SET R0, 100\n"
+        "SET R10, 0\n"
+        "goto:R2\n"
+        "INC R10\n"
+        "ADD R10, R10, R5\n"
+        "SUB R0, R10, R1\n"
+        "JNZ R1, R2\n"
+        "STOP";
+    auto binProgram = asmObj.AssembleString(program);
+
+    Memory16 referenceMemory(0x10000);
+    referenceMemory.WritePayload(0, binProgram);
+    Processor reference(referenceMemory);
+    reference.ExecuteAll();
+
+    std::vector<ExecutionEngine> engines = {ExecutionEngine::Interpreter};
+    if (JitCompiler::IsAvailable())
+    {
+        engines.push_back(ExecutionEngine::Jit);
+    }
+    for (auto engine : engines)
+    {
+        Memory16 programMemory(0x10000);
+        programMemory.WritePayload(0, binProgram);
+        Processor cpu(programMemory);
+        cpu.SetExecutionEngine(engine);
+        ASSERT_EQ(cpu.Run(5), StopReason::BudgetExhausted);
+        ASSERT_EQ(cpu.GetInstructionCount(), 5);
+        ASSERT_EQ(cpu.ReadRegister(RegisterId::R10), 1);
+
+        // Slices that keep cutting blocks and superinstructions in half
+        StopReason reason;
+        while ((reason = cpu.Run(7)) == StopReason::BudgetExhausted)
+        {
+        }
+        ASSERT_EQ(reason, StopReason::Halted);
+        ASSERT_EQ(cpu.GetInstructionCount(), 3 + 4 * 100 + 1);
+        ASSERT_EQ(cpu.Run(10), StopReason::Halted);
+
+        for (uint8_t i = 0; i < 16; ++i)
+        {
+            ASSERT_EQ(cpu.ReadRegister(static_cast<RegisterId>(i)),
+                      reference.ReadRegister(static_cast<RegisterId>(i)));
+        }
+    }
+}
+
+TEST(TestProcessorRun, TestBreakpointsAndTraps)
+{
+    Assembler asmObj;
+    std::string program =
+        "SET R0, 3\n"
+        "SET R2, Loop\n"
+        ":Loop\n"
+        "DEC R0\n"
+        "INC R1 ; Breakpoint here, in the middle of the loop block\n"
+        "JNZ R0, R2\n"
+        "TRAP\n"
+        "STOP\n";
+
+    Memory16 programMemory(0x10000);
+    programMemory.WritePayload(0, asmObj.AssembleString(program));
+    Processor cpu(programMemory);
+    cpu.AddBreakpoint(10);
+
+    for (uint16_t pass = 0; pass < 3; ++pass)
+    {
+        ASSERT_EQ(cpu.Run(1000), StopReason::Breakpoint);
+        ASSERT_EQ(cpu.ReadRegister(RegisterId::RIP), 10);
+        ASSERT_EQ(cpu.ReadRegister(RegisterId::R1), pass);
+    }
+
+    cpu.RemoveBreakpoint(10);
+    ASSERT_EQ(cpu.Run(1000), StopReason::Trap);
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::R1), 3);
+    // Stays put until someone clears the flag
+    ASSERT_EQ(cpu.Run(1000), StopReason::Trap);
+    cpu.WriteRegister(RegisterId::RFL, 0);
+    ASSERT_EQ(cpu.Run(1000), StopReason::Halted);
+}
+
+TEST(TestProcessorRun, TestFaultsAreReported)
+{
+    Memory16 programMemory(0x10000);
+    Assembler asmObj;
+    programMemory.WritePayload(0, asmObj.AssembleString("SWM ; No NVRAM on this one\n"));
+    Processor cpu(programMemory);
+    ASSERT_EQ(cpu.Run(10), StopReason::Fault);
+    ASSERT_NE(cpu.GetFaultMessage().find("NVRAM"), std::string::npos);
+
+    // Running off the end of the program can't be decoded either
+    Memory16 shortMemory(0x10000);
+    shortMemory.WritePayload(0, asmObj.AssembleString("INC R0\n"));
+    Processor shortCpu(shortMemory);
+    ASSERT_EQ(shortCpu.Run(10), StopReason::Fault);
+    ASSERT_EQ(shortCpu.ReadRegister(RegisterId::R0), 1);
+}
+
+TEST(TestProcessorRun, TestForkSharesStateUpToTheFork)
+{
+    Assembler asmObj;
+    std::string program =
+        "SET R0, h'1000\n"
+        "SET R1, h'cafe\n"
+        "STOR R1, R0 ; Both sides see this one\n"
+        "SET R2, h'1002\n"
+        "STOR R1, R2\n"
+        "LOAD R0, R3\n"
+        "LOAD R2, R4\n"
+        "STOP";
+
+    auto binProgram = asmObj.AssembleString(program);
+
+    Memory16 programMemory(0x10000);
+    programMemory.WritePayload(0, binProgram);
+    Processor cpu(programMemory);
+    ASSERT_EQ(cpu.Run(3), StopReason::BudgetExhausted);
+
+    auto fork = cpu.Fork();
+    ASSERT_EQ(fork->GetInstructionCount(), 3);
+    fork->WriteRegister(RegisterId::R1, 0xbeef);
+
+    ASSERT_EQ(fork->Run(100), StopReason::Halted);
+    ASSERT_EQ(cpu.Run(100), StopReason::Halted);
+
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::R3), 0xcafe);
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::R4), 0xcafe);
+    ASSERT_EQ(fork->ReadRegister(RegisterId::R3), 0xcafe);
+    ASSERT_EQ(fork->ReadRegister(RegisterId::R4), 0xbeef);
+    ASSERT_EQ(fork->GetInstructionCount(), cpu.GetInstructionCount());
+}
@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+
+#include "assembler.h"
+#include "sampling_profiler.h"
+
+namespace
+{
+// A short setup, then nearly all the time in the three lines of :Loop
+const std::string program =
+    "SET R0, 3000\n"
+    "SET R10, 0\n"
+    "SET R2, Loop\n"
+    ":Loop\n"
+    "INC R10\n"
+    "SUB R0, R10, R1\n"
+    "JNZ R1, R2\n"
+    ":Done\n"
+    "STOP\n";
+}  // namespace
+
+TEST(TestSamplingProfilerSuite, TestSamplesLandInTheLoop)
+{
+    Assembler asmObj;
+    Memory16 programMemory(0x10000);
+    programMemory.WritePayload(0, asmObj.AssembleString(program));
+    const DebugLineTable lines = asmObj.GetLineTable();
+    Processor cpu(programMemory);
+
+    SamplingProfiler profiler(cpu, 7);
+    cpu.ExecuteAll();
+
+    // 3 SETs, 3000 turns of 3, the STOP
+    ASSERT_EQ(profiler.GetSampleCount(), (3 + 3 * 3000 + 1) / 7);
+    uint64_t inLoop = 0;
+    for (const auto& [address, count] : profiler.GetSamples())
+    {
+        if (lines.TagAt(address) == "Loop")
+        {
+            inLoop += count;
+        }
+    }
+    ASSERT_GE(inLoop, profiler.GetSampleCount() - 1);
+
+    const std::string report = profiler.Report(lines);
+    ASSERT_NE(report.find("Loop"), std::string::npos);
+    ASSERT_NE(report.find("line 6"), std::string::npos);
+
+    std::stringstream folded;
+    profiler.WriteFoldedStacks(folded, lines);
+    std::string stack;
+    uint64_t total = 0;
+    for (std::string record; std::getline(folded, record);)
+    {
+        const auto space = record.rfind(' ');
+        ASSERT_NE(space, std::string::npos);
+        ASSERT_EQ(record.rfind("Loop;line ", 0) == 0 || record.rfind("_start;", 0) == 0, true)
+            << record;
+        total += std::stoull(record.substr(space + 1));
+    }
+    ASSERT_EQ(total, profiler.GetSampleCount());
+}
+
+TEST(TestSamplingProfilerSuite, TestStopsSamplingWhenGone)
+{
+    Assembler asmObj;
+    Memory16 programMemory(0x10000);
+    programMemory.WritePayload(0, asmObj.AssembleString(program));
+    Processor cpu(programMemory);
+    {
+        SamplingProfiler profiler(cpu, 100);
+        ASSERT_EQ(cpu.GetScheduler().Pending(), 1);
+    }
+    ASSERT_EQ(cpu.GetScheduler().Pending(), 0);
+    EXPECT_THROW(SamplingProfiler(cpu, 0), std::invalid_argument);
+}
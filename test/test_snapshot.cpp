@@ -0,0 +1,182 @@
+#include <gtest/gtest.h>
+
+#include "assembler.h"
+#include "processor.h"
+#include "snapshot_file.h"
+
+namespace
+{
+// Keeps a running sum in R5 and stores every step of it at 0x2000 + 2 * step
+const std::string program =
+    "SET R0, 50\n"
+    "SET R10, 0\n"
+    "SET R6, h'2000\n"
+    "SET R7, 2\n"
+    "goto:R2\n"
+    "INC R10\n"
+    "ADD R5, R10, R5\n"
+    "STOR R5, R6\n"
+    "ADD R6, R7, R6\n"
+    "SUB R0, R10, R1\n"
+    "JNZ R1, R2\n"
+    "LOAD R6, R8\n"
+    "STOP";
+
+RegisterFile Registers(const Processor& cpu)
+{
+    RegisterFile registers{};
+    for (size_t i = 0; i < registers.size(); ++i)
+    {
+        registers[i] = cpu.ReadRegister(static_cast<RegisterId>(i));
+    }
+    return registers;
+}
+}  // namespace
+
+TEST(TestSnapshotSuite, TestRestoreRewinds)
+{
+    Assembler asmObj;
+    Memory16 programMemory(0x10000);
+    programMemory.WritePayload(0, asmObj.AssembleString(program));
+    Processor cpu(programMemory);
+
+    ASSERT_EQ(cpu.Run(100), StopReason::BudgetExhausted);
+    const ProcessorSnapshot checkpoint = cpu.Snapshot();
+    const RegisterFile atCheckpoint = Registers(cpu);
+
+    ASSERT_EQ(cpu.Run(1000), StopReason::Halted);
+    const RegisterFile atEnd = Registers(cpu);
+    const uint64_t instructions = cpu.GetInstructionCount();
+
+    cpu.Restore(checkpoint);
+    ASSERT_EQ(Registers(cpu), atCheckpoint);
+    ASSERT_EQ(cpu.GetInstructionCount(), 100);
+    // Steps stored after the checkpoint are gone again
+    const uint16_t nextStep = cpu.ReadRegister(RegisterId::R6);
+    ASSERT_NE(cpu.Snapshot().sram.Read16(nextStep - 2), 0);
+    ASSERT_EQ(cpu.Snapshot().sram.Read16(nextStep), 0);
+
+    ASSERT_EQ(cpu.Run(1000), StopReason::Halted);
+    ASSERT_EQ(Registers(cpu), atEnd);
+    ASSERT_EQ(cpu.GetInstructionCount(), instructions);
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::R5), 50 * 51 / 2);
+}
+
+TEST(TestSnapshotSuite, TestFileRoundTrip)
+{
+    Assembler asmObj;
+    Memory16 programMemory(0x10000);
+    programMemory.WritePayload(0, asmObj.AssembleString(program));
+    Processor cpu(programMemory);
+    ASSERT_EQ(cpu.Run(137), StopReason::BudgetExhausted);
+
+    std::stringstream file;
+    SnapshotFile::Write(file, cpu.Snapshot());
+    // The stored steps fit in one page, the rest of the 64 KiB is left out
+    ASSERT_LT(file.str().size(), 512);
+
+    Processor restored(programMemory);
+    restored.Restore(SnapshotFile::Read(file));
+    ASSERT_EQ(Registers(restored), Registers(cpu));
+
+    ASSERT_EQ(restored.Run(1000), StopReason::Halted);
+    ASSERT_EQ(cpu.Run(1000), StopReason::Halted);
+    ASSERT_EQ(Registers(restored), Registers(cpu));
+    ASSERT_EQ(restored.GetInstructionCount(), cpu.GetInstructionCount());
+}
+
+TEST(TestSnapshotSuite, TestRejectsBadFiles)
+{
+    Memory16 programMemory(0x10000);
+    Processor cpu(programMemory);
+    std::stringstream file;
+    SnapshotFile::Write(file, cpu.Snapshot());
+    const std::string good = file.str();
+
+    std::stringstream badMagic("LXSX" + good.substr(4));
+    ASSERT_THROW(SnapshotFile::Read(badMagic), std::runtime_error);
+
+    std::string newer = good;
+    newer[5] = static_cast<char>(SnapshotFile::Version + 1);
+    std::stringstream badVersion(newer);
+    ASSERT_THROW(SnapshotFile::Read(badVersion), std::runtime_error);
+
+    std::stringstream truncated(good.substr(0, good.size() - 3));
+    ASSERT_THROW(SnapshotFile::Read(truncated), std::runtime_error);
+
+    // Right after the magic, version, registers, NVRAM flag, count, breakpoint and cycle
+    std::string badOpCode = good;
+    ASSERT_EQ(static_cast<uint8_t>(badOpCode[51]), static_cast<uint8_t>(OpCodeId::INVALID_INSTR));
+    badOpCode[51] = static_cast<char>(static_cast<uint8_t>(OpCodeId::INVALID_INSTR) + 1);
+    std::stringstream badOpCodeFile(badOpCode);
+    ASSERT_THROW(SnapshotFile::Read(badOpCodeFile), std::runtime_error);
+
+    // Selecting NVRAM needs NVRAM to restore into
+    ProcessorSnapshot snapshot = cpu.Snapshot();
+    snapshot.nvramSelected = true;
+    ASSERT_THROW(cpu.Restore(snapshot), std::runtime_error);
+}
+
+TEST(TestSnapshotSuite, TestPendingInterruptSurvives)
+{
+    // The program with a handler that stops right away at h'0200
+    Assembler asmObj;
+    auto binProgram = asmObj.AssembleString(program);
+    binProgram.resize(0x200);
+    const auto handler = asmObj.AssembleString("STOP");
+    binProgram.insert(binProgram.end(), handler.begin(), handler.end());
+    Memory16 programMemory(0x10000);
+    programMemory.WritePayload(0, binProgram);
+    Processor cpu(programMemory);
+    ASSERT_EQ(cpu.Run(10), StopReason::BudgetExhausted);
+    const ProcessorSnapshot quiet = cpu.Snapshot();
+    // No vector table yet, the interrupt waits
+    cpu.RaiseInterrupt();
+    ASSERT_EQ(cpu.Run(1), StopReason::BudgetExhausted);
+
+    std::stringstream file;
+    SnapshotFile::Write(file, cpu.Snapshot());
+    const ProcessorSnapshot pending = SnapshotFile::Read(file);
+    ASSERT_TRUE(pending.interruptPending);
+    ASSERT_EQ(pending.fault, Fault::None);
+
+    // The handler is entered on the next run only if the interrupt came back
+    Processor restored(programMemory);
+    restored.SetVectorTable(0x0100);
+    ProcessorSnapshot withTable = pending;
+    withTable.sram.Write16(0x0100, 0x0200);
+    restored.Restore(withTable);
+    ASSERT_EQ(restored.Run(10), StopReason::Halted);
+    ASSERT_EQ(restored.ReadRegister(RegisterId::RIP), 0x0202);
+
+    // Restoring a snapshot from before the interrupt drops it again
+    withTable = quiet;
+    withTable.sram.Write16(0x0100, 0x0200);
+    restored.Restore(withTable);
+    ASSERT_EQ(restored.Run(10), StopReason::BudgetExhausted);
+}
+
+TEST(TestSnapshotSuite, TestFullSramStaysSmall)
+{
+    // No two neighbouring bytes alike, the worst case for run lengths
+    Memory16 programMemory(0x10000);
+    Processor cpu(programMemory);
+    ProcessorSnapshot snapshot = cpu.Snapshot();
+    for (uint32_t address = 0; address < MainMemorySize; address += 2)
+    {
+        snapshot.sram.Write16(static_cast<uint16_t>(address),
+                              static_cast<uint16_t>(address * 0x9e37 + 0x0101));
+    }
+
+    std::stringstream file;
+    SnapshotFile::Write(file, snapshot);
+    // Every page plus its index, and the fixed fields
+    ASSERT_LT(file.str().size(), MainMemorySize + 2 * MainMemorySize / Memory16::PageSize + 128);
+
+    const ProcessorSnapshot read = SnapshotFile::Read(file);
+    for (uint32_t address = 0; address < MainMemorySize; address += 2)
+    {
+        ASSERT_EQ(read.sram.Read16(static_cast<uint16_t>(address)),
+                  snapshot.sram.Read16(static_cast<uint16_t>(address)));
+    }
+}
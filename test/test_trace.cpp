@@ -0,0 +1,154 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+
+#include "assembler.h"
+#include "processor.h"
+#include "scratch_file.h"
+#include "spsc_ring.h"
+
+namespace
+{
+const std::string tracedProgram =
+    "SET R0, 5\n"
+    "SET R10, 0\n"
+    "SET R3, h'2000\n"
+    "goto:R2\n"
+    "STOR R10, R3\n"
+    "PUSH R10\n"
+    "INC R10\n"
+    "SUB R0, R10, R1\n"
+    "JNZ R1, R2\n"
+    "STOP\n";
+
+// Runs tracedProgram, traced into filename when there is one
+std::unique_ptr<Processor> RunTraced(Memory16& programMemory, const std::string& filename)
+{
+    Assembler asmObj;
+    programMemory.WritePayload(0, asmObj.AssembleString(tracedProgram));
+    auto cpu = std::make_unique<Processor>(programMemory);
+    std::shared_ptr<TraceWriter> writer;
+    if (!filename.empty())
+    {
+        writer = std::make_shared<TraceWriter>(filename, 64);
+        cpu->SetTraceWriter(writer);
+    }
+    cpu->ExecuteAll();
+    if (writer)
+    {
+        writer->Close();
+    }
+    return cpu;
+}
+}  // namespace
+
+TEST(TestTraceSuite, TestSpscRing)
+{
+    SpscRing<uint8_t> ring(6);
+    ASSERT_EQ(ring.Capacity(), 8);
+    const uint8_t items[] = {1, 2, 3, 4, 5, 6};
+    ASSERT_TRUE(ring.TryPush(items, 6));
+    ASSERT_FALSE(ring.TryPush(items, 3));
+    uint8_t out[8] = {};
+    ASSERT_EQ(ring.Pop(out, 4), 4);
+    ASSERT_EQ(out[3], 4);
+    // Wraps around the end
+    ASSERT_TRUE(ring.TryPush(items, 6));
+    ASSERT_EQ(ring.Pop(out, 8), 8);
+    ASSERT_EQ(out[0], 5);
+    ASSERT_EQ(out[2], 1);
+    ASSERT_EQ(out[7], 6);
+    ASSERT_EQ(ring.Pop(out, 8), 0);
+
+    // Everything makes it across, in order
+    SpscRing<uint32_t> shared(64);
+    constexpr uint32_t Count = 100000;
+    std::thread producer([&shared] {
+        for (uint32_t i = 0; i < Count;)
+        {
+            if (shared.TryPush(&i, 1))
+            {
+                ++i;
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+    });
+    uint32_t expected = 0;
+    while (expected < Count)
+    {
+        uint32_t batch[16];
+        const size_t count = shared.Pop(batch, 16);
+        if (count == 0)
+        {
+            std::this_thread::yield();
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            ASSERT_EQ(batch[i], expected++);
+        }
+    }
+    producer.join();
+}
+
+TEST(TestTraceSuite, TestTraceReplaysTheRun)
+{
+    const ScratchFile scratch("trace");
+    const std::string& filename = scratch.name;
+    Memory16 programMemory(0x10000);
+    const auto cpu = RunTraced(programMemory, filename);
+    Memory16 untracedMemory(0x10000);
+    const auto untraced = RunTraced(untracedMemory, "");
+
+    std::ifstream file(filename, std::ios::binary);
+    TraceDecoder decoder(file);
+    TraceRecord record;
+    std::vector<TraceRecord> records;
+    while (decoder.Next(record))
+    {
+        records.push_back(record);
+    }
+    ASSERT_EQ(records.size(), cpu->GetInstructionCount());
+    ASSERT_EQ(cpu->GetInstructionCount(), untraced->GetInstructionCount());
+
+    // The registers everything left behind, RIP being where the STOP is
+    for (size_t reg = 0; reg < static_cast<size_t>(RegisterId::END_OF_REGLIST); ++reg)
+    {
+        const auto id = static_cast<RegisterId>(reg);
+        ASSERT_EQ(untraced->ReadRegister(id), cpu->ReadRegister(id));
+        if (id != RegisterId::RIP)
+        {
+            ASSERT_EQ(decoder.Registers()[reg], cpu->ReadRegister(id)) << reg;
+        }
+    }
+    ASSERT_EQ(records.back().instruction, 0x7691);  // STOP
+    ASSERT_EQ(records.front().literal, 5);
+
+    // One STOR and one PUSH per turn
+    std::vector<std::pair<uint16_t, uint16_t>> stores;
+    for (const auto& traced : records)
+    {
+        stores.insert(stores.end(), traced.memory.begin(), traced.memory.end());
+    }
+    ASSERT_EQ(stores.size(), 10);
+    ASSERT_EQ(stores[2], (std::pair<uint16_t, uint16_t>{0x2000, 1}));
+    ASSERT_EQ(stores[3], (std::pair<uint16_t, uint16_t>{RSP_DefaultAddress + 2, 1}));
+    file.close();
+
+    // Cut short in the middle of a record
+    std::ifstream whole(filename, std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(whole)), {});
+    std::stringstream truncated(bytes.substr(0, bytes.size() - 1));
+    TraceDecoder cut(truncated);
+    EXPECT_THROW(
+        {
+            while (cut.Next(record))
+            {
+            }
+        },
+        std::runtime_error);
+    std::stringstream garbage("not a trace");
+    EXPECT_THROW(TraceDecoder{garbage}, std::runtime_error);
+}
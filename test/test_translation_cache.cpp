@@ -0,0 +1,183 @@
+#include <gtest/gtest.h>
+
+#include "assembler.h"
+#include "memory.h"
+#include "processor.h"
+
+using Memory16 = Memory<uint16_t>;
+
+TEST(TestTranslationCacheSuite, TestBlocksEndOnControlFlow)
+{
+    Assembler asmObj;
+    std::string program =
+        "SET R0, 10\n"
+        "INC R1\n"
+        "MOV R1, RFL ; Writing RFL ends a block\n"
+        "ADD R0, R1, R2\n"
+        "JZ R0, R1\n"
+        "STOP\n";
+
+    Memory16 programMemory(0x10000);
+    programMemory.WritePayload(0, asmObj.AssembleString(program));
+    TranslationCache cache(programMemory);
+
+    const BasicBlock* block = cache.Lookup(0);
+    ASSERT_EQ(block->instructions.size(), 3);
+    ASSERT_EQ(block->endAddress, 8);
+    ASSERT_EQ(block->instructions[0].decoded.opCodeId, OpCodeId::SET);
+    ASSERT_EQ(block->instructions[0].literal, 10);
+    ASSERT_EQ(block->instructions[0].nextAddress, 4);
+
+    block = cache.Lookup(8);
+    ASSERT_EQ(block->instructions.size(), 2);
+    ASSERT_EQ(block->instructions[1].decoded.opCodeId, OpCodeId::JZ);
+
+    // Past the end of the payload nothing can be translated
+    block = cache.Lookup(14);
+    ASSERT_EQ(block->instructions.size(), 0);
+
+    cache.Lookup(0);
+    ASSERT_EQ(cache.GetStats().misses, 3);
+    ASSERT_EQ(cache.GetStats().hits, 1);
+}
+
+TEST(TestTranslationCacheSuite, TestLoopRunsFromCache)
+{
+    Assembler asmObj;
+    std::string program =
+        "SET R0, 100\n"
+        "SET R10, 0\n"
+        "goto:R2\n"
+        "INC R10\n"
+        "SUB R0, R10, R1\n"
+        "JNZ R1, R2\n"
+        "STOP";
+
+    Memory16 programMemory(0x10000);
+    programMemory.WritePayload(0, asmObj.AssembleString(program));
+    Processor cpu(programMemory);
+    cpu.ExecuteAll();
+
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::R10), 100);
+    // The prologue, the loop body and the STOP
+    ASSERT_EQ(cpu.GetTranslationCacheStats().misses, 3);
+    ASSERT_EQ(cpu.GetTranslationCacheStats().hits, 98);
+    ASSERT_EQ(cpu.GetTranslationCacheStats().invalidations, 0);
+}
+
+TEST(TestTranslationCacheSuite, TestWritesInvalidateCachedCode)
+{
+    Assembler asmObj;
+    std::string program =
+        "SET R0, 3\n"
+        "SET R2, Loop\n"
+        ":Loop\n"
+        "SET R1, h'1111 ; The literal lives at address 10\n"
+        "DEC R0\n"
+        "TRAP\n"
+        "JNZ R0, R2\n"
+        "STOP\n";
+
+    Memory16 programMemory(0x10000);
+    programMemory.WritePayload(0, asmObj.AssembleString(program));
+    Processor cpu(programMemory);
+
+    // Blocks at 0 and at Loop both contain the SET R1
+    cpu.ExecuteAll();
+    cpu.WriteRegister(RegisterId::RFL, 0);
+    cpu.ExecuteAll();
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::R1), 0x1111);
+
+    // Writing somewhere no block lives costs nothing, the STOP hasn't been translated yet
+    programMemory.Write8(18, 0x76);
+    ASSERT_EQ(cpu.GetTranslationCacheStats().invalidations, 0);
+
+    programMemory.Write16(10, 0x2222);
+    ASSERT_EQ(cpu.GetTranslationCacheStats().invalidations, 2);
+
+    cpu.WriteRegister(RegisterId::RFL, 0);
+    cpu.ExecuteAll();
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::R1), 0x2222);
+    ASSERT_EQ(cpu.ReadRegister(RegisterId::R0), 0);
+}
+
+TEST(TestTranslationCacheSuite, TestFusesKnownSequences)
+{
+    Assembler asmObj;
+    std::string program =
+        "SET R0, 1\n"
+        "SET R1, 2\n"
+        "SET R2, 3 ; Left alone, its neighbour is taken\n"
+        "INC R10\n"
+        "SUB R0, R10, R1\n"
+        "JNZ R1, R2\n"
+        "SUB R0, R10, R1\n"
+        "JNZ R1, RIP ; RIP operands are never fused\n";
+
+    Memory16 programMemory(0x10000);
+    programMemory.WritePayload(0, asmObj.AssembleString(program));
+    TranslationCache cache(programMemory);
+
+    const BasicBlock* block = cache.Lookup(0);
+    ASSERT_EQ(block->instructions.size(), 6);
+    ASSERT_EQ(block->instructions[0].fused, FusedOp::SetSet);
+    ASSERT_EQ(block->instructions[1].fused, FusedOp::None);
+    ASSERT_EQ(block->instructions[2].fused, FusedOp::None);
+    ASSERT_EQ(block->instructions[3].fused, FusedOp::IncSubJnz);
+    ASSERT_EQ(block->instructions[4].fused, FusedOp::None);
+
+    block = cache.Lookup(block->endAddress);
+    ASSERT_EQ(block->instructions.size(), 2);
+    ASSERT_EQ(block->instructions[0].fused, FusedOp::None);
+    ASSERT_EQ(cache.GetStats().fusedGroups, 2);
+
+    // Turning fusion off drops what was translated with it
+    cache.SetFusion(false);
+    ASSERT_EQ(cache.Lookup(0)->instructions[0].fused, FusedOp::None);
+}
+
+TEST(TestTranslationCacheSuite, TestFusedMatchesUnfused)
+{
+    Assembler asmObj;
+    std::string program =
+        "SET R0, 20\n"
+        "SET R5, 0\n"
+        "goto:R2\n"
+        "INC R5\n"
+        "SUB R0, R5, R6\n"
+        "JNZ R6, R2 ; INC, SUB, JNZ\n"
+        "SET R7, 10\n"
+        "SET R8, 0\n"
+        "goto:R3\n"
+        "DEC R7\n"
+        "DEC R7\n"
+        "JNZ R7, R3 ; DEC, DEC, JNZ\n"
+        "SET R9, 100\n"
+        "goto:R4\n"
+        "ADD R8, R0, R8\n"
+        "SUB R9, R8, R1\n"
+        "JNZ R1, R4 ; SUB, JNZ\n"
+        "INC R10\n"
+        "SUB R10, R5, R10 ; INC, SUB\n"
+        "STOP\n";
+    auto binProgram = asmObj.AssembleString(program);
+
+    std::array<std::array<uint16_t, 16>, 2> registers;
+    for (bool fusion : {false, true})
+    {
+        Memory16 programMemory(0x10000);
+        programMemory.WritePayload(0, binProgram);
+        Processor cpu(programMemory);
+        cpu.SetSuperinstructions(fusion);
+        cpu.ExecuteAll();
+        ASSERT_EQ(cpu.GetTranslationCacheStats().fusedGroups > 0, fusion);
+
+        for (uint8_t i = 0; i < 16; ++i)
+        {
+            registers[fusion][i] = cpu.ReadRegister(static_cast<RegisterId>(i));
+        }
+    }
+    ASSERT_EQ(registers[0], registers[1]);
+    ASSERT_EQ(registers[1][static_cast<size_t>(RegisterId::R8)], 100);
+    ASSERT_EQ(registers[1][static_cast<size_t>(RegisterId::R10)], static_cast<uint16_t>(1 - 20));
+}
@@ -3,13 +3,15 @@
 Simple opcode codegen script.
 Usage: python3 tools/generate_opcodes.py instructions.csv [out.cpp]
 
-CSV format (header): id,mnemonic,value,argCount,derefMask
+CSV format (header): id,mnemonic,value,argCount,derefMask,literal
 Example line:
-ADD,ADD,0x0,3,0b000
+ADD,ADD,0x0,3,0b000,0
+
+literal is 1 for instructions followed by a 16 bit literal word (SET, JMP).
 
 This script outputs a C++ file defining opCodeTable, opCodeDereferenceMap,
-mnemonicTable, opCodeMnemonicTable, opCodeValuesTable, registerMap and
-registerNameTable based on the CSV.
+mnemonicTable, opCodeMnemonicTable, opCodeValuesTable and decodeTable based
+on the CSV. decodeTable has one entry per possible instruction word.
 If an output path is provided, the file is written there; otherwise written to stdout.
 """
 import sys
@@ -34,7 +36,8 @@ with open(infile, newline='') as f:
             'mnemonic': row.get('mnemonic', row['id']).strip(),
             'value': row['value'].strip(),
             'argCount': int(row['argCount'].strip()),
-            'derefMask': row.get('derefMask', '0').strip()
+            'derefMask': row.get('derefMask', '0').strip(),
+            'literal': int((row.get('literal') or '0').strip())
         })
 
 # First, try to read register definitions from a canonical CSV (tools/registers.csv)
@@ -92,6 +95,41 @@ for op in ops:
     append(f"    {{{fmt_hex(op['value'])}, OpCodeId::{op['id']}}},")
 append('};')
 append('')
+
+# Every instruction is a single 16 bit word: the opcode value followed by one
+# nibble per register argument. Precompute the decoding of all of them.
+decode = [None] * 0x10000
+for op in ops:
+    shift = 4 * op['argCount']
+    start = int(fmt_hex(op['value']), 16) << shift
+    end = start + (1 << shift)
+    if end > 0x10000:
+        sys.exit(f"Opcode {op['id']} does not fit in an instruction word")
+    for word in range(start, end):
+        if decode[word] is not None:
+            sys.exit(f"Opcode {op['id']} overlaps {decode[word]['id']} at {word:#06x}")
+        decode[word] = op
+
+def decode_entry(word):
+    op = decode[word]
+    if op is None:
+        return '{O::INVALID_INSTR, 0, false, {}}'
+    n = op['argCount']
+    regs = ', '.join(f"R({(word >> (4 * (n - 1 - i))) & 0xf})" for i in range(n))
+    literal = 'true' if op['literal'] else 'false'
+    return f"{{O::{op['id']}, {n}, {literal}, {{{regs}}}}}"
+
+append('namespace')
+append('{')
+append('using O = OpCodeId;')
+append('using R = RegisterId;')
+append('}  // namespace')
+append('')
+append('constexpr std::array<DecodedInstruction, 0x10000> decodeTable = {{')
+for word in range(0, 0x10000, 4):
+    append('    ' + ', '.join(decode_entry(w) for w in range(word, word + 4)) + ',')
+append('}};')
+append('')
 # Registers are provided by src/register_table.cpp
 
 output = "\n".join(lines_out) + "\n"
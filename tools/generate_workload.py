@@ -0,0 +1,238 @@
+#!/usr/bin/env python3
+"""
+Synthetic workload generator.
+Usage: python3 tools/generate_workload.py [options] [-o out.txt]
+
+Emits a valid Luinux assembly program made of a loop body of --instructions
+instructions run --iterations times, then STOP. What the body does is
+controlled by:
+
+  --mix alu=4,mem=2,stack=1,move=2   relative weight of each kind of instruction
+  --branch-density 0.1               share of the body that is a conditional
+                                     forward branch over a few instructions
+  --footprint 4096                   bytes of SRAM LOAD and STOR spread over
+  --stack-depth 8                    deepest the stack gets within a turn
+  --swm-every 0                      a SWM every N instructions, 0 for none
+
+Branches depend on the values the body computes, so some are taken and some
+aren't. The stack is back where it started and SRAM is selected again at the
+end of every turn. Programs with SWM need NVRAM to run, pass an NVRAM file to
+luinuxcpu or in the luinuxbatch manifest.
+
+The same --seed gives the same program. The program is written to stdout
+unless -o is given.
+"""
+import argparse
+import random
+import sys
+
+# Registers with a fixed job, everything else is data
+COUNTER = 'R0'
+LOOP = 'R2'
+TARGET = 'R8'
+SCRATCH = 'R9'
+DATA = ['R1', 'R3', 'R4', 'R5', 'R6', 'R7', 'R10']
+
+MEMORY_BASE = 0x1000
+# Clear of the stack and of the default device pages above it
+MEMORY_LIMIT = 0xf000
+
+ALU3 = ['ADD', 'SUB', 'MUL', 'AND', 'OR', 'XOR', 'SMUL']
+ALU1 = ['NOT', 'SHFR', 'SHFL']
+JUMPS = ['JZ', 'JNZ', 'JE', 'JNE']
+KINDS = ['alu', 'mem', 'stack', 'move']
+
+# Program memory is 64 KB of 16 bit words
+MAX_WORDS = 0x8000
+
+
+def parse_mix(text):
+    mix = dict.fromkeys(KINDS, 0)
+    for item in text.split(','):
+        kind, _, weight = item.partition('=')
+        kind = kind.strip()
+        if kind not in mix:
+            raise ValueError('unknown instruction kind %r, expected one of %s'
+                             % (kind, ', '.join(KINDS)))
+        mix[kind] = float(weight)
+        if mix[kind] < 0:
+            raise ValueError('negative weight for %s' % kind)
+    if sum(mix.values()) <= 0:
+        raise ValueError('the mix has no weight')
+    return mix
+
+
+class Generator:
+    def __init__(self, args):
+        self.args = args
+        self.rng = random.Random(args.seed)
+        self.mix = parse_mix(args.mix)
+        self.lines = []
+        self.words = 0
+        self.depth = 0
+        self.nvram = False
+        self.tags = 0
+
+    def emit(self, line, words=1):
+        self.lines.append(line)
+        self.words += words
+
+    def data(self):
+        return self.rng.choice(DATA)
+
+    def address(self):
+        return MEMORY_BASE + 2 * self.rng.randrange(max(1, self.args.footprint // 2))
+
+    def alu(self):
+        roll = self.rng.random()
+        if roll < 0.1:
+            # Divisor from a literal so it's never 0
+            self.emit('SET %s, %d' % (SCRATCH, self.rng.randint(1, 255)), 2)
+            self.emit('%s %s, %s, %s' % (self.rng.choice(['DIV', 'SDIV']), self.data(), SCRATCH,
+                                         self.data()))
+        elif roll < 0.25:
+            self.emit('%s %s' % (self.rng.choice(ALU1), self.data()))
+        elif roll < 0.3:
+            self.emit('TSTB %s, %s' % (self.data(), self.data()))
+        else:
+            self.emit('%s %s, %s, %s' % (self.rng.choice(ALU3), self.data(), self.data(),
+                                         self.data()))
+
+    def mem(self):
+        self.emit('SET %s, h\'%04x' % (SCRATCH, self.address()), 2)
+        if self.rng.random() < 0.5:
+            self.emit('LOAD %s, %s' % (SCRATCH, self.data()))
+        else:
+            self.emit('STOR %s, %s' % (self.data(), SCRATCH))
+
+    def stack(self):
+        push = self.depth == 0 or (self.depth < self.args.stack_depth and self.rng.random() < 0.5)
+        if push:
+            self.emit('PUSH %s' % self.data())
+            self.depth += 1
+        else:
+            self.emit('POP %s' % self.data())
+            self.depth -= 1
+
+    def move(self):
+        roll = self.rng.random()
+        if roll < 0.3:
+            self.emit('MOV %s, %s' % (self.data(), self.data()))
+        elif roll < 0.5:
+            self.emit('SET %s, %d' % (self.data(), self.rng.randrange(0x10000)), 2)
+        elif roll < 0.9:
+            self.emit('%s %s' % (self.rng.choice(['INC', 'DEC']), self.data()))
+        else:
+            self.emit('%s %s' % (self.rng.choice(['SETZ', 'SETO']), self.data()))
+
+    def instruction(self, skippable):
+        kinds = [kind for kind in KINDS if self.mix[kind] > 0]
+        # A branch may skip it, so the stack has to be left alone
+        if skippable or self.args.stack_depth == 0:
+            kinds = [kind for kind in kinds if kind != 'stack']
+        weights = [self.mix[kind] for kind in kinds]
+        if not kinds:
+            # A mix of nothing but the stack, moves stand in with a weight of their own
+            kinds, weights = ['move'], [1]
+        kind = self.rng.choices(kinds, weights)[0]
+        getattr(self, kind)()
+
+    def branch(self, budget):
+        tag = 'Skip%d' % self.tags
+        self.tags += 1
+        self.emit('SET %s, %s' % (TARGET, tag), 2)
+        self.emit('%s %s, %s' % (self.rng.choice(JUMPS), self.data(), TARGET))
+        skipped = self.rng.randint(1, max(1, min(8, budget)))
+        for _ in range(skipped):
+            self.instruction(skippable=True)
+        self.emit(':%s' % tag, 0)
+        return 2 + skipped
+
+    def body(self):
+        count = 0
+        since_swm = 0
+        while count < self.args.instructions:
+            if self.args.swm_every and since_swm >= self.args.swm_every:
+                self.emit('SWM')
+                self.nvram = not self.nvram
+                since_swm = 0
+                count += 1
+                continue
+            if self.rng.random() < self.args.branch_density:
+                done = self.branch(self.args.instructions - count - 2)
+            else:
+                self.instruction(skippable=False)
+                done = 1
+            count += done
+            since_swm += done
+        while self.depth > 0:
+            self.emit('POP %s' % self.data())
+            self.depth -= 1
+        if self.nvram:
+            self.emit('SWM')
+            self.nvram = False
+
+    def generate(self):
+        args = self.args
+        self.emit('; generated by tools/generate_workload.py --instructions %d --iterations %d '
+                  '--mix %s --branch-density %g --footprint %d --stack-depth %d --swm-every %d '
+                  '--seed %d' % (args.instructions, args.iterations, args.mix, args.branch_density,
+                                 args.footprint, args.stack_depth, args.swm_every, args.seed), 0)
+        self.emit('SET %s, %d' % (COUNTER, args.iterations), 2)
+        for register in DATA:
+            self.emit('SET %s, %d' % (register, self.rng.randrange(0x10000)), 2)
+        self.emit('goto:%s' % LOOP, 2)
+        self.body()
+        self.emit('DEC %s' % COUNTER)
+        self.emit('JNZ %s, %s' % (COUNTER, LOOP))
+        self.emit('STOP')
+        if self.words > MAX_WORDS:
+            raise ValueError('the program takes %d words, more than the %d of program memory, '
+                             'ask for fewer instructions' % (self.words, MAX_WORDS))
+        return '\n'.join(self.lines) + '\n'
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Generates a synthetic Luinux workload.')
+    parser.add_argument('--instructions', type=int, default=1000,
+                        help='instructions in the loop body')
+    parser.add_argument('--iterations', type=int, default=100, help='turns of the loop')
+    parser.add_argument('--mix', default='alu=4,mem=2,stack=1,move=2',
+                        help='weights of ' + ', '.join(KINDS))
+    parser.add_argument('--branch-density', type=float, default=0.1,
+                        help='share of the body that is a conditional branch')
+    parser.add_argument('--footprint', type=int, default=4096,
+                        help='bytes of SRAM the body reads and writes')
+    parser.add_argument('--stack-depth', type=int, default=8,
+                        help='deepest the stack gets')
+    parser.add_argument('--swm-every', type=int, default=0,
+                        help='a SWM every N instructions, 0 for none')
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('-o', '--output', help='file to write, stdout otherwise')
+    args = parser.parse_args()
+
+    if args.instructions < 1:
+        parser.error('--instructions has to be at least 1')
+    if not 1 <= args.iterations <= 0xffff:
+        parser.error('--iterations has to be between 1 and 65535')
+    if not 0 <= args.branch_density <= 1:
+        parser.error('--branch-density has to be between 0 and 1')
+    if not 2 <= args.footprint <= MEMORY_LIMIT - MEMORY_BASE:
+        parser.error('--footprint has to be between 2 and %d' % (MEMORY_LIMIT - MEMORY_BASE))
+    if args.stack_depth < 0 or args.swm_every < 0:
+        parser.error('--stack-depth and --swm-every can\'t be negative')
+
+    try:
+        program = Generator(args).generate()
+    except ValueError as e:
+        print('generate_workload.py: %s' % e, file=sys.stderr)
+        sys.exit(1)
+    if args.output:
+        with open(args.output, 'w') as f:
+            f.write(program)
+    else:
+        sys.stdout.write(program)
+
+
+if __name__ == '__main__':
+    main()